@@ -3,10 +3,13 @@
 #include <vector>
 #include <cmath>
 #include "mist/core.hpp"
+#include "mist/array.hpp"
+#include "mist/boundary.hpp"
 #include "mist/serialize.hpp"
 #include "mist/ascii_reader.hpp"
 #include "mist/ascii_writer.hpp"
 #include "mist/driver.hpp"
+#include "mist/memory.hpp"
 
 using namespace mist;
 
@@ -114,20 +117,21 @@ auto euler_step(
     double dx = cfg.domain_length / cfg.num_zones;
     double v = cfg.advection_velocity;
 
+    // Copy the state into an array with one periodic ghost zone on each
+    // side, held in the driver's per-step arena
+    auto padded = expand(state.grid, 1);
+    auto buffer = scratch<double>(size(padded));
+    auto u = view(buffer, padded);
+
+    assign(u, view(state.conserved, state.grid), state.grid, cpu_t{});
+    fill_ghosts(u, state.grid, boundary_conditions<1>(boundary::periodic));
+
     // First-order upwind scheme
-    for (unsigned int i = 0; i < cfg.num_zones; ++i) {
-        unsigned int im1 = (i == 0) ? cfg.num_zones - 1 : i - 1;
-
-        if (v > 0) {
-            double flux_left = v * state.conserved[im1];
-            double flux_right = v * state.conserved[i];
-            new_state.conserved[i] = state.conserved[i] - dt / dx * (flux_right - flux_left);
-        } else {
-            unsigned int ip1 = (i + 1) % cfg.num_zones;
-            double flux_left = v * state.conserved[i];
-            double flux_right = v * state.conserved[ip1];
-            new_state.conserved[i] = state.conserved[i] - dt / dx * (flux_right - flux_left);
-        }
+    for (auto i : state.grid) {
+        auto upwind = v > 0 ? i - ivec(1) : i + ivec(1);
+        double flux_left = v * (v > 0 ? u[upwind] : u[i]);
+        double flux_right = v * (v > 0 ? u[i] : u[upwind]);
+        new_state.conserved[i[0]] = u[i] - dt / dx * (flux_right - flux_left);
     }
 
     return new_state;
@@ -150,13 +154,15 @@ auto average(
     double alpha
 ) -> advection_1d::state_t {
 
-    auto result = s1;
-
-    for (unsigned int i = 0; i < s1.conserved.size(); ++i) {
-        result.conserved[i] = (1.0 - alpha) * s1.conserved[i] + alpha * s2.conserved[i];
-    }
+    auto result = advection_1d::state_t{
+        std::vector<double>(s1.conserved.size()),
+        (1.0 - alpha) * s1.time + alpha * s2.time,
+        s1.grid
+    };
+    auto u1 = view(s1.conserved, s1.grid);
+    auto u2 = view(s2.conserved, s2.grid);
 
-    result.time = (1.0 - alpha) * s1.time + alpha * s2.time;
+    assign(view(result.conserved, result.grid), u1 * (1.0 - alpha) + u2 * alpha);
     return result;
 }
 
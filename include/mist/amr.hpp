@@ -0,0 +1,1032 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "core.hpp"
+#include "array.hpp"
+#include "boundary.hpp"
+#include "serialize.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Index space refinement
+// =============================================================================
+
+// The fine-level space covering the same region as a coarse space
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> refine(const index_space_t<S>& space, unsigned int ratio) {
+    auto result = space;
+    for (std::size_t a = 0; a < S; ++a) {
+        result._start._data[a] *= static_cast<int>(ratio);
+        result._shape._data[a] *= ratio;
+    }
+    return result;
+}
+
+// The coarse-level index of the zone containing a fine-level index
+template<std::size_t S>
+MIST_HD constexpr ivec_t<S> coarsen(const ivec_t<S>& index, unsigned int ratio) {
+    auto result = index;
+    auto r = static_cast<int>(ratio);
+    for (std::size_t a = 0; a < S; ++a) {
+        result._data[a] = index._data[a] >= 0 ? index._data[a] / r : -((-index._data[a] + r - 1) / r);
+    }
+    return result;
+}
+
+// The coarse-level space covered by a fine space (whose start and shape
+// are multiples of ratio)
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> coarsen(const index_space_t<S>& space, unsigned int ratio) {
+    auto result = index_space_t<S>{coarsen(space._start, ratio), space._shape};
+    for (std::size_t a = 0; a < S; ++a) {
+        result._shape._data[a] /= ratio;
+    }
+    return result;
+}
+
+// =============================================================================
+// patch_t: One block of a refinement level
+// =============================================================================
+
+// The zones of _space at refinement level _level, stored row-major with
+// _ghost ghost zones on every side
+template<typename T, std::size_t S>
+struct patch_t {
+    unsigned int _level = 0;
+    index_space_t<S> _space{};
+    unsigned int _ghost = 0;
+    std::vector<T> _data;
+
+    auto fields() const {
+        return std::make_tuple(
+            field("level", _level),
+            field("start", _space._start),
+            field("shape", _space._shape),
+            field("ghost", _ghost),
+            field("data", _data)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("level", _level),
+            field("start", _space._start),
+            field("shape", _space._shape),
+            field("ghost", _ghost),
+            field("data", _data)
+        );
+    }
+};
+
+template<typename T, std::size_t S>
+patch_t<T, S> patch(unsigned int level, const index_space_t<S>& space, unsigned int ghost) {
+    return patch_t<T, S>{level, space, ghost, std::vector<T>(size(expand(space, ghost)))};
+}
+
+// The patch's zones including ghost zones
+template<typename T, std::size_t S>
+constexpr index_space_t<S> padded(const patch_t<T, S>& p) {
+    return expand(p._space, p._ghost);
+}
+
+template<typename T, std::size_t S>
+array_view_t<T, S> view(patch_t<T, S>& p) {
+    return array_view_t<T, S>{p._data.data(), padded(p)};
+}
+
+template<typename T, std::size_t S>
+array_view_t<const T, S> view(const patch_t<T, S>& p) {
+    return array_view_t<const T, S>{p._data.data(), padded(p)};
+}
+
+// =============================================================================
+// hierarchy_t: Block-structured refinement levels
+// =============================================================================
+
+// A hierarchy of refinement levels over _domain, the zones of level 0.
+// Level l has zones _ratio^l times smaller than level 0, and is covered by
+// patches that are the tiles of _block zones per side of its index space,
+// so a patch is identified by its tile. Level 0 is covered completely;
+// each finer level covers a subset of the level below it, refining whole
+// tiles, with at least one coarse tile between it and any region of the
+// coarse level that is not itself covered (proper nesting).
+//
+// _patches holds the patches of all levels, ordered by level and then by
+// tile.
+template<typename T, std::size_t S>
+struct hierarchy_t {
+    index_space_t<S> _domain{};
+    unsigned int _block = 8;
+    unsigned int _ratio = 2;
+    unsigned int _ghost = 1;
+    unsigned int _max_level = 0;
+    boundary_conditions_t<S> _boundary{};
+    std::vector<patch_t<T, S>> _patches;
+};
+
+// A hierarchy with a single level covering domain, zero-initialized
+template<typename T, std::size_t S>
+hierarchy_t<T, S> hierarchy(
+    const index_space_t<S>& domain,
+    unsigned int block,
+    unsigned int ratio,
+    unsigned int ghost,
+    unsigned int max_level,
+    const boundary_conditions_t<S>& bc)
+{
+    if (ratio < 2 || block == 0 || block % ratio != 0) {
+        throw std::runtime_error("hierarchy: ratio must be at least 2 and divide the block size");
+    }
+    if (ghost > block) {
+        throw std::runtime_error("hierarchy: ghost zones must not be deeper than a block");
+    }
+    auto h = hierarchy_t<T, S>{domain, block, ratio, ghost, max_level, bc, {}};
+    auto tile_shape = uvec_t<S>{};
+    for (std::size_t a = 0; a < S; ++a) {
+        tile_shape._data[a] = block;
+    }
+    for (std::size_t n = 0; n < tile_count(domain, tile_shape); ++n) {
+        h._patches.push_back(patch<T>(0, tile_at(domain, tile_shape, n), ghost));
+    }
+    return h;
+}
+
+// Number of levels that have patches
+template<typename T, std::size_t S>
+unsigned int num_levels(const hierarchy_t<T, S>& h) {
+    return h._patches.empty() ? 0 : h._patches.back()._level + 1;
+}
+
+// Range [first, last) of _patches on a level
+template<typename T, std::size_t S>
+std::pair<std::size_t, std::size_t> level_range(const hierarchy_t<T, S>& h, unsigned int level) {
+    auto lower = std::partition_point(h._patches.begin(), h._patches.end(), [level](const auto& p) { return p._level < level; });
+    auto upper = std::partition_point(lower, h._patches.end(), [level](const auto& p) { return p._level <= level; });
+    return {static_cast<std::size_t>(lower - h._patches.begin()), static_cast<std::size_t>(upper - h._patches.begin())};
+}
+
+// The index space of a whole level
+template<typename T, std::size_t S>
+index_space_t<S> level_space(const hierarchy_t<T, S>& h, unsigned int level) {
+    auto space = h._domain;
+    for (unsigned int l = 0; l < level; ++l) {
+        space = refine(space, h._ratio);
+    }
+    return space;
+}
+
+namespace detail {
+    template<std::size_t S>
+    constexpr uvec_t<S> block_shape(unsigned int block) {
+        auto shape = uvec_t<S>{};
+        for (std::size_t a = 0; a < S; ++a) {
+            shape._data[a] = block;
+        }
+        return shape;
+    }
+
+    // Patch lookup for one level: the patch index (into _patches) of every
+    // tile of the level, or -1
+    template<std::size_t S>
+    struct level_map_t {
+        index_space_t<S> _space;
+        index_space_t<S> _tiles;
+        unsigned int _block;
+        std::vector<int> _ids;
+    };
+
+    template<std::size_t S>
+    ivec_t<S> tile_of(const level_map_t<S>& m, const ivec_t<S>& index) {
+        auto t = ivec_t<S>{};
+        for (std::size_t a = 0; a < S; ++a) {
+            t._data[a] = (index._data[a] - m._space._start._data[a]) / static_cast<int>(m._block);
+        }
+        return t;
+    }
+
+    template<std::size_t S>
+    int lookup(const level_map_t<S>& m, const ivec_t<S>& index) {
+        if (!contains(m._space, index)) {
+            return -1;
+        }
+        return m._ids[ndoffset(m._tiles, tile_of(m, index))];
+    }
+
+    template<typename T, std::size_t S>
+    level_map_t<S> level_map(const hierarchy_t<T, S>& h, unsigned int level) {
+        auto space = level_space(h, level);
+        auto m = level_map_t<S>{space, index_space_t<S>{}, h._block, {}};
+        for (std::size_t a = 0; a < S; ++a) {
+            m._tiles._shape._data[a] = (space._shape._data[a] + h._block - 1) / h._block;
+        }
+        m._ids.assign(size(m._tiles), -1);
+
+        auto [first, last] = level_range(h, level);
+        for (auto n = first; n < last; ++n) {
+            m._ids[ndoffset(m._tiles, tile_of(m, h._patches[n]._space._start))] = static_cast<int>(n);
+        }
+        return m;
+    }
+
+    template<typename T, std::size_t S>
+    std::vector<level_map_t<S>> level_maps(const hierarchy_t<T, S>& h) {
+        auto maps = std::vector<level_map_t<S>>{};
+        for (unsigned int l = 0; l < num_levels(h); ++l) {
+            maps.push_back(level_map(h, l));
+        }
+        return maps;
+    }
+
+    // An axis is periodic if its lower face is
+    template<std::size_t S>
+    bool periodic(const boundary_conditions_t<S>& bc, std::size_t axis) {
+        return bc._lo[axis] == boundary::periodic;
+    }
+
+    // Wrap an index into space along periodic axes; false if it lies
+    // outside space along a non-periodic axis
+    template<std::size_t S>
+    bool wrap(const index_space_t<S>& space, const boundary_conditions_t<S>& bc, ivec_t<S>& index) {
+        for (std::size_t a = 0; a < S; ++a) {
+            auto lo = space._start._data[a];
+            auto n = static_cast<int>(space._shape._data[a]);
+            if (index._data[a] < lo || index._data[a] >= lo + n) {
+                if (!periodic(bc, a)) {
+                    return false;
+                }
+                index._data[a] = boundary_source(boundary::periodic, index._data[a], lo, n);
+            }
+        }
+        return true;
+    }
+
+    // Value at a zone of a level, from the finest patch data covering it
+    // (piecewise-constant prolongation from coarser levels)
+    template<typename T, std::size_t S>
+    T sample(const hierarchy_t<T, S>& h, const std::vector<level_map_t<S>>& maps, unsigned int level, const ivec_t<S>& index) {
+        auto i = index;
+        for (auto l = level + 1; l > 0; --l) {
+            if (l - 1 < maps.size()) {
+                if (auto q = lookup(maps[l - 1], i); q >= 0) {
+                    return view(h._patches[q])[i];
+                }
+            }
+            i = coarsen(i, h._ratio);
+        }
+        throw std::runtime_error("hierarchy: index is not covered by level 0");
+    }
+
+    // Fill the ghost zones of every patch on a level from its neighbors on
+    // the level, or else from the level below, applying the domain boundary
+    // conditions. Values from the level below are interpolated in time
+    // between old_coarse (its patches before its latest update, if any)
+    // and its current data, with weight theta on the current data.
+    template<typename T, std::size_t S, Executor E, typename R>
+    void fill_level_ghosts(
+        hierarchy_t<T, S>& h,
+        const std::vector<level_map_t<S>>& maps,
+        unsigned int level,
+        const std::vector<patch_t<T, S>>* old_coarse,
+        double theta,
+        const E& e,
+        R reflect)
+    {
+        auto [first, last] = level_range(h, level);
+        auto space = level_space(h, level);
+        auto coarse_first = level > 0 ? level_range(h, level - 1).first : 0;
+
+        execute(e, last - first, [&](std::size_t begin, std::size_t end, std::size_t) {
+            for (auto n = first + begin; n < first + end; ++n) {
+                auto& p = h._patches[n];
+                auto u = view(p);
+
+                for (std::size_t m = 0; m < size(padded(p)); ++m) {
+                    auto index = ndindex(padded(p), m);
+                    if (contains(p._space, index)) {
+                        continue;
+                    }
+                    auto source = index;
+                    auto mirrored = std::array<bool, S>{};
+
+                    for (std::size_t a = 0; a < S; ++a) {
+                        auto x = index._data[a];
+                        auto lo = space._start._data[a];
+                        auto type = x < lo ? h._boundary._lo[a] : h._boundary._hi[a];
+                        source._data[a] = boundary_source(type, x, lo, static_cast<int>(space._shape._data[a]));
+                        mirrored[a] = source._data[a] != x && type == boundary::reflecting;
+                    }
+
+                    auto value = T{};
+                    if (auto q = lookup(maps[level], source); q >= 0) {
+                        value = view(h._patches[q])[source];
+                    } else if (level > 0) {
+                        auto c = coarsen(source, h._ratio);
+                        auto q = lookup(maps[level - 1], c);
+                        if (q < 0) {
+                            throw std::runtime_error("hierarchy: level is not properly nested");
+                        }
+                        value = view(h._patches[q])[c];
+                        if (old_coarse && theta < 1.0) {
+                            value = view((*old_coarse)[q - coarse_first])[c] * (1.0 - theta) + value * theta;
+                        }
+                    } else {
+                        throw std::runtime_error("hierarchy: level 0 does not cover its domain");
+                    }
+                    for (std::size_t a = 0; a < S; ++a) {
+                        if (mirrored[a]) {
+                            value = reflect(value, a);
+                        }
+                    }
+                    u[index] = value;
+                }
+            }
+        });
+    }
+}
+
+// Fill the ghost zones of every patch on a level
+template<typename T, std::size_t S, Executor E, typename R = no_reflect>
+void fill_ghosts(hierarchy_t<T, S>& h, unsigned int level, const E& e, R reflect = {}) {
+    detail::fill_level_ghosts(h, detail::level_maps(h), level, static_cast<const std::vector<patch_t<T, S>>*>(nullptr), 1.0, e, reflect);
+}
+
+// Replace the data of every zone of a level that is covered by the next
+// finer level with the average of the fine zones it contains
+// (conservative restriction)
+template<typename T, std::size_t S, Executor E>
+void restrict_level(hierarchy_t<T, S>& h, unsigned int level, const E& e) {
+    if (level + 1 >= num_levels(h)) {
+        return;
+    }
+    auto coarse_map = detail::level_map(h, level);
+    auto [first, last] = level_range(h, level + 1);
+    auto r = h._ratio;
+    auto block = uvec_t<S>{};
+    auto weight = 1.0;
+
+    for (std::size_t a = 0; a < S; ++a) {
+        block._data[a] = r;
+        weight /= r;
+    }
+
+    execute(e, last - first, [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (auto n = first + begin; n < first + end; ++n) {
+            const auto& fine = h._patches[n];
+            auto u = view(fine);
+
+            for (auto c : coarsen(fine._space, r)) {
+                auto children = index_space(c * static_cast<int>(r), block);
+                auto sum = T{};
+                for (auto i : children) {
+                    sum = sum + u[i];
+                }
+                view(h._patches[detail::lookup(coarse_map, c)])[c] = sum * weight;
+            }
+        }
+    });
+}
+
+// =============================================================================
+// Regridding
+// =============================================================================
+
+// Rebuild the levels above level 0 from refinement flags. For each level l
+// below _max_level, in turn, flag(u, index, l) is called on every zone of
+// every patch (u being an array_view_t<const T, S> of the patch with its
+// ghost zones filled). Tiles containing a flagged zone, and their
+// neighbors, are refined, except those next to a tile of level l that does
+// not exist, which keeps the new level properly nested. Patches of the new
+// level l + 1 keep the data of the old level l + 1 where it existed, and are
+// otherwise prolonged from the coarser level.
+template<typename T, std::size_t S, typename F, Executor E, typename R = no_reflect>
+void regrid(hierarchy_t<T, S>& h, F&& flag, const E& e, R reflect = {}) {
+    auto old = h;
+    auto old_maps = detail::level_maps(old);
+    auto tile_shape = detail::block_shape<S>(h._block);
+    detail::check_tile_shape(tile_shape, "regrid");
+
+    for (unsigned int l = 0; l < h._max_level; ++l) {
+        h._patches.erase(h._patches.begin() + level_range(h, l).second, h._patches.end());
+
+        auto maps = detail::level_maps(h);
+        detail::fill_level_ghosts(h, maps, l, static_cast<const std::vector<patch_t<T, S>>*>(nullptr), 1.0, e, reflect);
+
+        const auto& m = maps[l];
+        auto [first, last] = level_range(h, l);
+        auto flagged = std::vector<char>(size(m._tiles), 0);
+
+        execute(e, last - first, [&](std::size_t begin, std::size_t end, std::size_t) {
+            for (auto n = first + begin; n < first + end; ++n) {
+                const auto& p = h._patches[n];
+                auto u = view(p);
+                for (auto i : p._space) {
+                    if (flag(u, i, l)) {
+                        flagged[ndoffset(m._tiles, detail::tile_of(m, p._space._start))] = 1;
+                        break;
+                    }
+                }
+            }
+        });
+
+        // Neighboring tile t + d of tile t, wrapped on periodic axes, or -1
+        // if it lies outside the level along a non-periodic axis
+        auto neighbor = [&](const ivec_t<S>& t, const ivec_t<S>& d) -> long {
+            auto nb = t + d;
+            if (!detail::wrap(m._tiles, h._boundary, nb)) {
+                return -1;
+            }
+            return static_cast<long>(ndoffset(m._tiles, nb));
+        };
+        auto offsets = index_space_t<S>{ivec_t<S>{}, detail::block_shape<S>(3)};
+        for (std::size_t a = 0; a < S; ++a) {
+            offsets._start._data[a] = -1;
+        }
+        auto marked = flagged;
+
+        for (std::size_t n = 0; n < flagged.size(); ++n) {
+            if (flagged[n]) {
+                for (auto d : offsets) {
+                    if (auto k = neighbor(ndindex(m._tiles, n), d); k >= 0 && m._ids[k] >= 0) {
+                        marked[k] = 1;
+                    }
+                }
+            }
+        }
+
+        auto fine = std::vector<patch_t<T, S>>{};
+        for (std::size_t n = 0; n < marked.size(); ++n) {
+            if (!marked[n] || m._ids[n] < 0) {
+                continue;
+            }
+            auto nested = true;
+            for (auto d : offsets) {
+                if (auto k = neighbor(ndindex(m._tiles, n), d); k >= 0 && m._ids[k] < 0) {
+                    nested = false;
+                }
+            }
+            if (!nested) {
+                continue;
+            }
+            auto region = refine(h._patches[m._ids[n]]._space, h._ratio);
+            for (std::size_t k = 0; k < tile_count(region, tile_shape); ++k) {
+                fine.push_back(patch<T>(l + 1, tile_at(region, tile_shape, k), h._ghost));
+            }
+        }
+        if (fine.empty()) {
+            break;
+        }
+
+        execute(e, fine.size(), [&](std::size_t begin, std::size_t end, std::size_t) {
+            for (auto n = begin; n < end; ++n) {
+                auto u = view(fine[n]);
+                for (auto i : fine[n]._space) {
+                    u[i] = detail::sample(old, old_maps, l + 1, i);
+                }
+            }
+        });
+        h._patches.insert(h._patches.end(), fine.begin(), fine.end());
+    }
+}
+
+// =============================================================================
+// Time stepping
+// =============================================================================
+
+namespace detail {
+    // Flux register on one face of a fine patch that borders the coarse
+    // level: _faces are the coarse faces (indexed by the zone above the
+    // face along _axis), and _flux accumulates the time-integrated fine
+    // flux minus the coarse flux through each.
+    template<typename T, std::size_t S>
+    struct flux_register_t {
+        std::size_t _patch;
+        std::size_t _axis;
+        bool _upper;
+        index_space_t<S> _faces;
+        std::vector<T> _flux;
+    };
+
+    template<typename T, std::size_t S>
+    std::vector<flux_register_t<T, S>> flux_registers(const hierarchy_t<T, S>& h, const std::vector<level_map_t<S>>& maps, unsigned int level) {
+        auto registers = std::vector<flux_register_t<T, S>>{};
+        auto [first, last] = level_range(h, level);
+        auto space = level_space(h, level);
+
+        for (auto n = first; n < last; ++n) {
+            const auto& p = h._patches[n];
+            for (std::size_t a = 0; a < S; ++a) {
+                for (bool upper : {false, true}) {
+                    auto x = p._space._start._data[a] + (upper ? static_cast<int>(p._space._shape._data[a]) : 0);
+                    auto outside = p._space._start;
+                    outside._data[a] = upper ? x : x - 1;
+
+                    if (!wrap(space, h._boundary, outside) || lookup(maps[level], outside) >= 0) {
+                        continue;
+                    }
+                    auto faces = coarsen(p._space, h._ratio);
+                    faces._start._data[a] = x / static_cast<int>(h._ratio);
+                    faces._shape._data[a] = 1;
+                    registers.push_back({n, a, upper, faces, std::vector<T>(size(faces))});
+                }
+            }
+        }
+        return registers;
+    }
+
+    template<std::size_t S>
+    constexpr ivec_t<S> unit(std::size_t axis) {
+        auto e = ivec_t<S>{};
+        e._data[axis] = 1;
+        return e;
+    }
+
+    // Advance the patches of a level by dt with the finite-volume update
+    //
+    //     u -= dt / dx * sum_a (F_a(i + e_a) - F_a(i))
+    //
+    // where F_a(i) = flux(u, i, a) is the flux through the lower face of
+    // zone i along axis a. Fine fluxes through faces with a flux register
+    // are added to it.
+    template<typename T, std::size_t S, typename Flux, Executor E>
+    void update_level(
+        hierarchy_t<T, S>& h,
+        unsigned int level,
+        double dt,
+        double dx,
+        Flux& flux,
+        std::vector<flux_register_t<T, S>>* registers,
+        const E& e)
+    {
+        auto [first, last] = level_range(h, level);
+        auto by_patch = std::vector<std::vector<std::size_t>>(last - first);
+        auto weight = dt;
+
+        if (registers) {
+            for (std::size_t k = 0; k < registers->size(); ++k) {
+                by_patch[(*registers)[k]._patch - first].push_back(k);
+            }
+            for (std::size_t a = 0; a + 1 < S; ++a) {
+                weight /= h._ratio;
+            }
+        }
+
+        execute(e, last - first, [&](std::size_t begin, std::size_t end, std::size_t) {
+            auto fluxes = std::array<std::vector<T>, S>{};
+
+            for (auto n = first + begin; n < first + end; ++n) {
+                auto& p = h._patches[n];
+                auto u = view(std::as_const(p));
+                auto face_spaces = std::array<index_space_t<S>, S>{};
+
+                for (std::size_t a = 0; a < S; ++a) {
+                    face_spaces[a] = p._space;
+                    face_spaces[a]._shape._data[a] += 1;
+                    fluxes[a].resize(size(face_spaces[a]));
+                    for (std::size_t m = 0; m < fluxes[a].size(); ++m) {
+                        fluxes[a][m] = flux(u, ndindex(face_spaces[a], m), a);
+                    }
+                }
+                for (auto k : by_patch[n - first]) {
+                    auto& reg = (*registers)[k];
+                    auto a = reg._axis;
+                    auto x = p._space._start._data[a] + (reg._upper ? static_cast<int>(p._space._shape._data[a]) : 0);
+                    auto face = p._space;
+                    face._start._data[a] = x;
+                    face._shape._data[a] = 1;
+
+                    for (auto f : face) {
+                        auto c = coarsen(f, h._ratio);
+                        c._data[a] = reg._faces._start._data[a];
+                        auto& slot = reg._flux[ndoffset(reg._faces, c)];
+                        slot = slot + fluxes[a][ndoffset(face_spaces[a], f)] * weight;
+                    }
+                }
+
+                auto next = p._data;
+                auto v = array_view_t<T, S>{next.data(), padded(p)};
+                for (auto i : p._space) {
+                    auto df = T{};
+                    for (std::size_t a = 0; a < S; ++a) {
+                        df = df + fluxes[a][ndoffset(face_spaces[a], i + unit<S>(a))] - fluxes[a][ndoffset(face_spaces[a], i)];
+                    }
+                    v[i] = u[i] - df * (dt / dx);
+                }
+                p._data.swap(next);
+            }
+        });
+    }
+
+    // Advance a level, and recursively the finer levels with ratio
+    // substeps each, then restrict the finer level onto this one and
+    // correct the coarse zones next to it with the flux registers
+    template<typename T, std::size_t S, typename Flux, Executor E, typename R>
+    void advance_level(
+        hierarchy_t<T, S>& h,
+        const std::vector<level_map_t<S>>& maps,
+        unsigned int level,
+        double dt,
+        double dx,
+        Flux& flux,
+        std::vector<flux_register_t<T, S>>* registers,
+        const E& e,
+        R reflect)
+    {
+        auto has_fine = level + 1 < num_levels(h);
+        auto fine_registers = has_fine ? flux_registers(h, maps, level + 1) : std::vector<flux_register_t<T, S>>{};
+        auto old = std::vector<patch_t<T, S>>{};
+
+        if (has_fine) {
+            auto [first, last] = level_range(h, level);
+            old.assign(h._patches.begin() + first, h._patches.begin() + last);
+
+            for (auto& reg : fine_registers) {
+                auto a = reg._axis;
+                for (auto j : reg._faces) {
+                    auto inside = reg._upper ? j - unit<S>(a) : j;
+                    reg._flux[ndoffset(reg._faces, j)] = flux(view(std::as_const(h._patches[lookup(maps[level], inside)])), j, a) * -dt;
+                }
+            }
+        }
+
+        update_level(h, level, dt, dx, flux, registers, e);
+
+        if (has_fine) {
+            for (unsigned int k = 0; k < h._ratio; ++k) {
+                fill_level_ghosts(h, maps, level + 1, &old, static_cast<double>(k) / h._ratio, e, reflect);
+                advance_level(h, maps, level + 1, dt / h._ratio, dx / h._ratio, flux, &fine_registers, e, reflect);
+            }
+            restrict_level(h, level, e);
+
+            auto space = level_space(h, level);
+            for (const auto& reg : fine_registers) {
+                auto a = reg._axis;
+                for (auto j : reg._faces) {
+                    auto outside = reg._upper ? j : j - unit<S>(a);
+                    if (!wrap(space, h._boundary, outside)) {
+                        continue;
+                    }
+                    auto correction = reg._flux[ndoffset(reg._faces, j)] * (1.0 / dx);
+                    auto& u = view(h._patches[lookup(maps[level], outside)])[outside];
+                    u = reg._upper ? u + correction : u - correction;
+                }
+            }
+        }
+    }
+}
+
+// Advance the hierarchy by dt, which is the time step of level 0. Each
+// level l > 0 takes ratio substeps of the level below it (Berger-Colella
+// subcycling), with ghost zones next to the coarse level interpolated in
+// time. After its substeps, a level is restricted onto the one below, and
+// the coarse zones bordering it are corrected with the difference between
+// the fine and coarse fluxes through the coarse-fine interface (refluxing),
+// so the update is conservative. dx is the zone size on level 0, and
+// flux(u, index, axis) returns the flux through the lower face of zone
+// index along axis, reading the patch view u (with ghost zones) only
+// within _ghost zones of it.
+template<typename T, std::size_t S, typename Flux, Executor E, typename R = no_reflect>
+void advance(hierarchy_t<T, S>& h, double dt, double dx, Flux&& flux, const E& e, R reflect = {}) {
+    auto maps = detail::level_maps(h);
+    detail::fill_level_ghosts(h, maps, 0, static_cast<const std::vector<patch_t<T, S>>*>(nullptr), 1.0, e, reflect);
+    detail::advance_level(h, maps, 0, dt, dx, flux, static_cast<std::vector<detail::flux_register_t<T, S>>*>(nullptr), e, reflect);
+}
+
+// =============================================================================
+// Driver integration
+// =============================================================================
+
+// A model supplies the physics of a conservation law on an AMR hierarchy:
+//
+// - M::config_t, its runtime parameters
+// - M::value_t, the conserved quantities of a zone (arithmetic or vec_t)
+// - M::rank, the number of dimensions, and M::ghost, the stencil radius
+// - initial_value(cfg, x) -> value_t at the zone center x
+// - flux(cfg, u, index, axis) -> value_t through the lower face of zone
+//   index along axis, where u is a patch view with ghost zones
+// - max_wavespeed(cfg, value) -> double
+// - refine_flag(cfg, u, index, dx) -> bool, true where zone index of the
+//   patch view u (with zone size dx) should be refined
+//
+// Optionally, reflect(cfg, value, axis) -> value_t transforms values
+// mirrored by reflecting boundaries, and M::executor_t (default cpu_t)
+// runs the per-patch work.
+template<typename M>
+concept AmrModel = requires(
+    const typename M::config_t& cfg,
+    const typename M::value_t& value,
+    const array_view_t<const typename M::value_t, M::rank>& u,
+    const ivec_t<M::rank>& index,
+    const dvec_t<M::rank>& x,
+    std::size_t axis,
+    double dx)
+{
+    { M::ghost } -> std::convertible_to<unsigned int>;
+    { initial_value(cfg, x) } -> std::convertible_to<typename M::value_t>;
+    { flux(cfg, u, index, axis) } -> std::convertible_to<typename M::value_t>;
+    { max_wavespeed(cfg, value) } -> std::convertible_to<double>;
+    { refine_flag(cfg, u, index, dx) } -> std::convertible_to<bool>;
+};
+
+template<typename M>
+struct amr_config_t {
+    typename M::config_t model{};
+    uvec_t<M::rank> resolution = detail::block_shape<M::rank>(64);
+    double domain_length = 1.0;
+    unsigned int block_size = 8;
+    unsigned int refinement_ratio = 2;
+    unsigned int max_level = 2;
+    unsigned int regrid_interval = 4;
+    std::string boundary = "periodic";
+
+    auto fields() const {
+        return std::make_tuple(
+            field("model", model),
+            field("resolution", resolution),
+            field("domain_length", domain_length),
+            field("block_size", block_size),
+            field("refinement_ratio", refinement_ratio),
+            field("max_level", max_level),
+            field("regrid_interval", regrid_interval),
+            field("boundary", boundary)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("model", model),
+            field("resolution", resolution),
+            field("domain_length", domain_length),
+            field("block_size", block_size),
+            field("refinement_ratio", refinement_ratio),
+            field("max_level", max_level),
+            field("regrid_interval", regrid_interval),
+            field("boundary", boundary)
+        );
+    }
+};
+
+template<typename M>
+struct amr_state_t {
+    hierarchy_t<typename M::value_t, M::rank> hierarchy;
+    double time = 0.0;
+    int stages = 0;
+
+    auto fields() const {
+        return std::make_tuple(
+            field("time", time),
+            field("stages", stages),
+            field("patches", hierarchy._patches)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("time", time),
+            field("stages", stages),
+            field("patches", hierarchy._patches)
+        );
+    }
+};
+
+template<typename M>
+struct amr_product_t {
+    std::vector<int> patches_per_level;
+    std::vector<patch_t<typename M::value_t, M::rank>> patches;
+
+    auto fields() const {
+        return std::make_tuple(
+            field("patches_per_level", patches_per_level),
+            field("patches", patches)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("patches_per_level", patches_per_level),
+            field("patches", patches)
+        );
+    }
+};
+
+// Physics for the driver: a model M evolved on an AMR hierarchy. Each
+// euler_step regrids (every regrid_interval steps, counting RK stages) and
+// then advances all levels with subcycling and refluxing. RK stages may
+// see different hierarchies; average maps its first argument onto the
+// patches of its second.
+template<AmrModel M>
+struct amr {
+    using model_t = M;
+    using config_t = amr_config_t<M>;
+    using state_t = amr_state_t<M>;
+    using product_t = amr_product_t<M>;
+};
+
+namespace detail {
+    template<typename M>
+    auto model_executor() {
+        if constexpr (requires { typename M::executor_t; }) {
+            return typename M::executor_t{};
+        } else {
+            return cpu_t{};
+        }
+    }
+
+    template<typename M>
+    auto model_reflect(const typename M::config_t& cfg) {
+        return [&cfg](const typename M::value_t& value, std::size_t axis) -> typename M::value_t {
+            if constexpr (requires { reflect(cfg, value, axis); }) {
+                return reflect(cfg, value, axis);
+            } else {
+                return value;
+            }
+        };
+    }
+
+    template<typename M>
+    double zone_size(const amr_config_t<M>& cfg, unsigned int level) {
+        auto dx = cfg.domain_length / cfg.resolution[0];
+        for (unsigned int l = 0; l < level; ++l) {
+            dx /= cfg.refinement_ratio;
+        }
+        return dx;
+    }
+
+    template<typename M>
+    void regrid_model(const amr_config_t<M>& cfg, amr_state_t<M>& s) {
+        regrid(s.hierarchy, [&cfg](const auto& u, const auto& index, unsigned int level) {
+            return refine_flag(cfg.model, u, index, zone_size(cfg, level));
+        }, model_executor<M>(), model_reflect<M>(cfg.model));
+    }
+}
+
+template<typename M>
+amr_state_t<M> initial_state(const amr_config_t<M>& cfg) {
+    using T = typename M::value_t;
+    constexpr auto S = M::rank;
+
+    auto s = amr_state_t<M>{};
+    s.hierarchy = hierarchy<T>(
+        index_space(ivec_t<S>{}, cfg.resolution),
+        cfg.block_size,
+        cfg.refinement_ratio,
+        M::ghost,
+        cfg.max_level,
+        boundary_conditions<S>(parse_boundary(cfg.boundary)));
+
+    auto initialize = [&]() {
+        for (auto& p : s.hierarchy._patches) {
+            auto dx = detail::zone_size(cfg, p._level);
+            auto u = view(p);
+            for (auto i : p._space) {
+                auto x = dvec_t<S>{};
+                for (std::size_t a = 0; a < S; ++a) {
+                    x[a] = (i[a] + 0.5) * dx;
+                }
+                u[i] = initial_value(cfg.model, x);
+            }
+        }
+    };
+    initialize();
+
+    for (unsigned int l = 0; l < cfg.max_level; ++l) {
+        detail::regrid_model(cfg, s);
+        initialize();
+    }
+    for (auto l = num_levels(s.hierarchy); l > 1; --l) {
+        restrict_level(s.hierarchy, l - 2, detail::model_executor<M>());
+    }
+    return s;
+}
+
+template<typename M>
+amr_state_t<M> euler_step(const amr_config_t<M>& cfg, const amr_state_t<M>& state, double dt) {
+    auto s = state;
+
+    if (cfg.max_level > 0 && cfg.regrid_interval > 0 && s.stages % cfg.regrid_interval == 0) {
+        detail::regrid_model(cfg, s);
+    }
+    auto flux_function = [&cfg](const auto& u, const auto& index, std::size_t axis) {
+        return flux(cfg.model, u, index, axis);
+    };
+    advance(s.hierarchy, dt, detail::zone_size(cfg, 0), flux_function, detail::model_executor<M>(), detail::model_reflect<M>(cfg.model));
+    s.time += dt;
+    s.stages += 1;
+    return s;
+}
+
+template<typename M>
+double courant_time(const amr_config_t<M>& cfg, const amr_state_t<M>& s) {
+    auto speed = 0.0;
+    for (const auto& p : s.hierarchy._patches) {
+        auto u = view(p);
+        for (auto i : p._space) {
+            speed = std::max(speed, static_cast<double>(max_wavespeed(cfg.model, u[i])));
+        }
+    }
+    // Level l takes ratio^l substeps of zones ratio^l times smaller, so the
+    // level 0 zone size sets the time step
+    return detail::zone_size(cfg, 0) / speed;
+}
+
+template<typename M>
+amr_state_t<M> average(const amr_state_t<M>& a, const amr_state_t<M>& b, double alpha) {
+    auto result = b;
+    const auto& pa = a.hierarchy._patches;
+    auto& pr = result.hierarchy._patches;
+
+    auto same = pa.size() == pr.size();
+    for (std::size_t n = 0; same && n < pr.size(); ++n) {
+        same = pa[n]._level == pr[n]._level && pa[n]._space == pr[n]._space;
+    }
+    auto remapped = b.hierarchy;
+    if (!same) {
+        auto maps = detail::level_maps(a.hierarchy);
+        for (auto& p : remapped._patches) {
+            auto u = view(p);
+            for (auto i : p._space) {
+                u[i] = detail::sample(a.hierarchy, maps, p._level, i);
+            }
+        }
+    }
+    const auto& source = same ? pa : remapped._patches;
+
+    for (std::size_t n = 0; n < pr.size(); ++n) {
+        for (std::size_t k = 0; k < pr[n]._data.size(); ++k) {
+            pr[n]._data[k] = source[n]._data[k] * (1.0 - alpha) + pr[n]._data[k] * alpha;
+        }
+    }
+    result.time = (1.0 - alpha) * a.time + alpha * b.time;
+    return result;
+}
+
+template<typename M>
+amr_product_t<M> get_product(const amr_config_t<M>&, const amr_state_t<M>& s) {
+    auto product = amr_product_t<M>{};
+    for (const auto& p : s.hierarchy._patches) {
+        if (product.patches_per_level.size() <= p._level) {
+            product.patches_per_level.resize(p._level + 1);
+        }
+        product.patches_per_level[p._level] += 1;
+    }
+    product.patches = s.hierarchy._patches;
+    return product;
+}
+
+template<typename M>
+double get_time(const amr_state_t<M>& s, int kind) {
+    if (kind == 0) return s.time;
+    throw std::out_of_range("amr only supports time kind=0");
+}
+
+template<typename M>
+std::size_t zone_count(const amr_state_t<M>& s) {
+    std::size_t count = 0;
+    for (const auto& p : s.hierarchy._patches) {
+        count += size(p._space);
+    }
+    return count;
+}
+
+template<typename M>
+std::vector<std::pair<std::string, double>> timeseries_sample(const amr_config_t<M>& cfg, const amr_state_t<M>& s) {
+    auto sample = std::vector<std::pair<std::string, double>>{
+        {"time", s.time},
+        {"patches", static_cast<double>(s.hierarchy._patches.size())},
+        {"zones", static_cast<double>(zone_count(s))}
+    };
+
+    // Level 0 holds the restricted average of the finer levels, so its sum
+    // is the total of each conserved quantity
+    auto volume = 1.0;
+    for (std::size_t a = 0; a < M::rank; ++a) {
+        volume *= detail::zone_size(cfg, 0);
+    }
+    auto total = typename M::value_t{};
+    auto [first, last] = level_range(s.hierarchy, 0);
+    for (auto n = first; n < last; ++n) {
+        auto u = view(s.hierarchy._patches[n]);
+        for (auto i : s.hierarchy._patches[n]._space) {
+            total = total + u[i] * volume;
+        }
+    }
+    if constexpr (std::is_arithmetic_v<typename M::value_t>) {
+        sample.push_back({"total", total});
+    } else {
+        for (std::size_t k = 0; k < total.size(); ++k) {
+            sample.push_back({"total_" + std::to_string(k), total[k]});
+        }
+    }
+    return sample;
+}
+
+} // namespace mist
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "core.hpp"
+
+namespace mist {
+
+// =============================================================================
+// array_view_t: Non-owning view of a row-major buffer
+// =============================================================================
+
+template<typename T, std::size_t S>
+struct array_view_t {
+    T* _data;
+    index_space_t<S> _space;
+
+    // Element at an absolute index
+    MIST_HD constexpr T& operator[](const ivec_t<S>& index) const {
+        return _data[ndoffset(_space, index)];
+    }
+};
+
+// Constructors
+template<typename T, std::size_t S>
+MIST_HD constexpr array_view_t<T, S> view(T* data, const index_space_t<S>& space) {
+    return array_view_t<T, S>{data, space};
+}
+
+template<typename T, typename A, std::size_t S>
+array_view_t<T, S> view(std::vector<T, A>& v, const index_space_t<S>& space) {
+    if (v.size() != size(space)) {
+        throw std::runtime_error("view: buffer size does not match index space");
+    }
+    return array_view_t<T, S>{v.data(), space};
+}
+
+template<typename T, typename A, std::size_t S>
+array_view_t<const T, S> view(const std::vector<T, A>& v, const index_space_t<S>& space) {
+    if (v.size() != size(space)) {
+        throw std::runtime_error("view: buffer size does not match index space");
+    }
+    return array_view_t<const T, S>{v.data(), space};
+}
+
+// Free functions for array_view_t
+template<typename T, std::size_t S>
+MIST_HD constexpr T* data(const array_view_t<T, S>& v) {
+    return v._data;
+}
+
+template<typename T, std::size_t S>
+MIST_HD constexpr const index_space_t<S>& domain(const array_view_t<T, S>& v) {
+    return v._space;
+}
+
+template<typename T, std::size_t S>
+MIST_HD constexpr T ndread(const array_view_t<T, S>& v, const ivec_t<S>& index) {
+    return v._data[ndoffset(v._space, index)];
+}
+
+template<typename T, std::size_t S>
+MIST_HD constexpr void ndwrite(const array_view_t<T, S>& v, const ivec_t<S>& index, std::type_identity_t<T> value) {
+    v._data[ndoffset(v._space, index)] = value;
+}
+
+// =============================================================================
+// vec_view_t: Non-owning view of a multi-component buffer
+// =============================================================================
+
+// A buffer holding a vec_t<T, N> per zone, with components placed by the
+// component layout C (aos_t, soa_t, aosoa_t). Kernels written against
+// vec_view_t read and write whole vectors or single components through one
+// API, so the layout can be changed without changing the kernel.
+template<typename T, std::size_t N, std::size_t S, ComponentLayout C>
+struct vec_view_t {
+    T* _data;
+    index_space_t<S> _space;
+};
+
+// Constructors
+template<std::size_t N, ComponentLayout C, typename T, std::size_t S>
+MIST_HD constexpr vec_view_t<T, N, S, C> vec_view(C, T* data, const index_space_t<S>& space) {
+    return vec_view_t<T, N, S, C>{data, space};
+}
+
+template<std::size_t N, ComponentLayout C, typename T, typename A, std::size_t S>
+vec_view_t<T, N, S, C> vec_view(C layout, std::vector<T, A>& v, const index_space_t<S>& space) {
+    if (v.size() != ndsize<N>(layout, space)) {
+        throw std::runtime_error("vec_view: buffer size does not match index space");
+    }
+    return vec_view_t<T, N, S, C>{v.data(), space};
+}
+
+template<std::size_t N, ComponentLayout C, typename T, typename A, std::size_t S>
+vec_view_t<const T, N, S, C> vec_view(C layout, const std::vector<T, A>& v, const index_space_t<S>& space) {
+    if (v.size() != ndsize<N>(layout, space)) {
+        throw std::runtime_error("vec_view: buffer size does not match index space");
+    }
+    return vec_view_t<const T, N, S, C>{v.data(), space};
+}
+
+// Free functions for vec_view_t
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr T* data(const vec_view_t<T, N, S, C>& v) {
+    return v._data;
+}
+
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr const index_space_t<S>& domain(const vec_view_t<T, N, S, C>& v) {
+    return v._space;
+}
+
+// Whole vector at an index
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr vec_t<std::remove_const_t<T>, N> ndread(const vec_view_t<T, N, S, C>& v, const ivec_t<S>& index) {
+    vec_t<std::remove_const_t<T>, N> result{};
+    for (std::size_t k = 0; k < N; ++k) {
+        result._data[k] = v._data[ndoffset<N>(C{}, v._space, index, k)];
+    }
+    return result;
+}
+
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr void ndwrite(const vec_view_t<T, N, S, C>& v, const ivec_t<S>& index, const vec_t<T, N>& value) {
+    for (std::size_t k = 0; k < N; ++k) {
+        v._data[ndoffset<N>(C{}, v._space, index, k)] = value._data[k];
+    }
+}
+
+// Single component k at an index
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr std::remove_const_t<T> ndread(const vec_view_t<T, N, S, C>& v, const ivec_t<S>& index, std::size_t k) {
+    return v._data[ndoffset<N>(C{}, v._space, index, k)];
+}
+
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr void ndwrite(const vec_view_t<T, N, S, C>& v, const ivec_t<S>& index, std::size_t k, T value) {
+    v._data[ndoffset<N>(C{}, v._space, index, k)] = value;
+}
+
+// =============================================================================
+// Lazy expressions
+// =============================================================================
+
+// An expression is an array view, or a lazy combination of views, scalars
+// and vec_t constants. Nothing is computed until an expression is assigned;
+// then every element is evaluated in a single traversal, with no temporaries.
+
+// Scalar or vec_t operand, broadcast to every index
+template<typename T>
+struct constant_t {
+    T _value;
+};
+
+// Lazy element-wise application of _func to the operands
+template<typename F, typename... Args>
+struct expr_t {
+    F _func;
+    std::tuple<Args...> _args;
+};
+
+namespace detail {
+    template<typename T> struct is_expression : std::false_type {};
+    template<typename T, std::size_t S> struct is_expression<array_view_t<T, S>> : std::true_type {};
+    template<typename T, std::size_t N, std::size_t S, typename C> struct is_expression<vec_view_t<T, N, S, C>> : std::true_type {};
+    template<typename T> struct is_expression<constant_t<T>> : std::true_type {};
+    template<typename F, typename... Args> struct is_expression<expr_t<F, Args...>> : std::true_type {};
+
+    template<typename T> struct is_vec_type : std::false_type {};
+    template<typename T, std::size_t S> struct is_vec_type<vec_t<T, S>> : std::true_type {};
+}
+
+template<typename T>
+concept Expression = detail::is_expression<std::remove_cvref_t<T>>::value;
+
+// Values that are broadcast when combined with an expression
+template<typename T>
+concept Broadcastable = Arithmetic<std::remove_cvref_t<T>> || detail::is_vec_type<std::remove_cvref_t<T>>::value;
+
+template<typename T>
+concept Operand = Expression<T> || Broadcastable<T>;
+
+// Evaluate an expression at an absolute index
+template<typename T, std::size_t S>
+MIST_HD constexpr auto eval(const array_view_t<T, S>& v, const ivec_t<S>& index) {
+    return ndread(v, index);
+}
+
+template<typename T, std::size_t N, std::size_t S, typename C>
+MIST_HD constexpr auto eval(const vec_view_t<T, N, S, C>& v, const ivec_t<S>& index) {
+    return ndread(v, index);
+}
+
+template<typename T, std::size_t S>
+MIST_HD constexpr T eval(const constant_t<T>& c, const ivec_t<S>&) {
+    return c._value;
+}
+
+template<typename F, typename... Args, std::size_t S>
+MIST_HD constexpr auto eval(const expr_t<F, Args...>& e, const ivec_t<S>& index) {
+    return std::apply([&](const auto&... args) {
+        return e._func(eval(args, index)...);
+    }, e._args);
+}
+
+namespace detail {
+    template<typename T>
+    constexpr auto as_operand(const T& x) {
+        if constexpr (Expression<T>) {
+            return x;
+        } else {
+            return constant_t<T>{x};
+        }
+    }
+
+    template<typename F, typename... Args>
+    constexpr auto make_expr(F func, const Args&... args) {
+        return expr_t<F, decltype(as_operand(args))...>{func, {as_operand(args)...}};
+    }
+
+    struct add_op { template<typename A, typename B> MIST_HD constexpr auto operator()(const A& a, const B& b) const { return a + b; } };
+    struct sub_op { template<typename A, typename B> MIST_HD constexpr auto operator()(const A& a, const B& b) const { return a - b; } };
+    struct mul_op { template<typename A, typename B> MIST_HD constexpr auto operator()(const A& a, const B& b) const { return a * b; } };
+    struct div_op { template<typename A, typename B> MIST_HD constexpr auto operator()(const A& a, const B& b) const { return a / b; } };
+    struct neg_op { template<typename A> MIST_HD constexpr auto operator()(const A& a) const { return -a; } };
+
+    struct component_op {
+        std::size_t _k;
+        template<typename V> MIST_HD constexpr auto operator()(const V& v) const { return v[_k]; }
+    };
+}
+
+// Element-wise operators; at least one operand must be an expression
+template<Operand A, Operand B>
+    requires (Expression<A> || Expression<B>)
+constexpr auto operator+(const A& a, const B& b) {
+    return detail::make_expr(detail::add_op{}, a, b);
+}
+
+template<Operand A, Operand B>
+    requires (Expression<A> || Expression<B>)
+constexpr auto operator-(const A& a, const B& b) {
+    return detail::make_expr(detail::sub_op{}, a, b);
+}
+
+template<Operand A, Operand B>
+    requires (Expression<A> || Expression<B>)
+constexpr auto operator*(const A& a, const B& b) {
+    return detail::make_expr(detail::mul_op{}, a, b);
+}
+
+template<Operand A, Operand B>
+    requires (Expression<A> || Expression<B>)
+constexpr auto operator/(const A& a, const B& b) {
+    return detail::make_expr(detail::div_op{}, a, b);
+}
+
+template<Expression A>
+constexpr auto operator-(const A& a) {
+    return detail::make_expr(detail::neg_op{}, a);
+}
+
+// Lazy element-wise function application, e.g. map(a, [](double x) { return std::sqrt(x); })
+template<Expression A, typename F>
+constexpr auto map(const A& a, F func) {
+    return detail::make_expr(func, a);
+}
+
+// Lazy extraction of component k from an expression of vec_t elements
+template<Expression A>
+constexpr auto component(const A& a, std::size_t k) {
+    return detail::make_expr(detail::component_op{k}, a);
+}
+
+// =============================================================================
+// Assignment
+// =============================================================================
+
+// A view that expressions can be assigned to
+template<typename D>
+concept WritableView = Expression<D> && requires(const D& dst) {
+    { domain(dst) };
+    ndwrite(dst, start(domain(dst)), eval(dst, start(domain(dst))));
+};
+
+namespace detail {
+    // Whether every view in an expression can be read over space
+    template<typename T, std::size_t S>
+    bool covers(const array_view_t<T, S>& v, const index_space_t<S>& space) {
+        return intersect(space, domain(v)) == space;
+    }
+
+    template<typename T, std::size_t N, std::size_t S, typename C>
+    bool covers(const vec_view_t<T, N, S, C>& v, const index_space_t<S>& space) {
+        return intersect(space, domain(v)) == space;
+    }
+
+    template<typename T, std::size_t S>
+    bool covers(const constant_t<T>&, const index_space_t<S>&) {
+        return true;
+    }
+
+    template<typename F, typename... Args, std::size_t S>
+    bool covers(const expr_t<F, Args...>& e, const index_space_t<S>& space) {
+        return std::apply([&](const auto&... args) {
+            return (covers(args, space) && ...);
+        }, e._args);
+    }
+}
+
+// Evaluate expr at every index of space and store it in dst, in one
+// traversal. Throws std::runtime_error if dst, or a view read by expr, does
+// not cover space.
+template<WritableView D, Expression E, std::size_t S, typename X>
+void assign(const D& dst, const E& expr, const index_space_t<S>& space, const X& e) {
+    if (!detail::covers(dst, space)) {
+        throw std::runtime_error("assign: the destination does not cover the index space");
+    }
+    if (!detail::covers(expr, space)) {
+        throw std::runtime_error("assign: a view in the expression does not cover the index space");
+    }
+    for_each(space, [dst, expr](const ivec_t<S>& index) {
+        ndwrite(dst, index, eval(expr, index));
+    }, e);
+}
+
+template<WritableView D, Expression E, typename X>
+    requires (!std::same_as<X, std::remove_cvref_t<decltype(domain(std::declval<D>()))>>)
+void assign(const D& dst, const E& expr, const X& e) {
+    assign(dst, expr, domain(dst), e);
+}
+
+template<WritableView D, Expression E>
+void assign(const D& dst, const E& expr) {
+    assign(dst, expr, domain(dst), cpu_t{});
+}
+
+} // namespace mist
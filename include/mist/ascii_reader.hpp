@@ -90,9 +90,9 @@ public:
     // Arrays (dynamic std::vector)
     // =========================================================================
 
-    template<typename T>
+    template<typename T, typename Alloc>
         requires std::is_arithmetic_v<T>
-    void read_array(const char* name, std::vector<T>& value) {
+    void read_array(const char* name, std::vector<T, Alloc>& value) {
         skip_whitespace_and_comments();
         std::string field_name = read_identifier();
         if (field_name != name) {
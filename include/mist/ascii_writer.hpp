@@ -56,9 +56,9 @@ public:
     // Arrays (dynamic std::vector)
     // =========================================================================
 
-    template<typename T>
+    template<typename T, typename Alloc>
         requires std::is_arithmetic_v<T>
-    void write_array(const char* name, const std::vector<T>& value) {
+    void write_array(const char* name, const std::vector<T, Alloc>& value) {
         write_indent();
         os_ << name << " = [";
         for (std::size_t i = 0; i < value.size(); ++i) {
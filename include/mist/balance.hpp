@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include "core.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Curve partitions
+// =============================================================================
+
+// When the cost per zone varies (shocks, stiff chemistry, refined regions),
+// dividing patches by zone count leaves most workers waiting on the
+// slowest. Here patches are instead divided by measured cost: they are
+// ordered along a Hilbert curve through their centers, and the curve is cut
+// into runs of nearly equal total cost, so each worker (or rank) gets a
+// compact, contiguous group of patches whose boundaries with other groups
+// stay short.
+
+// When a rebalance pays for itself. Moving a patch to another worker costs
+// _migration_cost seconds per zone (for threads, the cache and NUMA
+// locality lost; for ranks, the time to send it). A new partition is only
+// adopted when its predicted saving over the next _horizon traversals
+// exceeds that cost, and the current partition is more than _tolerance
+// above a perfect balance.
+struct balance_policy_t {
+    double _migration_cost = 0.0;
+    double _horizon = 10.0;
+    double _tolerance = 0.05;
+};
+
+// Patch indices ordered along a Hilbert curve through the patch centers
+template<std::size_t S>
+std::vector<std::size_t> curve_order(const std::vector<index_space_t<S>>& spaces) {
+    auto order = std::vector<std::size_t>(spaces.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+
+    if (spaces.empty()) {
+        return order;
+    }
+
+    // Twice the centers, so they are integers, relative to their lower corner
+    auto centers = std::vector<ivec_t<S>>{};
+    auto lo = ivec_t<S>{};
+    auto hi = ivec_t<S>{};
+
+    for (const auto& space : spaces) {
+        auto c = ivec_t<S>{};
+        for (std::size_t a = 0; a < S; ++a) {
+            c._data[a] = 2 * space._start._data[a] + static_cast<int>(space._shape._data[a]);
+        }
+        centers.push_back(c);
+    }
+    lo = hi = centers[0];
+    for (const auto& c : centers) {
+        for (std::size_t a = 0; a < S; ++a) {
+            lo._data[a] = std::min(lo._data[a], c._data[a]);
+            hi._data[a] = std::max(hi._data[a], c._data[a]);
+        }
+    }
+    auto level = 0u;
+    for (std::size_t a = 0; a < S; ++a) {
+        while ((std::int64_t(1) << level) <= std::int64_t(hi._data[a]) - lo._data[a]) ++level;
+    }
+
+    auto keys = std::vector<std::uint64_t>{};
+    for (const auto& c : centers) {
+        auto point = uvec_t<S>{};
+        for (std::size_t a = 0; a < S; ++a) {
+            point._data[a] = static_cast<unsigned int>(c._data[a] - lo._data[a]);
+        }
+        keys.push_back(detail::curve_key<true>(point, level));
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t i, std::size_t j) {
+        return keys[i] < keys[j];
+    });
+    return order;
+}
+
+// The part (0 to parts - 1) of each patch, cutting the curve order into
+// parts runs of nearly equal total cost: each cut is placed where the
+// running total is nearest a multiple of the mean load
+inline std::vector<std::size_t> curve_partition(const std::vector<std::size_t>& order, const std::vector<double>& cost, std::size_t parts) {
+    auto part = std::vector<std::size_t>(cost.size(), 0);
+    auto total = 0.0;
+
+    for (auto k : order) {
+        total += cost[k];
+    }
+    auto before = 0.0;
+
+    for (auto k : order) {
+        auto mid = before + 0.5 * cost[k];
+        auto p = total > 0.0 ? static_cast<std::size_t>(mid / total * static_cast<double>(parts)) : 0;
+        part[k] = std::min(p, parts - 1);
+        before += cost[k];
+    }
+    return part;
+}
+
+// The total cost of each part
+inline std::vector<double> part_loads(const std::vector<double>& cost, const std::vector<std::size_t>& part, std::size_t parts) {
+    auto loads = std::vector<double>(parts, 0.0);
+    for (std::size_t k = 0; k < cost.size(); ++k) {
+        loads[part[k]] += cost[k];
+    }
+    return loads;
+}
+
+// The partition to use next: a new curve partition of the patches if the
+// policy finds it worth the migration (the zones of patches changing part),
+// else part unchanged
+template<std::size_t S>
+std::vector<std::size_t> rebalance(
+    const std::vector<index_space_t<S>>& spaces,
+    const std::vector<double>& cost,
+    const std::vector<std::size_t>& part,
+    std::size_t parts,
+    const balance_policy_t& policy = {})
+{
+    auto next = curve_partition(curve_order(spaces), cost, parts);
+    auto loads = part_loads(cost, part, parts);
+    auto next_loads = part_loads(cost, next, parts);
+    auto max_load = *std::max_element(loads.begin(), loads.end());
+    auto next_max_load = *std::max_element(next_loads.begin(), next_loads.end());
+    auto mean_load = std::accumulate(loads.begin(), loads.end(), 0.0) / static_cast<double>(parts);
+
+    if (max_load <= mean_load * (1.0 + policy._tolerance)) {
+        return part;
+    }
+    auto moved = 0.0;
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        if (next[k] != part[k]) {
+            moved += size(spaces[k]);
+        }
+    }
+    auto saving = (max_load - next_max_load) * policy._horizon;
+    return saving > moved * policy._migration_cost ? next : part;
+}
+
+// =============================================================================
+// Balanced multi-patch traversals
+// =============================================================================
+
+// Measured per-patch costs and the assignment of patches to workers, kept
+// across traversals of the same set of patches. Costs are smoothed over
+// traversals, and every _interval traversals the assignment is
+// reconsidered under _policy. A change in the number of patches or
+// workers starts over, partitioning by zone count until costs are measured.
+struct load_balancer_t {
+    std::vector<double> _cost{};       // smoothed seconds per patch
+    std::vector<std::size_t> _part{};  // worker slot of each patch
+    std::size_t _parts = 0;
+    int _interval = 10;
+    int _count = 0;
+    double _smoothing = 0.5;           // weight of the newest measurement
+    balance_policy_t _policy{};
+};
+
+namespace detail {
+    template<std::size_t S>
+    void reset_balancer(load_balancer_t& lb, const std::vector<index_space_t<S>>& spaces, std::size_t parts) {
+        auto zones = std::vector<double>{};
+        for (const auto& space : spaces) {
+            zones.push_back(size(space));
+        }
+        lb._part = curve_partition(curve_order(spaces), zones, parts);
+        lb._cost.assign(spaces.size(), -1.0);  // not yet measured
+        lb._parts = parts;
+        lb._count = 0;
+    }
+}
+
+// Call func(p, index) for every index of every patch p, with whole patches
+// assigned to the executor's workers by measured cost. Each patch's wall
+// time is recorded into lb, and every lb._interval traversals the patches
+// are repartitioned along the curve if lb._policy finds it worthwhile.
+// With static chunking, worker k runs the patches of slot k.
+template<PatchRange R, typename F, Executor E>
+void for_each(const R& patches, F&& func, load_balancer_t& lb, const E& e) {
+    using clock = std::chrono::steady_clock;
+
+    auto n = static_cast<std::size_t>(std::ranges::size(patches));
+    auto parts = num_workers(e);
+    auto spaces = std::vector<std::decay_t<decltype(domain(std::ranges::begin(patches)[0]))>>{};
+    spaces.reserve(n);
+
+    for (const auto& p : patches) {
+        spaces.push_back(domain(p));
+    }
+    if (lb._part.size() != n || lb._parts != parts) {
+        detail::reset_balancer(lb, spaces, parts);
+    }
+
+    // Each slot's patches, in curve order
+    auto slots = std::vector<std::vector<std::size_t>>(parts);
+    for (auto k : curve_order(spaces)) {
+        slots[lb._part[k]].push_back(k);
+    }
+    auto elapsed = std::vector<double>(n, 0.0);
+
+    execute(e, parts, [&](std::size_t first, std::size_t last, std::size_t) {
+        for (auto slot = first; slot < last; ++slot) {
+            for (auto k : slots[slot]) {
+                const auto& p = std::ranges::begin(patches)[k];
+                const auto& space = domain(p);
+                auto start = clock::now();
+
+                for (std::size_t m = 0; m < size(space); ++m) {
+                    func(p, ndindex(space, m));
+                }
+                elapsed[k] = std::chrono::duration<double>(clock::now() - start).count();
+            }
+        }
+    });
+
+    for (std::size_t k = 0; k < n; ++k) {
+        lb._cost[k] = lb._cost[k] < 0.0 ? elapsed[k] : (1.0 - lb._smoothing) * lb._cost[k] + lb._smoothing * elapsed[k];
+    }
+    if (++lb._count % lb._interval == 0) {
+        lb._part = rebalance(spaces, lb._cost, lb._part, parts, lb._policy);
+    }
+}
+
+} // namespace mist
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "core.hpp"
+#include "array.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Boundary conditions
+// =============================================================================
+
+// Boundary types, numbered as in configuration files (0, 1, 2)
+enum class boundary {
+    periodic,
+    outflow,
+    reflecting
+};
+
+inline boundary parse_boundary(const std::string& str) {
+    if (str == "periodic") return boundary::periodic;
+    if (str == "outflow") return boundary::outflow;
+    if (str == "reflecting") return boundary::reflecting;
+    throw std::runtime_error("boundary must be 'periodic', 'outflow', or 'reflecting'");
+}
+
+// Boundary type of the lower and upper face along each axis
+template<std::size_t S>
+struct boundary_conditions_t {
+    std::array<boundary, S> _lo;
+    std::array<boundary, S> _hi;
+};
+
+// The same boundary type on every face
+template<std::size_t S>
+constexpr boundary_conditions_t<S> boundary_conditions(boundary type) {
+    auto result = boundary_conditions_t<S>{};
+    result._lo.fill(type);
+    result._hi.fill(type);
+    return result;
+}
+
+// Leaves values unchanged when they are mirrored by a reflecting boundary
+struct no_reflect {
+    template<typename T>
+    MIST_HD constexpr T operator()(const T& value, std::size_t) const {
+        return value;
+    }
+};
+
+namespace detail {
+    // Interior coordinate that supplies ghost coordinate x along one axis
+    // of an interior range [lo, lo + n)
+    MIST_HD constexpr int boundary_source(boundary type, int x, int lo, int n) {
+        auto hi = lo + n;
+        if (x >= lo && x < hi) {
+            return x;
+        }
+        switch (type) {
+            case boundary::periodic: return lo + ((x - lo) % n + n) % n;
+            case boundary::outflow: return x < lo ? lo : hi - 1;
+            case boundary::reflecting: return x < lo ? lo + (lo - 1 - x) : hi - 1 - (x - hi);
+        }
+        return x;
+    }
+
+    // The (up to 3^S - 1) boxes of padded outside interior: the faces, edges
+    // and corners of the ghost shell
+    template<std::size_t S>
+    std::vector<index_space_t<S>> ghost_regions(const index_space_t<S>& padded, const index_space_t<S>& interior) {
+        auto regions = std::vector<index_space_t<S>>{};
+        auto count = 1u;
+        for (std::size_t a = 0; a < S; ++a) {
+            count *= 3;
+        }
+        for (unsigned int code = 0; code < count; ++code) {
+            auto region = interior;
+            auto c = code;
+            auto ghost = false;
+
+            for (std::size_t a = 0; a < S; ++a, c /= 3) {
+                auto lo = padded._start._data[a];
+                auto mid = interior._start._data[a];
+                auto hi = mid + static_cast<int>(interior._shape._data[a]);
+                auto end = lo + static_cast<int>(padded._shape._data[a]);
+
+                switch (c % 3) {
+                    case 0: region._start._data[a] = lo; region._shape._data[a] = mid - lo; ghost = true; break;
+                    case 1: break;
+                    case 2: region._start._data[a] = hi; region._shape._data[a] = end - hi; ghost = true; break;
+                }
+            }
+            if (ghost && size(region) > 0) {
+                regions.push_back(region);
+            }
+        }
+        return regions;
+    }
+}
+
+// Fill the ghost zones of u, meaning the zones of domain(u) outside
+// interior, from the interior values according to the boundary types bc.
+// The rule along each axis is applied independently, so faces, edges and
+// corners of the ghost shell are filled together, in one traversal that is
+// distributed over the executor's workers.
+//
+// Along a reflecting axis, ghost values are mirrored from the interior and
+// passed through reflect(value, axis), which for example negates the
+// normal component of a velocity or momentum. Reflecting ghost layers may
+// be no deeper than the interior. u may be an array_view_t or a vec_view_t.
+template<WritableView D, std::size_t S, Executor E, typename R = no_reflect>
+void fill_ghosts(const D& u, const index_space_t<S>& interior, const boundary_conditions_t<S>& bc, const E& e, R reflect = {}) {
+    const auto& padded = domain(u);
+
+    if (intersect(padded, interior) != interior || size(interior) == 0) {
+        throw std::runtime_error("fill_ghosts: interior must be a non-empty subspace of domain(u)");
+    }
+    for (std::size_t a = 0; a < S; ++a) {
+        auto lo_depth = interior._start._data[a] - padded._start._data[a];
+        auto hi_depth = static_cast<int>(padded._shape._data[a]) - static_cast<int>(interior._shape._data[a]) - lo_depth;
+        auto n = static_cast<int>(interior._shape._data[a]);
+
+        if ((bc._lo[a] == boundary::reflecting && lo_depth > n) || (bc._hi[a] == boundary::reflecting && hi_depth > n)) {
+            throw std::runtime_error("fill_ghosts: reflecting ghost layer is deeper than the interior");
+        }
+    }
+
+    auto regions = detail::ghost_regions(padded, interior);
+
+    for_each(regions, [&](const index_space_t<S>&, const ivec_t<S>& index) {
+        auto source = index;
+        auto mirrored = std::array<bool, S>{};
+
+        for (std::size_t a = 0; a < S; ++a) {
+            auto x = index._data[a];
+            auto lo = interior._start._data[a];
+            auto type = x < lo ? bc._lo[a] : bc._hi[a];
+            source._data[a] = detail::boundary_source(type, x, lo, static_cast<int>(interior._shape._data[a]));
+            mirrored[a] = source._data[a] != x && type == boundary::reflecting;
+        }
+        auto value = ndread(u, source);
+
+        for (std::size_t a = 0; a < S; ++a) {
+            if (mirrored[a]) {
+                value = reflect(value, a);
+            }
+        }
+        ndwrite(u, index, value);
+    }, e);
+}
+
+template<WritableView D, std::size_t S>
+void fill_ghosts(const D& u, const index_space_t<S>& interior, const boundary_conditions_t<S>& bc) {
+    fill_ghosts(u, interior, bc, cpu_t{});
+}
+
+} // namespace mist
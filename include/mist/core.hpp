@@ -1,10 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 // CUDA compatibility macros
 #ifdef __CUDACC__
@@ -42,9 +67,30 @@ concept UnaryFunction = requires(F f, T t) {
 // vec_t: Statically sized array type
 // =============================================================================
 
+namespace detail {
+    // Natural SIMD alignment of N elements of T: their size if that is a
+    // power of two no larger than a cache line, otherwise alignof(T)
+    template<typename T, std::size_t N>
+    constexpr std::size_t simd_alignment() {
+        constexpr std::size_t bytes = sizeof(T) * N;
+        return (bytes & (bytes - 1)) == 0 && bytes <= 64 ? bytes : alignof(T);
+    }
+
+    // Defining MIST_ALIGNED_VEC aligns vec_t to its SIMD alignment. Only
+    // power-of-two byte sizes are affected, so sizeof(vec_t) never changes.
+    template<typename T, std::size_t S>
+    constexpr std::size_t vec_alignment() {
+        #ifdef MIST_ALIGNED_VEC
+        return simd_alignment<T, S>();
+        #else
+        return alignof(T);
+        #endif
+    }
+}
+
 template<Arithmetic T, std::size_t S>
     requires (S > 0)
-struct vec_t {
+struct alignas(detail::vec_alignment<T, S>()) vec_t {
     T _data[S];
 
     MIST_HD constexpr T& operator[](std::size_t i) { return _data[i]; }
@@ -159,6 +205,54 @@ MIST_HD constexpr uvec_t<S> range() {
     return detail::range_impl<S>(std::make_index_sequence<S>{});
 }
 
+// =============================================================================
+// Native vector support
+// =============================================================================
+
+// With GCC and Clang, element-wise vec_t operators on 2, 3 and 4 components
+// of 4- or 8-byte arithmetic types are computed in one native vector register
+// when one is wide enough (3-vectors are padded to 4 lanes; double 3- and
+// 4-vectors need AVX). Results are identical to the scalar loops, which
+// remain in use for constant evaluation, other compilers, and when
+// MIST_NO_NATIVE_VECTORS is defined.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__CUDACC__) && !defined(MIST_NO_NATIVE_VECTORS)
+#define MIST_NATIVE_VECTORS
+#endif
+
+#ifdef MIST_NATIVE_VECTORS
+namespace detail {
+    #if defined(__AVX__)
+    inline constexpr std::size_t native_vector_bytes = 32;
+    #else
+    inline constexpr std::size_t native_vector_bytes = 16;
+    #endif
+
+    template<typename T, std::size_t S>
+    concept NativeVector = (std::is_floating_point_v<T> || (std::is_integral_v<T> && !std::is_same_v<T, bool>))
+        && (sizeof(T) == 4 || sizeof(T) == 8)
+        && S >= 2 && S <= 4
+        && sizeof(T) * (S == 3 ? 4 : S) <= native_vector_bytes;
+
+    template<typename T, std::size_t S>
+    struct native_vector {
+        static constexpr std::size_t lanes = S == 3 ? 4 : S;
+        typedef T type __attribute__((vector_size(lanes * sizeof(T))));
+    };
+
+    template<typename T, std::size_t S>
+    inline typename native_vector<T, S>::type to_native(const vec_t<T, S>& v) {
+        typename native_vector<T, S>::type result{};
+        std::memcpy(&result, v._data, sizeof(v._data));
+        return result;
+    }
+
+    template<typename T, std::size_t S, typename N>
+    inline void from_native(vec_t<T, S>& v, const N& native) {
+        std::memcpy(v._data, &native, sizeof(v._data));
+    }
+}
+#endif
+
 // =============================================================================
 // Operators
 // =============================================================================
@@ -168,6 +262,14 @@ template<Arithmetic T, Arithmetic U, std::size_t S>
 MIST_HD constexpr auto operator+(const vec_t<T, S>& a, const vec_t<U, S>& b) {
     using R = decltype(std::declval<T>() + std::declval<U>());
     vec_t<R, S> result{};
+    #ifdef MIST_NATIVE_VECTORS
+    if constexpr (std::is_same_v<T, U> && std::is_same_v<R, T> && detail::NativeVector<T, S>) {
+        if (!std::is_constant_evaluated()) {
+            detail::from_native(result, detail::to_native(a) + detail::to_native(b));
+            return result;
+        }
+    }
+    #endif
     for (std::size_t i = 0; i < S; ++i) {
         result._data[i] = a._data[i] + b._data[i];
     }
@@ -179,6 +281,14 @@ template<Arithmetic T, Arithmetic U, std::size_t S>
 MIST_HD constexpr auto operator-(const vec_t<T, S>& a, const vec_t<U, S>& b) {
     using R = decltype(std::declval<T>() - std::declval<U>());
     vec_t<R, S> result{};
+    #ifdef MIST_NATIVE_VECTORS
+    if constexpr (std::is_same_v<T, U> && std::is_same_v<R, T> && detail::NativeVector<T, S>) {
+        if (!std::is_constant_evaluated()) {
+            detail::from_native(result, detail::to_native(a) - detail::to_native(b));
+            return result;
+        }
+    }
+    #endif
     for (std::size_t i = 0; i < S; ++i) {
         result._data[i] = a._data[i] - b._data[i];
     }
@@ -190,6 +300,14 @@ template<Arithmetic T, Arithmetic U, std::size_t S>
 MIST_HD constexpr auto operator*(const vec_t<T, S>& v, U scalar) {
     using R = decltype(std::declval<T>() * std::declval<U>());
     vec_t<R, S> result{};
+    #ifdef MIST_NATIVE_VECTORS
+    if constexpr (std::is_same_v<R, T> && detail::NativeVector<T, S>) {
+        if (!std::is_constant_evaluated()) {
+            detail::from_native(result, detail::to_native(v) * static_cast<T>(scalar));
+            return result;
+        }
+    }
+    #endif
     for (std::size_t i = 0; i < S; ++i) {
         result._data[i] = v._data[i] * scalar;
     }
@@ -207,6 +325,14 @@ template<Arithmetic T, Arithmetic U, std::size_t S>
 MIST_HD constexpr auto operator/(const vec_t<T, S>& v, U scalar) {
     using R = decltype(std::declval<T>() / std::declval<U>());
     vec_t<R, S> result{};
+    #ifdef MIST_NATIVE_VECTORS
+    if constexpr (std::is_same_v<R, T> && std::is_floating_point_v<T> && detail::NativeVector<T, S>) {
+        if (!std::is_constant_evaluated()) {
+            detail::from_native(result, detail::to_native(v) / static_cast<T>(scalar));
+            return result;
+        }
+    }
+    #endif
     for (std::size_t i = 0; i < S; ++i) {
         result._data[i] = v._data[i] / scalar;
     }
@@ -218,6 +344,17 @@ template<Arithmetic T, Arithmetic U, std::size_t S>
 constexpr auto dot(const vec_t<T, S>& a, const vec_t<U, S>& b) {
     using R = decltype(std::declval<T>() * std::declval<U>());
     R result{};
+    #ifdef MIST_NATIVE_VECTORS
+    if constexpr (std::is_same_v<T, U> && std::is_same_v<R, T> && detail::NativeVector<T, S>) {
+        if (!std::is_constant_evaluated()) {
+            auto products = detail::to_native(a) * detail::to_native(b);
+            for (std::size_t i = 0; i < S; ++i) {
+                result += products[i];
+            }
+            return result;
+        }
+    }
+    #endif
     for (std::size_t i = 0; i < S; ++i) {
         result += a._data[i] * b._data[i];
     }
@@ -321,6 +458,82 @@ MIST_HD constexpr bool contains(const index_space_t<S>& space, const ivec_t<S>&
     return true;
 }
 
+// Grow a space by width zones on both sides of every axis
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> expand(const index_space_t<S>& space, const uvec_t<S>& width) {
+    auto result = space;
+    for (std::size_t i = 0; i < S; ++i) {
+        result._start._data[i] -= static_cast<int>(width._data[i]);
+        result._shape._data[i] += 2 * width._data[i];
+    }
+    return result;
+}
+
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> expand(const index_space_t<S>& space, unsigned int width) {
+    auto w = uvec_t<S>{};
+    for (std::size_t i = 0; i < S; ++i) {
+        w._data[i] = width;
+    }
+    return expand(space, w);
+}
+
+// Indices common to both spaces (an empty space if they are disjoint)
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> intersect(const index_space_t<S>& a, const index_space_t<S>& b) {
+    auto result = index_space_t<S>{};
+    for (std::size_t i = 0; i < S; ++i) {
+        int lo = std::max(a._start._data[i], b._start._data[i]);
+        int hi = std::min(a._start._data[i] + static_cast<int>(a._shape._data[i]),
+                          b._start._data[i] + static_cast<int>(b._shape._data[i]));
+        result._start._data[i] = lo;
+        result._shape._data[i] = hi > lo ? static_cast<unsigned int>(hi - lo) : 0;
+    }
+    return result;
+}
+
+// =============================================================================
+// Tiling
+// =============================================================================
+
+// Number of tiles of tile_shape needed to cover space. Every component of
+// tile_shape must be positive (see detail::check_tile_shape).
+template<std::size_t S>
+MIST_HD constexpr std::size_t tile_count(const index_space_t<S>& space, const uvec_t<S>& tile_shape) {
+    std::size_t total = 1;
+    for (std::size_t i = 0; i < S; ++i) {
+        total *= (space._shape._data[i] + tile_shape._data[i] - 1) / tile_shape._data[i];
+    }
+    return total;
+}
+
+namespace detail {
+    // Host-side entry points that tile a space reject empty tile shapes,
+    // which tile_count and tile_at would divide by
+    template<std::size_t S>
+    void check_tile_shape(const uvec_t<S>& tile_shape, const char* caller) {
+        for (std::size_t i = 0; i < S; ++i) {
+            if (tile_shape._data[i] == 0) {
+                throw std::runtime_error(std::string(caller) + ": tile shape must be positive along every axis");
+            }
+        }
+    }
+}
+
+// The n-th tile covering space (tiles in row-major order), clipped to space
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> tile_at(const index_space_t<S>& space, const uvec_t<S>& tile_shape, std::size_t n) {
+    auto result = index_space_t<S>{};
+    for (std::size_t i = S; i > 0; --i) {
+        auto tiles = (space._shape._data[i - 1] + tile_shape._data[i - 1] - 1) / tile_shape._data[i - 1];
+        auto t = static_cast<unsigned int>(n % tiles);
+        n /= tiles;
+        result._start._data[i - 1] = space._start._data[i - 1] + static_cast<int>(t * tile_shape._data[i - 1]);
+        result._shape._data[i - 1] = std::min(tile_shape._data[i - 1], space._shape._data[i - 1] - t * tile_shape._data[i - 1]);
+    }
+    return result;
+}
+
 // =============================================================================
 // Multi-dimensional indexing
 // =============================================================================
@@ -384,6 +597,238 @@ MIST_HD constexpr void ndwrite_soa(T* data, const index_space_t<S>& space, const
     }
 }
 
+// =============================================================================
+// Storage layouts
+// =============================================================================
+
+// Row-major storage, as used by ndoffset, ndread and ndwrite above
+struct row_major_t {};
+
+// Bricked storage: the space is divided into cubic bricks of B zones per
+// side. Bricks are stored one after another in row-major brick order, and
+// the zones of each brick are contiguous and row-major within the brick.
+// Edge bricks are padded to full size, so a bricked buffer holds
+// ndsize(bricked_t<B>{}, space) elements. A 3D stencil then touches a few
+// bricks (cache lines and pages) rather than several distant rows and planes.
+template<unsigned int B>
+    requires (B > 0)
+struct bricked_t {};
+
+// Row-major storage with padded strides: every stride but the innermost is
+// rounded up to an odd number of cache lines of L elements. On power-of-two
+// grids, plain row-major rows and planes are separated by multiples of the
+// cache way size, so a stencil's neighbors compete for a few cache sets;
+// odd strides spread them over all sets. Gaps hold no zone, and a padded
+// buffer holds ndsize(padded_t<L>{}, space) elements. L = 8 is a 64-byte
+// line of doubles.
+template<unsigned int L = 8>
+    requires (L > 0)
+struct padded_t {};
+
+namespace detail {
+    // Strides of a padded_t<L> buffer
+    template<unsigned int L, std::size_t S>
+    MIST_HD constexpr std::array<std::size_t, S> padded_strides(const index_space_t<S>& space) {
+        std::array<std::size_t, S> stride{};
+        stride[S - 1] = 1;
+        for (std::size_t i = S - 1; i > 0; --i) {
+            auto lines = (space._shape._data[i] * stride[i] + L - 1) / L;
+            stride[i - 1] = (lines | 1) * L;
+        }
+        return stride;
+    }
+}
+
+// Number of elements in a buffer with the given layout
+template<std::size_t S>
+MIST_HD constexpr std::size_t ndsize(row_major_t, const index_space_t<S>& space) {
+    return size(space);
+}
+
+template<unsigned int B, std::size_t S>
+MIST_HD constexpr std::size_t ndsize(bricked_t<B>, const index_space_t<S>& space) {
+    std::size_t total = 1;
+    for (std::size_t i = 0; i < S; ++i) {
+        total *= ((space._shape._data[i] + B - 1) / B) * B;
+    }
+    return total;
+}
+
+template<unsigned int L, std::size_t S>
+MIST_HD constexpr std::size_t ndsize(padded_t<L>, const index_space_t<S>& space) {
+    return space._shape._data[0] * detail::padded_strides<L>(space)[0];
+}
+
+// Flat offset of a multi-dimensional index
+template<std::size_t S>
+MIST_HD constexpr std::size_t ndoffset(row_major_t, const index_space_t<S>& space, const ivec_t<S>& index) {
+    return ndoffset(space, index);
+}
+
+template<unsigned int B, std::size_t S>
+MIST_HD constexpr std::size_t ndoffset(bricked_t<B>, const index_space_t<S>& space, const ivec_t<S>& index) {
+    std::size_t brick = 0;
+    std::size_t inner = 0;
+    for (std::size_t i = 0; i < S; ++i) {
+        auto rel = static_cast<unsigned int>(index._data[i] - space._start._data[i]);
+        auto bricks = (space._shape._data[i] + B - 1) / B;
+        brick = brick * bricks + rel / B;
+        inner = inner * B + rel % B;
+    }
+    std::size_t volume = 1;
+    for (std::size_t i = 0; i < S; ++i) {
+        volume *= B;
+    }
+    return brick * volume + inner;
+}
+
+template<unsigned int L, std::size_t S>
+MIST_HD constexpr std::size_t ndoffset(padded_t<L>, const index_space_t<S>& space, const ivec_t<S>& index) {
+    auto stride = detail::padded_strides<L>(space);
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < S; ++i) {
+        offset += static_cast<std::size_t>(index._data[i] - space._start._data[i]) * stride[i];
+    }
+    return offset;
+}
+
+// Multi-dimensional index at a flat offset (for bricked and padded storage,
+// offsets in padding map to indices outside the space)
+template<std::size_t S>
+MIST_HD constexpr ivec_t<S> ndindex(row_major_t, const index_space_t<S>& space, std::size_t offset) {
+    return ndindex(space, offset);
+}
+
+template<unsigned int B, std::size_t S>
+MIST_HD constexpr ivec_t<S> ndindex(bricked_t<B>, const index_space_t<S>& space, std::size_t offset) {
+    ivec_t<S> index{};
+    std::size_t volume = 1;
+    for (std::size_t i = 0; i < S; ++i) {
+        volume *= B;
+    }
+    auto brick = offset / volume;
+    auto inner = offset % volume;
+    for (std::size_t i = S; i > 0; --i) {
+        auto bricks = (space._shape._data[i - 1] + B - 1) / B;
+        auto rel = (brick % bricks) * B + inner % B;
+        index._data[i - 1] = space._start._data[i - 1] + static_cast<int>(rel);
+        brick /= bricks;
+        inner /= B;
+    }
+    return index;
+}
+
+template<unsigned int L, std::size_t S>
+MIST_HD constexpr ivec_t<S> ndindex(padded_t<L>, const index_space_t<S>& space, std::size_t offset) {
+    auto stride = detail::padded_strides<L>(space);
+    ivec_t<S> index{};
+    for (std::size_t i = 0; i < S; ++i) {
+        index._data[i] = space._start._data[i] + static_cast<int>(offset / stride[i]);
+        offset %= stride[i];
+    }
+    return index;
+}
+
+// A storage layout maps the indices of a space to distinct buffer offsets
+template<typename L>
+concept Layout = requires(L layout, index_space_t<1> space, ivec_t<1> index, std::size_t offset) {
+    { ndsize(layout, space) } -> std::convertible_to<std::size_t>;
+    { ndoffset(layout, space, index) } -> std::convertible_to<std::size_t>;
+    { ndindex(layout, space, offset) } -> std::same_as<ivec_t<1>>;
+};
+
+// Read and write scalars in a buffer with the given layout
+template<Layout L, typename T, std::size_t S>
+MIST_HD constexpr T ndread(L layout, const T* data, const index_space_t<S>& space, const ivec_t<S>& index) {
+    return data[ndoffset(layout, space, index)];
+}
+
+template<Layout L, typename T, std::size_t S>
+MIST_HD constexpr void ndwrite(L layout, T* data, const index_space_t<S>& space, const ivec_t<S>& index, T value) {
+    data[ndoffset(layout, space, index)] = value;
+}
+
+// =============================================================================
+// Component layouts
+// =============================================================================
+
+// Placement of the N components of each zone of a multi-component array.
+// Each policy is parameterized by the spatial layout L that orders zones.
+
+// Array of structures: the components of a zone are adjacent
+template<Layout L = row_major_t>
+struct aos_t {};
+
+// Structure of arrays: each component is a contiguous array (component-major,
+// as used by ndread_soa and ndwrite_soa)
+template<Layout L = row_major_t>
+struct soa_t {};
+
+// Array of structures of arrays: zones are grouped into tiles of W, and each
+// tile stores its W values of component 0, then of component 1, and so on
+template<std::size_t W, Layout L = row_major_t>
+    requires (W > 0)
+struct aosoa_t {};
+
+// Number of buffer elements for N components per zone
+template<std::size_t N, Layout L, std::size_t S>
+MIST_HD constexpr std::size_t ndsize(aos_t<L>, const index_space_t<S>& space) {
+    return N * ndsize(L{}, space);
+}
+
+template<std::size_t N, Layout L, std::size_t S>
+MIST_HD constexpr std::size_t ndsize(soa_t<L>, const index_space_t<S>& space) {
+    return N * ndsize(L{}, space);
+}
+
+template<std::size_t N, std::size_t W, Layout L, std::size_t S>
+MIST_HD constexpr std::size_t ndsize(aosoa_t<W, L>, const index_space_t<S>& space) {
+    return (ndsize(L{}, space) + W - 1) / W * W * N;
+}
+
+// Offset of component k of the zone at index, for N components per zone
+template<std::size_t N, Layout L, std::size_t S>
+MIST_HD constexpr std::size_t ndoffset(aos_t<L>, const index_space_t<S>& space, const ivec_t<S>& index, std::size_t k) {
+    return ndoffset(L{}, space, index) * N + k;
+}
+
+template<std::size_t N, Layout L, std::size_t S>
+MIST_HD constexpr std::size_t ndoffset(soa_t<L>, const index_space_t<S>& space, const ivec_t<S>& index, std::size_t k) {
+    return k * ndsize(L{}, space) + ndoffset(L{}, space, index);
+}
+
+template<std::size_t N, std::size_t W, Layout L, std::size_t S>
+MIST_HD constexpr std::size_t ndoffset(aosoa_t<W, L>, const index_space_t<S>& space, const ivec_t<S>& index, std::size_t k) {
+    auto zone = ndoffset(L{}, space, index);
+    return zone / W * W * N + k * W + zone % W;
+}
+
+// A component layout places N components of every zone at distinct offsets
+template<typename C>
+concept ComponentLayout = requires(C layout, index_space_t<1> space, ivec_t<1> index) {
+    { ndsize<2>(layout, space) } -> std::convertible_to<std::size_t>;
+    { ndoffset<2>(layout, space, index, std::size_t(0)) } -> std::convertible_to<std::size_t>;
+};
+
+// Read and write a vec_t<T, N> with any component layout
+template<typename T, std::size_t N, ComponentLayout C, std::size_t S>
+    requires Arithmetic<T>
+MIST_HD constexpr vec_t<T, N> ndread(C layout, const T* data, const index_space_t<S>& space, const ivec_t<S>& index) {
+    vec_t<T, N> result{};
+    for (std::size_t k = 0; k < N; ++k) {
+        result._data[k] = data[ndoffset<N>(layout, space, index, k)];
+    }
+    return result;
+}
+
+template<ComponentLayout C, typename T, std::size_t N, std::size_t S>
+    requires Arithmetic<T>
+MIST_HD constexpr void ndwrite(C layout, T* data, const index_space_t<S>& space, const ivec_t<S>& index, const vec_t<T, N>& value) {
+    for (std::size_t k = 0; k < N; ++k) {
+        data[ndoffset<N>(layout, space, index, k)] = value._data[k];
+    }
+}
+
 // =============================================================================
 // Iterator for index_space_t
 // =============================================================================
@@ -435,171 +880,1522 @@ constexpr index_space_iterator<S> end(const index_space_t<S>& space) {
 }
 
 // =============================================================================
-// Execution policies
+// pack_t: Lane-width SIMD pack
 // =============================================================================
 
-enum class exec {
-    cpu,
-    omp,
-    gpu
+template<Arithmetic T, std::size_t W>
+    requires (W > 0)
+struct alignas(detail::simd_alignment<T, W>()) pack_t {
+    T _data[W];
+
+    MIST_HD constexpr T& operator[](std::size_t i) { return _data[i]; }
+    MIST_HD constexpr const T& operator[](std::size_t i) const { return _data[i]; }
+
+    MIST_HD constexpr std::size_t size() const { return W; }
 };
 
-// =============================================================================
-// Parallel index space traversals
-// =============================================================================
+// Pack with every lane equal to value
+template<std::size_t W, Arithmetic T>
+MIST_HD constexpr pack_t<T, W> broadcast(T value) {
+    pack_t<T, W> result{};
+    for (std::size_t i = 0; i < W; ++i) {
+        result._data[i] = value;
+    }
+    return result;
+}
 
-#ifdef __CUDACC__
-template<std::size_t S, typename F>
-__global__ void for_each_kernel(index_space_t<S> space, F func) {
-    std::size_t n = blockIdx.x * blockDim.x + threadIdx.x;
-    if (n < size(space)) {
-        func(ndindex(space, n));
+// Load W contiguous elements
+template<std::size_t W, Arithmetic T>
+MIST_HD constexpr pack_t<T, W> load(const T* ptr) {
+    pack_t<T, W> result{};
+    for (std::size_t i = 0; i < W; ++i) {
+        result._data[i] = ptr[i];
     }
+    return result;
 }
 
-// Map kernel for map_reduce
-template<std::size_t S, typename T, typename MapF>
-__global__ void map_kernel(index_space_t<S> space, MapF map, T* d_output) {
-    std::size_t n = blockIdx.x * blockDim.x + threadIdx.x;
-    if (n < size(space)) {
-        d_output[n] = map(ndindex(space, n));
+// Load the first count elements; remaining lanes are zero
+template<std::size_t W, Arithmetic T>
+MIST_HD constexpr pack_t<T, W> load(const T* ptr, std::size_t count) {
+    if (count == W) {
+        return load<W>(ptr);
+    }
+    pack_t<T, W> result{};
+    for (std::size_t i = 0; i < count; ++i) {
+        result._data[i] = ptr[i];
+    }
+    return result;
+}
+
+// Store W contiguous elements
+template<Arithmetic T, std::size_t W>
+MIST_HD constexpr void store(T* ptr, const pack_t<T, W>& p) {
+    for (std::size_t i = 0; i < W; ++i) {
+        ptr[i] = p._data[i];
     }
 }
-#endif
 
-template<std::size_t S, typename F>
-void for_each(const index_space_t<S>& space, F&& func, exec e) {
-    switch (e) {
-        case exec::cpu: {
-            for (std::size_t n = 0; n < size(space); ++n) {
-                func(ndindex(space, n));
-            }
-            break;
-        }
-        case exec::omp: {
-            #ifdef _OPENMP
-            #pragma omp parallel for
-            for (std::size_t n = 0; n < size(space); ++n) {
-                func(ndindex(space, n));
-            }
-            #else
-            throw std::runtime_error("unsupported exec::omp");
-            #endif
-            break;
-        }
-        case exec::gpu: {
-            #ifdef __CUDACC__
-            int blockSize = 256;
-            int numBlocks = (size(space) + blockSize - 1) / blockSize;
-            for_each_kernel<<<numBlocks, blockSize>>>(space, func);
-            #else
-            throw std::runtime_error("unsupported exec::gpu");
-            #endif
-            break;
-        }
+// Store the first count lanes
+template<Arithmetic T, std::size_t W>
+MIST_HD constexpr void store(T* ptr, const pack_t<T, W>& p, std::size_t count) {
+    if (count == W) {
+        store(ptr, p);
+        return;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        ptr[i] = p._data[i];
     }
 }
 
-// Default: CPU execution
-template<std::size_t S, typename F>
-void for_each(const index_space_t<S>& space, F&& func) {
-    for_each(space, std::forward<F>(func), exec::cpu);
+// Lane-wise binary operators (pack-pack, pack-scalar, scalar-pack)
+#define MIST_PACK_BINARY_OP(OP)                                                          \
+template<Arithmetic T, Arithmetic U, std::size_t W>                                      \
+MIST_HD constexpr auto operator OP(const pack_t<T, W>& a, const pack_t<U, W>& b) {       \
+    pack_t<decltype(std::declval<T>() OP std::declval<U>()), W> result{};                \
+    for (std::size_t i = 0; i < W; ++i) result._data[i] = a._data[i] OP b._data[i];      \
+    return result;                                                                       \
+}                                                                                        \
+template<Arithmetic T, Arithmetic U, std::size_t W>                                      \
+MIST_HD constexpr auto operator OP(const pack_t<T, W>& a, U b) {                         \
+    pack_t<decltype(std::declval<T>() OP std::declval<U>()), W> result{};                \
+    for (std::size_t i = 0; i < W; ++i) result._data[i] = a._data[i] OP b;               \
+    return result;                                                                       \
+}                                                                                        \
+template<Arithmetic T, Arithmetic U, std::size_t W>                                      \
+MIST_HD constexpr auto operator OP(T a, const pack_t<U, W>& b) {                         \
+    pack_t<decltype(std::declval<T>() OP std::declval<U>()), W> result{};                \
+    for (std::size_t i = 0; i < W; ++i) result._data[i] = a OP b._data[i];               \
+    return result;                                                                       \
+}
+
+MIST_PACK_BINARY_OP(+)
+MIST_PACK_BINARY_OP(-)
+MIST_PACK_BINARY_OP(*)
+MIST_PACK_BINARY_OP(/)
+
+#undef MIST_PACK_BINARY_OP
+
+template<Arithmetic T, std::size_t W>
+MIST_HD constexpr pack_t<T, W> operator-(const pack_t<T, W>& a) {
+    pack_t<T, W> result{};
+    for (std::size_t i = 0; i < W; ++i) {
+        result._data[i] = -a._data[i];
+    }
+    return result;
+}
+
+// Lane-wise function application
+template<Arithmetic T, std::size_t W, typename F>
+    requires UnaryFunction<F, T>
+constexpr auto map(const pack_t<T, W>& p, F&& func) {
+    using R = decltype(func(std::declval<T>()));
+    pack_t<R, W> result{};
+    for (std::size_t i = 0; i < W; ++i) {
+        result._data[i] = func(p._data[i]);
+    }
+    return result;
+}
+
+// Horizontal sum of all lanes
+template<Arithmetic T, std::size_t W>
+MIST_HD constexpr T sum(const pack_t<T, W>& p) {
+    T result{};
+    for (std::size_t i = 0; i < W; ++i) {
+        result += p._data[i];
+    }
+    return result;
 }
 
 // =============================================================================
-// Map-Reduce
+// batch_t: Contiguous run of indices along the innermost axis
 // =============================================================================
 
-template<std::size_t S, typename T, typename MapF, typename ReduceF>
-T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, exec e) {
-    switch (e) {
-        case exec::cpu: {
-            T result = init;
-            for (std::size_t n = 0; n < size(space); ++n) {
-                result = reduce_op(result, map(ndindex(space, n)));
-            }
-            return result;
-        }
-        case exec::omp: {
-            #ifdef _OPENMP
-            T global_result = init;
-
-            #pragma omp parallel
-            {
-                T local_result = init;
+// Lane l of a batch is the index _start with _start[S-1] + l in the innermost
+// axis. Only the first _count lanes (at most W) lie inside the index space.
+template<std::size_t S, std::size_t W>
+struct batch_t {
+    ivec_t<S> _start;
+    unsigned int _count;
+};
 
-                #pragma omp for nowait
-                for (std::size_t n = 0; n < size(space); ++n) {
-                    local_result = reduce_op(local_result, map(ndindex(space, n)));
-                }
+template<std::size_t S, std::size_t W>
+MIST_HD constexpr const ivec_t<S>& start(const batch_t<S, W>& b) {
+    return b._start;
+}
 
-                #pragma omp critical
-                {
-                    global_result = reduce_op(global_result, local_result);
-                }
-            }
+template<std::size_t S, std::size_t W>
+MIST_HD constexpr unsigned int count(const batch_t<S, W>& b) {
+    return b._count;
+}
 
-            return global_result;
-            #else
-            throw std::runtime_error("unsupported exec::omp");
-            #endif
-        }
-        case exec::gpu: {
-            #ifdef __CUDACC__
-            // Step 1: Map indices to values in device memory
-            std::size_t n = size(space);
-            T* d_mapped;
-            cudaMalloc(&d_mapped, n * sizeof(T));
-
-            // Launch map kernel
-            int blockSize = 256;
-            int numBlocks = (n + blockSize - 1) / blockSize;
-            map_kernel<<<numBlocks, blockSize>>>(space, map, d_mapped);
-            cudaDeviceSynchronize();
-
-            // Step 2: Use CUB to reduce the mapped values
-            T* d_result;
-            cudaMalloc(&d_result, sizeof(T));
-
-            void* d_temp_storage = nullptr;
-            std::size_t temp_storage_bytes = 0;
-
-            // Determine temporary storage requirements
-            cub::DeviceReduce::Reduce(
-                d_temp_storage, temp_storage_bytes,
-                d_mapped, d_result, n, reduce_op, init
-            );
-
-            // Allocate temporary storage
-            cudaMalloc(&d_temp_storage, temp_storage_bytes);
-
-            // Run reduction
-            cub::DeviceReduce::Reduce(
-                d_temp_storage, temp_storage_bytes,
-                d_mapped, d_result, n, reduce_op, init
-            );
-
-            // Copy result to host
-            T result;
-            cudaMemcpy(&result, d_result, sizeof(T), cudaMemcpyDeviceToHost);
-
-            // Cleanup
-            cudaFree(d_mapped);
-            cudaFree(d_result);
-            cudaFree(d_temp_storage);
+// Index of lane l
+template<std::size_t S, std::size_t W>
+MIST_HD constexpr ivec_t<S> lane_index(const batch_t<S, W>& b, std::size_t l) {
+    auto index = b._start;
+    index._data[S - 1] += static_cast<int>(l);
+    return index;
+}
 
-            return result;
-            #else
-            throw std::runtime_error("unsupported exec::gpu");
-            #endif
-        }
+// Innermost-axis coordinate of every lane
+template<std::size_t S, std::size_t W>
+MIST_HD constexpr pack_t<int, W> lane_coordinates(const batch_t<S, W>& b) {
+    pack_t<int, W> result{};
+    for (std::size_t l = 0; l < W; ++l) {
+        result._data[l] = b._start._data[S - 1] + static_cast<int>(l);
     }
+    return result;
 }
 
-// Default: CPU execution
-template<std::size_t S, typename T, typename MapF, typename ReduceF>
-T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op) {
-    return map_reduce(space, init, std::forward<MapF>(map), std::forward<ReduceF>(reduce_op), exec::cpu);
+// Read a batch of scalars from a row-major buffer (inactive lanes are zero)
+template<typename T, std::size_t S, std::size_t W>
+MIST_HD constexpr pack_t<T, W> ndread(const T* data, const index_space_t<S>& space, const batch_t<S, W>& b) {
+    return load<W>(data + ndoffset(space, b._start), b._count);
+}
+
+// Write the active lanes of a batch to a row-major buffer
+template<typename T, std::size_t S, std::size_t W>
+MIST_HD constexpr void ndwrite(T* data, const index_space_t<S>& space, const batch_t<S, W>& b, const pack_t<T, W>& value) {
+    store(data + ndoffset(space, b._start), value, b._count);
+}
+
+// =============================================================================
+// Executors
+// =============================================================================
+
+// How an executor divides [0, n) into chunks for its workers
+enum class chunking {
+    static_,    // chunks assigned to workers up front (OpenMP "static")
+    dynamic,    // fixed-size chunks claimed on demand
+    guided      // chunks claimed on demand, shrinking toward the grain size
+};
+
+// Which CPU each worker of a parallel backend is pinned to. On multi-socket
+// nodes, pinning keeps a worker next to the memory it first touched (see
+// first_touch in memory.hpp), so bandwidth scales across sockets.
+enum class affinity {
+    none,       // workers float, as scheduled by the OS
+    compact,    // fill the hardware threads of one core, then one socket, first
+    scatter,    // spread workers round-robin over sockets, then cores
+    list        // worker w runs on _cpus[w % _cpus.size()]
+};
+
+struct affinity_t {
+    affinity _policy = affinity::none;
+    std::vector<unsigned int> _cpus;  // for affinity::list
+};
+
+// "none", "compact", "scatter", or a comma-separated CPU list like "0,2,4,6"
+inline affinity_t parse_affinity(const std::string& str) {
+    if (str == "none") return {};
+    if (str == "compact") return {affinity::compact, {}};
+    if (str == "scatter") return {affinity::scatter, {}};
+
+    auto result = affinity_t{affinity::list, {}};
+    auto cpu = 0u;
+    auto digits = 0;
+
+    for (auto c : str + ",") {
+        if (c >= '0' && c <= '9' && digits < 6) {
+            cpu = 10 * cpu + static_cast<unsigned int>(c - '0');
+            ++digits;
+        } else if (c == ',' && digits > 0) {
+            result._cpus.push_back(cpu);
+            cpu = 0;
+            digits = 0;
+        } else {
+            throw std::runtime_error("affinity must be 'none', 'compact', 'scatter', or a list of CPUs like '0,2,4'");
+        }
+    }
+    return result;
+}
+
+// Serial execution on the calling thread
+struct cpu_t {};
+
+// OpenMP parallel region (requires compiling with -fopenmp)
+struct omp_t {
+    chunking _chunking = chunking::static_;
+    std::size_t _grain = 0;         // chunk size (0 = automatic)
+    unsigned int _num_threads = 0;  // worker count (0 = OpenMP default)
+    affinity_t _affinity = {};      // pinning, in place of OMP_PROC_BIND
+};
+
+// std::thread workers, spawned for each call
+struct threads_t {
+    chunking _chunking = chunking::static_;
+    std::size_t _grain = 0;         // chunk size (0 = automatic)
+    unsigned int _num_threads = 0;  // worker count (0 = hardware concurrency)
+    affinity_t _affinity = {};
+};
+
+// A persistent team of std::thread workers. The workers are started once
+// and park between parallel regions; each execute() wakes them with an
+// atomic flag and joins them at a spinning barrier, which is far cheaper
+// than spawning threads. Regions started from inside a region run
+// serially on the calling worker. The calling thread is worker 0.
+struct team_t {
+    chunking _chunking = chunking::static_;
+    std::size_t _grain = 0;
+    std::vector<std::thread> _threads;
+
+    mutable std::atomic<std::uint64_t> _generation{0};
+    mutable std::atomic<std::size_t> _pending{0};
+    mutable std::atomic<bool> _stop{false};
+    mutable std::mutex _mutex;
+    mutable void* _job = nullptr;
+    mutable void (*_run)(void*, std::size_t) = nullptr;
+    mutable std::vector<std::exception_ptr> _errors;
+
+    affinity_t _affinity;
+
+    explicit team_t(unsigned int num_threads = 0, affinity_t affinity = {});  // 0 = hardware concurrency
+    ~team_t();
+    team_t(const team_t&) = delete;
+    team_t& operator=(const team_t&) = delete;
+};
+
+// CUDA kernel launch
+struct gpu_t {
+    unsigned int _block_size = 256;
+};
+
+// An executor invokes body(first, last, worker) for a set of chunks covering
+// [0, n) exactly once, where worker < num_workers(e) identifies the calling
+// worker. Chunks handed to the same worker never run concurrently, so the
+// worker id may be used to index per-worker storage. User types model the
+// concept by providing these two free functions (found by ADL).
+template<typename E>
+concept Executor = requires(const E& e, std::size_t n, void (*body)(std::size_t, std::size_t, std::size_t)) {
+    { num_workers(e) } -> std::convertible_to<std::size_t>;
+    execute(e, n, body);
+};
+
+// Serial executor
+inline std::size_t num_workers(const cpu_t&) {
+    return 1;
+}
+
+template<typename F>
+void execute(const cpu_t&, std::size_t n, F&& body) {
+    if (n > 0) {
+        body(std::size_t(0), n, std::size_t(0));
+    }
+}
+
+// OpenMP executor
+inline std::size_t num_workers(const omp_t& e) {
+    #ifdef _OPENMP
+    return e._num_threads > 0 ? e._num_threads : static_cast<std::size_t>(omp_get_max_threads());
+    #else
+    return e._num_threads > 0 ? e._num_threads : 1;
+    #endif
+}
+
+namespace detail {
+    // Chunk size used when an executor's grain is left at zero
+    inline std::size_t default_grain(chunking c, std::size_t n, std::size_t workers) {
+        switch (c) {
+            case chunking::static_: return std::max<std::size_t>(1, (n + workers - 1) / workers);
+            case chunking::dynamic: return std::max<std::size_t>(1, n / (8 * workers));
+            case chunking::guided:  return 1;
+        }
+        return 1;
+    }
+
+    struct cpu_info_t {
+        unsigned int _cpu;
+        unsigned int _package;  // socket
+        unsigned int _core;     // core id within the package
+        unsigned int _thread;   // hardware thread rank within the core
+    };
+
+    // The CPUs this process may run on, with their place in the machine
+    inline std::vector<cpu_info_t> cpu_topology() {
+        auto cpus = std::vector<cpu_info_t>{};
+        #ifdef __linux__
+        auto read_id = [](unsigned int cpu, const char* name, unsigned int fallback) {
+            auto path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name;
+            auto file = std::ifstream(path);
+            auto id = fallback;
+            return file >> id ? id : fallback;
+        };
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        sched_getaffinity(0, sizeof(allowed), &allowed);
+
+        for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back({cpu, read_id(cpu, "physical_package_id", 0), read_id(cpu, "core_id", cpu), 0});
+            }
+        }
+        #endif
+        if (cpus.empty()) {
+            for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                cpus.push_back({cpu, 0, cpu, 0});
+            }
+        }
+        for (std::size_t i = 0; i < cpus.size(); ++i) {
+            for (std::size_t j = 0; j < i; ++j) {
+                if (cpus[j]._package == cpus[i]._package && cpus[j]._core == cpus[i]._core) {
+                    ++cpus[i]._thread;
+                }
+            }
+        }
+        return cpus;
+    }
+
+    // The CPUs in the order workers are placed on them by a policy
+    inline std::vector<unsigned int> cpu_order(affinity policy) {
+        auto cpus = cpu_topology();
+        auto compact = [](const cpu_info_t& a, const cpu_info_t& b) {
+            return std::tie(a._package, a._core, a._thread) < std::tie(b._package, b._core, b._thread);
+        };
+        std::sort(cpus.begin(), cpus.end(), compact);
+
+        if (policy == affinity::scatter) {
+            // Rank each CPU among those of its package with its thread rank,
+            // then deal ranks out across packages
+            auto rank = std::vector<unsigned int>(cpus.size());
+            for (std::size_t i = 0; i < cpus.size(); ++i) {
+                for (std::size_t j = 0; j < i; ++j) {
+                    if (cpus[j]._package == cpus[i]._package && cpus[j]._thread == cpus[i]._thread) {
+                        ++rank[i];
+                    }
+                }
+                cpus[i]._core = rank[i];
+            }
+            std::sort(cpus.begin(), cpus.end(), [](const cpu_info_t& a, const cpu_info_t& b) {
+                return std::tie(a._thread, a._core, a._package) < std::tie(b._thread, b._core, b._package);
+            });
+        }
+        auto order = std::vector<unsigned int>{};
+        for (const auto& c : cpus) {
+            order.push_back(c._cpu);
+        }
+        return order;
+    }
+
+    // CPU for a worker under an affinity, or -1 to leave it unpinned
+    inline int affinity_cpu(const affinity_t& a, std::size_t worker) {
+        switch (a._policy) {
+            case affinity::none: return -1;
+            case affinity::compact: {
+                static const auto order = cpu_order(affinity::compact);
+                return static_cast<int>(order[worker % order.size()]);
+            }
+            case affinity::scatter: {
+                static const auto order = cpu_order(affinity::scatter);
+                return static_cast<int>(order[worker % order.size()]);
+            }
+            case affinity::list: {
+                if (a._cpus.empty()) return -1;
+                return static_cast<int>(a._cpus[worker % a._cpus.size()]);
+            }
+        }
+        return -1;
+    }
+
+    // The CPUs an affinity gives workers first, ..., first + count - 1, as a
+    // list, so two sets of workers can be placed side by side
+    inline affinity_t affinity_slice(const affinity_t& a, std::size_t first, std::size_t count) {
+        if (affinity_cpu(a, 0) < 0) return a;
+        auto slice = affinity_t{affinity::list, {}};
+        for (std::size_t w = first; w < first + count; ++w) {
+            slice._cpus.push_back(static_cast<unsigned int>(affinity_cpu(a, w)));
+        }
+        return slice;
+    }
+
+    // CPU the calling thread was last pinned to, or -1
+    inline int& pinned_cpu() {
+        thread_local int pinned = -1;
+        return pinned;
+    }
+
+    // Pin the calling thread to a CPU (best effort; a no-op for cpu < 0 and
+    // off Linux). Repeated requests for the same CPU cost nothing.
+    inline void pin_thread(int cpu) {
+        if (cpu < 0 || cpu == pinned_cpu()) return;
+        #ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<unsigned int>(cpu), &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            pinned_cpu() = cpu;
+        }
+        #endif
+    }
+
+    // Pin a thread no executor owns (a caller, which runs as worker 0) for
+    // a scope, such as a whole team_scope_t, and give it back its own CPU
+    // mask afterwards. A thread that is already pinned keeps its CPU.
+    struct caller_pin_t {
+        #ifdef __linux__
+        cpu_set_t _saved;
+        #endif
+        bool _restore = false;
+
+        explicit caller_pin_t(int cpu) {
+            if (cpu < 0 || pinned_cpu() >= 0) return;
+            #ifdef __linux__
+            if (pthread_getaffinity_np(pthread_self(), sizeof(_saved), &_saved) != 0) return;
+            pin_thread(cpu);
+            _restore = pinned_cpu() == cpu;
+            #endif
+        }
+        ~caller_pin_t() {
+            #ifdef __linux__
+            if (!_restore) return;
+            pthread_setaffinity_np(pthread_self(), sizeof(_saved), &_saved);
+            pinned_cpu() = -1;
+            #endif
+        }
+        caller_pin_t(const caller_pin_t&) = delete;
+        caller_pin_t& operator=(const caller_pin_t&) = delete;
+    };
+}
+
+template<typename F>
+void execute(const omp_t& e, std::size_t n, F&& body) {
+    #ifdef _OPENMP
+    if (n == 0) return;
+    auto workers = num_workers(e);
+    auto grain = e._grain > 0 ? e._grain : detail::default_grain(e._chunking, n, workers);
+    auto chunks = static_cast<std::int64_t>((n + grain - 1) / grain);
+
+    #pragma omp parallel num_threads(static_cast<int>(workers))
+    {
+        auto worker = static_cast<std::size_t>(omp_get_thread_num());
+        if (worker != 0) detail::pin_thread(detail::affinity_cpu(e._affinity, worker));
+        auto run = [&](std::int64_t c) {
+            auto first = static_cast<std::size_t>(c) * grain;
+            body(first, std::min(n, first + grain), worker);
+        };
+        switch (e._chunking) {
+            case chunking::static_: {
+                #pragma omp for schedule(static, 1)
+                for (std::int64_t c = 0; c < chunks; ++c) run(c);
+                break;
+            }
+            case chunking::dynamic: {
+                #pragma omp for schedule(dynamic, 1)
+                for (std::int64_t c = 0; c < chunks; ++c) run(c);
+                break;
+            }
+            case chunking::guided: {
+                #pragma omp for schedule(guided, 1)
+                for (std::int64_t c = 0; c < chunks; ++c) run(c);
+                break;
+            }
+        }
+    }
+    #else
+    (void)e; (void)n; (void)body;
+    throw std::runtime_error("unsupported exec::omp");
+    #endif
+}
+
+// Persistent team executor
+inline std::size_t num_workers(const team_t& e) {
+    return e._threads.size() + 1;
+}
+
+namespace detail {
+    inline const team_t*& current_team() {
+        thread_local const team_t* team = nullptr;
+        return team;
+    }
+
+    // A threads_t executor runs on the current team (see team_scope_t) if
+    // there is one and it does not ask for a different number of threads
+    inline bool delegates_to_team(const threads_t& e) {
+        auto team = current_team();
+        return team && (e._num_threads == 0 || e._num_threads == num_workers(*team));
+    }
+}
+
+// std::thread executor
+inline std::size_t num_workers(const threads_t& e) {
+    if (detail::delegates_to_team(e)) return num_workers(*detail::current_team());
+    if (e._num_threads > 0) return e._num_threads;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+namespace detail {
+    // Run worker's share of the chunks of [0, n) under a chunking policy;
+    // next is the shared cursor for dynamic and guided chunking
+    template<typename F>
+    void run_chunks(chunking c, std::size_t grain, std::size_t n, std::size_t workers, std::atomic<std::size_t>& next, std::size_t worker, F& body) {
+        switch (c) {
+            case chunking::static_: {
+                for (auto first = worker * grain; first < n; first += workers * grain) {
+                    body(first, std::min(n, first + grain), worker);
+                }
+                break;
+            }
+            case chunking::dynamic: {
+                for (auto first = next.fetch_add(grain); first < n; first = next.fetch_add(grain)) {
+                    body(first, std::min(n, first + grain), worker);
+                }
+                break;
+            }
+            case chunking::guided: {
+                auto first = next.load();
+                while (first < n) {
+                    auto count = std::max(grain, (n - first) / (2 * workers));
+                    auto last = std::min(n, first + count);
+                    if (next.compare_exchange_weak(first, last)) {
+                        body(first, last, worker);
+                        first = last;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    template<typename F>
+    void execute_on_team(const team_t& team, chunking c, std::size_t grain, std::size_t n, F& body);
+}
+
+template<typename F>
+void execute(const threads_t& e, std::size_t n, F&& body) {
+    if (n == 0) return;
+    if (detail::delegates_to_team(e)) {
+        detail::execute_on_team(*detail::current_team(), e._chunking, e._grain, n, body);
+        return;
+    }
+    auto workers = num_workers(e);
+    auto grain = e._grain > 0 ? e._grain : detail::default_grain(e._chunking, n, workers);
+    auto next = std::atomic<std::size_t>(0);
+
+    auto errors = std::vector<std::exception_ptr>(workers);
+    auto guarded = [&](std::size_t worker) {
+        if (worker != 0) detail::pin_thread(detail::affinity_cpu(e._affinity, worker));
+        try {
+            detail::run_chunks(e._chunking, grain, n, workers, next, worker, body);
+        } catch (...) {
+            errors[worker] = std::current_exception();
+        }
+    };
+    auto pool = std::vector<std::thread>();
+    pool.reserve(workers - 1);
+
+    for (std::size_t w = 1; w < workers; ++w) {
+        pool.emplace_back(guarded, w);
+    }
+    guarded(0);
+
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    for (auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+namespace detail {
+    // Spin briefly on an atomic before blocking in wait(), so that back to
+    // back parallel regions hand off in well under a microsecond
+    template<typename T>
+    void spin_wait(const std::atomic<T>& value, T old) {
+        for (int spin = 0; spin < 4096; ++spin) {
+            if (value.load(std::memory_order_acquire) != old) return;
+        }
+        value.wait(old, std::memory_order_acquire);
+    }
+
+    inline bool& in_team_region() {
+        thread_local bool inside = false;
+        return inside;
+    }
+
+    inline void team_worker(const team_t& team, std::size_t worker) {
+        auto seen = std::uint64_t(0);
+        in_team_region() = true;
+        pin_thread(affinity_cpu(team._affinity, worker));
+        while (true) {
+            spin_wait(team._generation, seen);
+            seen = team._generation.load(std::memory_order_acquire);
+
+            if (team._stop.load(std::memory_order_acquire)) {
+                return;
+            }
+            try {
+                team._run(team._job, worker);
+            } catch (...) {
+                team._errors[worker] = std::current_exception();
+            }
+            if (team._pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                team._pending.notify_one();
+            }
+        }
+    }
+
+    template<typename F>
+    void execute_on_team(const team_t& team, chunking c, std::size_t grain, std::size_t n, F& body) {
+        auto workers = num_workers(team);
+        grain = grain > 0 ? grain : default_grain(c, n, workers);
+
+        // Nested regions, and teams without workers, run on the calling thread
+        if (workers == 1 || in_team_region()) {
+            body(std::size_t(0), n, std::size_t(0));
+            return;
+        }
+        auto lock = std::lock_guard<std::mutex>(team._mutex);
+        auto next = std::atomic<std::size_t>(0);
+        auto job = [&](std::size_t worker) {
+            run_chunks(c, grain, n, workers, next, worker, body);
+        };
+        using job_t = decltype(job);
+
+        team._job = &job;
+        team._run = [](void* j, std::size_t worker) { (*static_cast<job_t*>(j))(worker); };
+        std::fill(team._errors.begin(), team._errors.end(), nullptr);
+        team._pending.store(workers - 1, std::memory_order_relaxed);
+        team._generation.fetch_add(1, std::memory_order_release);
+        team._generation.notify_all();
+
+        in_team_region() = true;
+        try {
+            job(0);
+        } catch (...) {
+            team._errors[0] = std::current_exception();
+        }
+        in_team_region() = false;
+
+        for (auto p = team._pending.load(std::memory_order_acquire); p != 0; p = team._pending.load(std::memory_order_acquire)) {
+            spin_wait(team._pending, p);
+        }
+        for (auto& error : team._errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+}
+
+inline team_t::team_t(unsigned int num_threads, affinity_t affinity) : _affinity(std::move(affinity)) {
+    auto workers = num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+    _errors.resize(workers);
+    for (std::size_t w = 1; w < workers; ++w) {
+        _threads.emplace_back(detail::team_worker, std::cref(*this), w);
+    }
+}
+
+inline team_t::~team_t() {
+    _stop.store(true, std::memory_order_release);
+    _generation.fetch_add(1, std::memory_order_release);
+    _generation.notify_all();
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+template<typename F>
+void execute(const team_t& e, std::size_t n, F&& body) {
+    if (n == 0) return;
+    detail::execute_on_team(e, e._chunking, e._grain, n, body);
+}
+
+// Route threads_t executors on this thread to a team for the scope's
+// lifetime, e.g. around each step of a simulation. The thread, worker 0 of
+// the team's regions, is pinned to the team's first CPU for the scope
+// (unless it is pinned already) rather than on every region.
+struct team_scope_t {
+    const team_t* _previous;
+    detail::caller_pin_t _pin;
+
+    explicit team_scope_t(const team_t& team) : _previous(detail::current_team()), _pin(detail::affinity_cpu(team._affinity, 0)) {
+        detail::current_team() = &team;
+    }
+    ~team_scope_t() {
+        detail::current_team() = _previous;
+    }
+    team_scope_t(const team_scope_t&) = delete;
+    team_scope_t& operator=(const team_scope_t&) = delete;
+};
+
+// =============================================================================
+// Runtime execution policy (for config-driven selection)
+// =============================================================================
+
+enum class exec {
+    cpu,
+    omp,
+    gpu,
+    threads
+};
+
+inline exec parse_exec(const std::string& str) {
+    if (str == "cpu") return exec::cpu;
+    if (str == "omp") return exec::omp;
+    if (str == "gpu") return exec::gpu;
+    if (str == "threads") return exec::threads;
+    throw std::runtime_error("exec must be 'cpu', 'omp', 'gpu', or 'threads'");
+}
+
+// =============================================================================
+// Parallel index space traversals
+// =============================================================================
+
+#ifdef __CUDACC__
+template<std::size_t S, typename F>
+__global__ void for_each_kernel(index_space_t<S> space, F func) {
+    std::size_t n = blockIdx.x * blockDim.x + threadIdx.x;
+    if (n < size(space)) {
+        func(ndindex(space, n));
+    }
+}
+
+// Map kernel for map_reduce
+template<std::size_t S, typename T, typename MapF>
+__global__ void map_kernel(index_space_t<S> space, MapF map, T* d_output) {
+    std::size_t n = blockIdx.x * blockDim.x + threadIdx.x;
+    if (n < size(space)) {
+        d_output[n] = map(ndindex(space, n));
+    }
+}
+#endif
+
+template<std::size_t S, typename F, Executor E>
+void for_each(const index_space_t<S>& space, F&& func, const E& e) {
+    execute(e, size(space), [&func, &space](std::size_t first, std::size_t last, std::size_t) {
+        for (std::size_t n = first; n < last; ++n) {
+            func(ndindex(space, n));
+        }
+    });
+}
+
+template<std::size_t S, typename F>
+void for_each(const index_space_t<S>& space, F&& func, const gpu_t& e) {
+    #ifdef __CUDACC__
+    int blockSize = e._block_size;
+    int numBlocks = (size(space) + blockSize - 1) / blockSize;
+    for_each_kernel<<<numBlocks, blockSize>>>(space, func);
+    #else
+    (void)space; (void)func; (void)e;
+    throw std::runtime_error("unsupported exec::gpu");
+    #endif
+}
+
+template<std::size_t S, typename F>
+void for_each(const index_space_t<S>& space, F&& func, exec e) {
+    switch (e) {
+        case exec::cpu: for_each(space, func, cpu_t{}); break;
+        case exec::omp: for_each(space, func, omp_t{}); break;
+        case exec::gpu: for_each(space, func, gpu_t{}); break;
+        case exec::threads: for_each(space, func, threads_t{}); break;
+    }
+}
+
+// Default: CPU execution
+template<std::size_t S, typename F>
+void for_each(const index_space_t<S>& space, F&& func) {
+    for_each(space, std::forward<F>(func), cpu_t{});
+}
+
+// =============================================================================
+// Map-Reduce
+// =============================================================================
+
+template<std::size_t S, typename T, typename MapF, typename ReduceF, Executor E>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, const E& e) {
+    // Per-worker partial results are seeded from the first mapped value, so
+    // init enters the reduction exactly once, as in serial execution
+    auto partial = std::vector<std::optional<T>>(num_workers(e));
+
+    execute(e, size(space), [&](std::size_t first, std::size_t last, std::size_t worker) {
+        std::size_t n = first;
+        T local = partial[worker] ? *partial[worker] : T(map(ndindex(space, n++)));
+        for (; n < last; ++n) {
+            local = reduce_op(local, map(ndindex(space, n)));
+        }
+        partial[worker] = local;
+    });
+
+    T result = init;
+    for (const auto& p : partial) {
+        if (p) result = reduce_op(result, *p);
+    }
+    return result;
+}
+
+template<std::size_t S, typename T, typename MapF, typename ReduceF>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, const gpu_t& e) {
+    #ifdef __CUDACC__
+    // Step 1: Map indices to values in device memory
+    std::size_t n = size(space);
+    T* d_mapped;
+    cudaMalloc(&d_mapped, n * sizeof(T));
+
+    // Launch map kernel
+    int blockSize = e._block_size;
+    int numBlocks = (n + blockSize - 1) / blockSize;
+    map_kernel<<<numBlocks, blockSize>>>(space, map, d_mapped);
+    cudaDeviceSynchronize();
+
+    // Step 2: Use CUB to reduce the mapped values
+    T* d_result;
+    cudaMalloc(&d_result, sizeof(T));
+
+    void* d_temp_storage = nullptr;
+    std::size_t temp_storage_bytes = 0;
+
+    // Determine temporary storage requirements
+    cub::DeviceReduce::Reduce(
+        d_temp_storage, temp_storage_bytes,
+        d_mapped, d_result, n, reduce_op, init
+    );
+
+    // Allocate temporary storage
+    cudaMalloc(&d_temp_storage, temp_storage_bytes);
+
+    // Run reduction
+    cub::DeviceReduce::Reduce(
+        d_temp_storage, temp_storage_bytes,
+        d_mapped, d_result, n, reduce_op, init
+    );
+
+    // Copy result to host
+    T result;
+    cudaMemcpy(&result, d_result, sizeof(T), cudaMemcpyDeviceToHost);
+
+    // Cleanup
+    cudaFree(d_mapped);
+    cudaFree(d_result);
+    cudaFree(d_temp_storage);
+
+    return result;
+    #else
+    (void)space; (void)init; (void)map; (void)reduce_op; (void)e;
+    throw std::runtime_error("unsupported exec::gpu");
+    #endif
+}
+
+template<std::size_t S, typename T, typename MapF, typename ReduceF>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, exec e) {
+    switch (e) {
+        case exec::cpu: return map_reduce(space, init, map, reduce_op, cpu_t{});
+        case exec::omp: return map_reduce(space, init, map, reduce_op, omp_t{});
+        case exec::gpu: return map_reduce(space, init, map, reduce_op, gpu_t{});
+        case exec::threads: return map_reduce(space, init, map, reduce_op, threads_t{});
+    }
+    return init;
+}
+
+// Default: CPU execution
+template<std::size_t S, typename T, typename MapF, typename ReduceF>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op) {
+    return map_reduce(space, init, std::forward<MapF>(map), std::forward<ReduceF>(reduce_op), cpu_t{});
+}
+
+// =============================================================================
+// Multi-patch traversals
+// =============================================================================
+
+// The index space of itself, so that a collection of index spaces is a
+// collection of patches
+template<std::size_t S>
+MIST_HD constexpr const index_space_t<S>& domain(const index_space_t<S>& space) {
+    return space;
+}
+
+// A patch is anything with an index space domain(p), such as an array view,
+// carrying whatever data a kernel needs on that space
+template<typename P>
+concept Patch = requires(const P& p) {
+    { size(domain(p)) } -> std::convertible_to<std::size_t>;
+    { ndindex(domain(p), std::size_t(0)) };
+};
+
+template<typename R>
+concept PatchRange = std::ranges::random_access_range<const R> && Patch<std::ranges::range_value_t<R>>;
+
+namespace detail {
+    // Offsets of each patch's first zone in the concatenation of all zones
+    template<typename R>
+    std::vector<std::size_t> patch_offsets(const R& patches) {
+        auto offsets = std::vector<std::size_t>{0};
+        for (const auto& p : patches) {
+            offsets.push_back(offsets.back() + size(domain(p)));
+        }
+        return offsets;
+    }
+
+    // Call func(p, index) on zones [first, last) of the concatenation
+    template<typename R, typename F>
+    void for_each_patch_zone(const R& patches, const std::vector<std::size_t>& offsets, std::size_t first, std::size_t last, F&& func) {
+        auto k = static_cast<std::size_t>(std::upper_bound(offsets.begin(), offsets.end(), first) - offsets.begin() - 1);
+        auto n = first;
+        while (n < last) {
+            const auto& p = std::ranges::begin(patches)[k];
+            const auto& space = domain(p);
+            auto end = std::min(last, offsets[k + 1]);
+            for (; n < end; ++n) {
+                func(p, ndindex(space, n - offsets[k]));
+            }
+            ++k;
+        }
+    }
+}
+
+// Call func(p, index) for every index of every patch p, in a single parallel
+// region. The zones of all patches are concatenated and chunked by the
+// executor as one range, so work is balanced by zone count however the
+// patches differ in size, and small patches share a chunk.
+template<PatchRange R, typename F, Executor E>
+void for_each(const R& patches, F&& func, const E& e) {
+    auto offsets = detail::patch_offsets(patches);
+    execute(e, offsets.back(), [&](std::size_t first, std::size_t last, std::size_t) {
+        detail::for_each_patch_zone(patches, offsets, first, last, func);
+    });
+}
+
+template<PatchRange R, typename F>
+void for_each(const R& patches, F&& func) {
+    for_each(patches, std::forward<F>(func), cpu_t{});
+}
+
+// Reduce map(p, index) over every index of every patch, in a single
+// parallel region
+template<PatchRange R, typename T, typename MapF, typename ReduceF, Executor E>
+T map_reduce(const R& patches, T init, MapF&& map, ReduceF&& reduce_op, const E& e) {
+    auto offsets = detail::patch_offsets(patches);
+    auto partial = std::vector<std::optional<T>>(num_workers(e));
+
+    execute(e, offsets.back(), [&](std::size_t first, std::size_t last, std::size_t worker) {
+        auto local = partial[worker];
+        detail::for_each_patch_zone(patches, offsets, first, last, [&](const auto& p, const auto& index) {
+            local = local ? T(reduce_op(*local, map(p, index))) : T(map(p, index));
+        });
+        partial[worker] = local;
+    });
+
+    T result = init;
+    for (const auto& p : partial) {
+        if (p) result = reduce_op(result, *p);
+    }
+    return result;
+}
+
+template<PatchRange R, typename T, typename MapF, typename ReduceF>
+T map_reduce(const R& patches, T init, MapF&& map, ReduceF&& reduce_op) {
+    return map_reduce(patches, init, std::forward<MapF>(map), std::forward<ReduceF>(reduce_op), cpu_t{});
+}
+
+// =============================================================================
+// Workspace traversals
+// =============================================================================
+
+// A per-thread scratch buffer of _size elements of T, declared by a kernel
+// that needs room for a pencil, a small matrix, or similar
+template<typename T>
+struct workspace_t {
+    std::size_t _size;
+};
+
+template<typename T>
+constexpr workspace_t<T> workspace(std::size_t size) {
+    return workspace_t<T>{size};
+}
+
+namespace detail {
+    // This thread's workspace buffers of T, one per nesting depth, so a
+    // kernel may itself run a traversal that declares a workspace. Buffers
+    // are allocated (and first touched) by the thread that uses them, and
+    // live as long as it does.
+    template<typename T>
+    struct workspace_stack_t {
+        std::vector<std::vector<T>> _buffers;
+        std::size_t _depth = 0;
+    };
+
+    template<typename T>
+    workspace_stack_t<T>& workspace_stack() {
+        thread_local workspace_stack_t<T> stack;
+        return stack;
+    }
+
+    // Holds this thread's buffer at the current depth for a scope
+    template<typename T>
+    struct workspace_lease_t {
+        std::span<T> _span;
+
+        explicit workspace_lease_t(std::size_t size) {
+            auto& stack = workspace_stack<T>();
+            if (stack._buffers.size() == stack._depth) {
+                stack._buffers.emplace_back();
+            }
+            auto& buffer = stack._buffers[stack._depth];
+            if (buffer.size() < size) {
+                buffer.resize(size);
+            }
+            _span = std::span<T>(buffer.data(), size);
+            ++stack._depth;
+        }
+        ~workspace_lease_t() {
+            --workspace_stack<T>()._depth;
+        }
+        workspace_lease_t(const workspace_lease_t&) = delete;
+        workspace_lease_t& operator=(const workspace_lease_t&) = delete;
+    };
+}
+
+// Call func(index, ws) for every index of space, where ws is a std::span<T>
+// of w._size elements belonging to the calling thread. Each thread's buffer
+// is allocated on its first use and reused by later traversals on that
+// thread, so kernels need neither allocate nor index arrays by worker.
+// Reuse across calls therefore needs threads that outlive them: cpu_t, omp_t
+// and team_t (or threads_t on a team scope); a threads_t without a team
+// starts fresh threads, and so fresh buffers, on every call. Contents
+// persist between calls on the same thread and are not initialized per
+// index.
+template<std::size_t S, typename T, typename F, Executor E>
+void for_each(const index_space_t<S>& space, workspace_t<T> w, F&& func, const E& e) {
+    execute(e, size(space), [&func, &space, w](std::size_t first, std::size_t last, std::size_t) {
+        auto lease = detail::workspace_lease_t<T>(w._size);
+        for (std::size_t n = first; n < last; ++n) {
+            func(ndindex(space, n), lease._span);
+        }
+    });
+}
+
+template<std::size_t S, typename T, typename F>
+void for_each(const index_space_t<S>& space, workspace_t<T> w, F&& func) {
+    for_each(space, w, std::forward<F>(func), cpu_t{});
+}
+
+// =============================================================================
+// SIMD traversals
+// =============================================================================
+
+// Hands kernels batches of up to W contiguous indices along the innermost
+// axis. Batches are distributed over the workers of the inner executor.
+template<std::size_t W, typename E = cpu_t>
+    requires (W > 0) && Executor<E>
+struct simd_t {
+    E _inner{};
+};
+
+namespace detail {
+    template<std::size_t W, std::size_t S>
+    std::size_t batches_per_row(const index_space_t<S>& space) {
+        return (space._shape._data[S - 1] + W - 1) / W;
+    }
+
+    template<std::size_t W, std::size_t S>
+    batch_t<S, W> make_batch(const index_space_t<S>& space, std::size_t per_row, std::size_t n) {
+        auto row_length = space._shape._data[S - 1];
+        auto row = n / per_row;
+        auto lane0 = static_cast<unsigned int>((n % per_row) * W);
+        return batch_t<S, W>{ndindex(space, row * row_length + lane0), std::min<unsigned int>(W, row_length - lane0)};
+    }
+}
+
+template<std::size_t S, typename F, std::size_t W, typename E>
+void for_each(const index_space_t<S>& space, F&& func, const simd_t<W, E>& e) {
+    if (size(space) == 0) return;
+    auto per_row = detail::batches_per_row<W>(space);
+    auto rows = size(space) / space._shape._data[S - 1];
+
+    execute(e._inner, rows * per_row, [&](std::size_t first, std::size_t last, std::size_t) {
+        for (std::size_t n = first; n < last; ++n) {
+            func(detail::make_batch<W>(space, per_row, n));
+        }
+    });
+}
+
+// The map function returns a pack_t<T, W>; its active lanes are reduced in order
+template<std::size_t S, typename T, typename MapF, typename ReduceF, std::size_t W, typename E>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, const simd_t<W, E>& e) {
+    if (size(space) == 0) return init;
+    auto per_row = detail::batches_per_row<W>(space);
+    auto rows = size(space) / space._shape._data[S - 1];
+    auto partial = std::vector<std::optional<T>>(num_workers(e._inner));
+
+    execute(e._inner, rows * per_row, [&](std::size_t first, std::size_t last, std::size_t worker) {
+        auto local = partial[worker];
+        for (std::size_t n = first; n < last; ++n) {
+            auto b = detail::make_batch<W>(space, per_row, n);
+            auto p = map(b);
+            for (std::size_t l = 0; l < b._count; ++l) {
+                local = local ? T(reduce_op(*local, p._data[l])) : T(p._data[l]);
+            }
+        }
+        partial[worker] = local;
+    });
+
+    T result = init;
+    for (const auto& p : partial) {
+        if (p) result = reduce_op(result, *p);
+    }
+    return result;
+}
+
+// =============================================================================
+// Storage-order traversals
+// =============================================================================
+
+// Visit the indices of space in the storage order of a layout. Workers are
+// handed contiguous ranges of storage, so each touches its own memory.
+template<std::size_t S, typename F, typename E>
+void for_each(row_major_t, const index_space_t<S>& space, F&& func, const E& e) {
+    for_each(space, std::forward<F>(func), e);
+}
+
+template<unsigned int L, std::size_t S, typename F, typename E>
+void for_each(padded_t<L>, const index_space_t<S>& space, F&& func, const E& e) {
+    for_each(space, std::forward<F>(func), e);
+}
+
+template<unsigned int B, std::size_t S, typename F, Executor E>
+void for_each(bricked_t<B>, const index_space_t<S>& space, F&& func, const E& e) {
+    static_assert(B > 0, "bricks must have a positive edge length");
+    auto brick_shape = uvec_t<S>{};
+    for (std::size_t i = 0; i < S; ++i) {
+        brick_shape._data[i] = B;
+    }
+    execute(e, tile_count(space, brick_shape), [&](std::size_t first, std::size_t last, std::size_t) {
+        for (std::size_t n = first; n < last; ++n) {
+            auto brick = tile_at(space, brick_shape, n);
+            for (std::size_t m = 0; m < size(brick); ++m) {
+                func(ndindex(brick, m));
+            }
+        }
+    });
+}
+
+template<Layout L, std::size_t S, typename F>
+void for_each(L layout, const index_space_t<S>& space, F&& func) {
+    for_each(layout, space, std::forward<F>(func), cpu_t{});
+}
+
+// =============================================================================
+// Space-filling-curve traversals
+// =============================================================================
+
+// Visit indices in Morton (Z-order) or Hilbert order, rather than row-major
+// order. The curve runs over the smallest power-of-two box enclosing the
+// space, skipping indices outside it. The inner executor partitions the
+// indices by their rank along the curve, so every chunk is a contiguous,
+// compact run of the curve, whatever the number of workers.
+template<typename E = cpu_t>
+    requires Executor<E>
+struct morton_t {
+    E _inner{};
+};
+
+template<typename E = cpu_t>
+    requires Executor<E>
+struct hilbert_t {
+    E _inner{};
+};
+
+namespace detail {
+    // Rotate the low S bits of x left by k
+    template<std::size_t S>
+    constexpr unsigned int rotl_bits(unsigned int x, unsigned int k) {
+        constexpr auto n = static_cast<unsigned int>(S);
+        constexpr auto mask = (1u << n) - 1;
+        k %= n;
+        return k == 0 ? x : ((x << k) | (x >> (n - k))) & mask;
+    }
+
+    constexpr unsigned int gray_code(unsigned int i) {
+        return i ^ (i >> 1);
+    }
+
+    constexpr unsigned int trailing_set_bits(unsigned int i) {
+        unsigned int count = 0;
+        while (i & 1) { i >>= 1; ++count; }
+        return count;
+    }
+
+    // Hilbert curve state of Hamilton (2006): entry corner and direction
+    struct hilbert_state_t {
+        unsigned int _entry;
+        unsigned int _dir;
+    };
+
+    // Corner of child w (bit a = upper half along axis a), and the child's state
+    template<std::size_t S>
+    constexpr std::pair<unsigned int, hilbert_state_t> hilbert_child(hilbert_state_t st, unsigned int w) {
+        constexpr auto n = static_cast<unsigned int>(S);
+        auto corner = rotl_bits<S>(gray_code(w), st._dir + 1) ^ st._entry;
+        auto entry = w == 0 ? 0u : gray_code(2 * ((w - 1) / 2));
+        auto dir = w == 0 ? 0u : (w % 2 == 0 ? trailing_set_bits(w - 1) : trailing_set_bits(w)) % n;
+        auto child = hilbert_state_t{st._entry ^ rotl_bits<S>(entry, st._dir + 1), (st._dir + dir + 1) % n};
+        return {corner, child};
+    }
+
+    // Number of indices of a shape-sized box at the origin inside the cube
+    // [lo, lo + side) along every axis
+    template<std::size_t S>
+    constexpr std::size_t cube_overlap(const uvec_t<S>& shape, const uvec_t<S>& lo, unsigned int side) {
+        std::size_t count = 1;
+        for (std::size_t a = 0; a < S; ++a) {
+            if (lo._data[a] >= shape._data[a]) return 0;
+            count *= std::min(side, shape._data[a] - lo._data[a]);
+        }
+        return count;
+    }
+
+    // Visit the indices of ranks [skip, skip + remaining) within a cube of
+    // side 2^level whose corner is lo (relative to the space's start)
+    template<bool Hilbert, std::size_t S, typename F>
+    void curve_visit(
+        const index_space_t<S>& space,
+        const uvec_t<S>& lo,
+        unsigned int level,
+        hilbert_state_t st,
+        std::size_t& skip,
+        std::size_t& remaining,
+        F& func)
+    {
+        if (level == 0) {
+            auto index = space._start;
+            for (std::size_t a = 0; a < S; ++a) {
+                index._data[a] += static_cast<int>(lo._data[a]);
+            }
+            func(index);
+            --remaining;
+            return;
+        }
+        auto half = 1u << (level - 1);
+
+        for (unsigned int w = 0; w < (1u << S) && remaining > 0; ++w) {
+            auto corner = w;
+            auto child = st;
+            if constexpr (Hilbert) {
+                std::tie(corner, child) = hilbert_child<S>(st, w);
+            }
+            auto child_lo = lo;
+            for (std::size_t a = 0; a < S; ++a) {
+                child_lo._data[a] += ((corner >> a) & 1) * half;
+            }
+            auto count = cube_overlap(space._shape, child_lo, half);
+
+            if (skip >= count) {
+                skip -= count;
+                continue;
+            }
+            curve_visit<Hilbert>(space, child_lo, level - 1, child, skip, remaining, func);
+        }
+    }
+
+    // Call func on the indices of space with curve ranks in [first, last)
+    template<bool Hilbert, std::size_t S, typename F>
+    void curve_for_range(const index_space_t<S>& space, std::size_t first, std::size_t last, F&& func) {
+        unsigned int level = 0;
+        for (std::size_t a = 0; a < S; ++a) {
+            while ((1u << level) < space._shape._data[a]) ++level;
+        }
+        auto skip = first;
+        auto remaining = last - first;
+        curve_visit<Hilbert>(space, uvec_t<S>{}, level, hilbert_state_t{0, 0}, skip, remaining, func);
+    }
+
+    // Rank along the curve of a point in the cube of side 2^level at the
+    // origin, counting every point of the cube
+    template<bool Hilbert, std::size_t S>
+    constexpr std::uint64_t curve_key(const uvec_t<S>& point, unsigned int level) {
+        auto key = std::uint64_t(0);
+        auto st = hilbert_state_t{0, 0};
+
+        for (; level > 0; --level) {
+            auto corner = 0u;
+            for (std::size_t a = 0; a < S; ++a) {
+                corner |= ((point._data[a] >> (level - 1)) & 1u) << a;
+            }
+            auto w = corner;
+            if constexpr (Hilbert) {
+                for (w = 0; hilbert_child<S>(st, w).first != corner; ++w) {}
+                st = hilbert_child<S>(st, w).second;
+            }
+            key = (key << S) | w;
+        }
+        return key;
+    }
+
+    template<bool Hilbert, std::size_t S, typename F, typename E>
+    void curve_for_each(const index_space_t<S>& space, F&& func, const E& e) {
+        execute(e, size(space), [&](std::size_t first, std::size_t last, std::size_t) {
+            curve_for_range<Hilbert>(space, first, last, func);
+        });
+    }
+
+    template<bool Hilbert, std::size_t S, typename T, typename MapF, typename ReduceF, typename E>
+    T curve_map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, const E& e) {
+        auto partial = std::vector<std::optional<T>>(num_workers(e));
+
+        execute(e, size(space), [&](std::size_t first, std::size_t last, std::size_t worker) {
+            auto local = partial[worker];
+            curve_for_range<Hilbert>(space, first, last, [&](const ivec_t<S>& index) {
+                local = local ? T(reduce_op(*local, map(index))) : T(map(index));
+            });
+            partial[worker] = local;
+        });
+
+        T result = init;
+        for (const auto& p : partial) {
+            if (p) result = reduce_op(result, *p);
+        }
+        return result;
+    }
+}
+
+template<std::size_t S, typename F, typename E>
+void for_each(const index_space_t<S>& space, F&& func, const morton_t<E>& e) {
+    detail::curve_for_each<false>(space, func, e._inner);
+}
+
+template<std::size_t S, typename F, typename E>
+void for_each(const index_space_t<S>& space, F&& func, const hilbert_t<E>& e) {
+    detail::curve_for_each<true>(space, func, e._inner);
+}
+
+template<std::size_t S, typename T, typename MapF, typename ReduceF, typename E>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, const morton_t<E>& e) {
+    return detail::curve_map_reduce<false>(space, init, map, reduce_op, e._inner);
+}
+
+template<std::size_t S, typename T, typename MapF, typename ReduceF, typename E>
+T map_reduce(const index_space_t<S>& space, T init, MapF&& map, ReduceF&& reduce_op, const hilbert_t<E>& e) {
+    return detail::curve_map_reduce<true>(space, init, map, reduce_op, e._inner);
+}
+
+// =============================================================================
+// Axis permutation
+// =============================================================================
+
+// Reorder the axes of an index or space: axis a of the result is axis
+// perm[a] of the argument. For example, with perm = (2, 1, 0) a 3D space is
+// transposed so that its first axis becomes the innermost one.
+template<std::size_t S>
+MIST_HD constexpr ivec_t<S> permute(const ivec_t<S>& index, const uvec_t<S>& perm) {
+    auto result = ivec_t<S>{};
+    for (std::size_t a = 0; a < S; ++a) {
+        result._data[a] = index._data[perm._data[a]];
+    }
+    return result;
+}
+
+template<std::size_t S>
+MIST_HD constexpr index_space_t<S> permute(const index_space_t<S>& space, const uvec_t<S>& perm) {
+    auto result = index_space_t<S>{};
+    for (std::size_t a = 0; a < S; ++a) {
+        result._start._data[a] = space._start._data[perm._data[a]];
+        result._shape._data[a] = space._shape._data[perm._data[a]];
+    }
+    return result;
+}
+
+namespace detail {
+    // Tile edge, in zones, of a blocked permutation: a 32 x 32 tile of
+    // doubles touches 32 cache lines of each array and fits in L1
+    constexpr unsigned int permute_block = 32;
+
+    template<std::size_t S>
+    void check_permutation(const uvec_t<S>& perm) {
+        auto seen = vec_t<bool, S>{};
+        for (std::size_t a = 0; a < S; ++a) {
+            if (perm._data[a] >= S || seen._data[perm._data[a]]) {
+                throw std::runtime_error("permute: perm is not a permutation of the axes");
+            }
+            seen._data[perm._data[a]] = true;
+        }
+    }
+
+    // Row-major strides of a space, in elements
+    template<std::size_t S>
+    constexpr vec_t<std::size_t, S> strides(const index_space_t<S>& space) {
+        auto result = vec_t<std::size_t, S>{};
+        std::size_t stride = 1;
+        for (std::size_t a = S; a > 0; --a) {
+            result._data[a - 1] = stride;
+            stride *= space._shape._data[a - 1];
+        }
+        return result;
+    }
+}
+
+// Copy the row-major array src, covering space, to the row-major array dst,
+// covering permute(space, perm), so that dst at permute(i, perm) equals src
+// at i. A sweep along source axis perm[S - 1] then runs at unit stride in dst.
+//
+// The space is cut into tiles spanning permute_block zones along the axes
+// that are innermost in src and in dst, and tiles are distributed over the
+// executor's workers. Each tile is written row by row in destination order:
+// the inner loop is a unit-stride store of a strided load, which compilers
+// vectorize, and the source cache lines it reads stay resident for the
+// whole tile.
+template<typename T, std::size_t S, Executor E>
+void permute(const T* src, T* dst, const index_space_t<S>& space, const uvec_t<S>& perm, const E& e) {
+    detail::check_permutation(perm);
+
+    auto dst_space = permute(space, perm);
+    auto src_strides = detail::strides(space);
+    auto dst_strides = detail::strides(dst_space);
+
+    // Source stride of a step along each destination axis
+    auto steps = vec_t<std::size_t, S>{};
+    for (std::size_t a = 0; a < S; ++a) {
+        steps._data[a] = src_strides._data[perm._data[a]];
+    }
+
+    auto tile_shape = uvec_t<S>{};
+    for (std::size_t a = 0; a < S; ++a) {
+        tile_shape._data[a] = 1;
+    }
+    tile_shape._data[S - 1] = detail::permute_block;
+    tile_shape._data[perm._data[S - 1]] = detail::permute_block;
+
+    if constexpr (S > 1) {
+        if (perm._data[S - 1] == S - 1) {
+            tile_shape._data[S - 2] = detail::permute_block;
+        }
+    }
+
+    execute(e, tile_count(space, tile_shape), [&](std::size_t first, std::size_t last, std::size_t) {
+        for (std::size_t n = first; n < last; ++n) {
+            auto tile = tile_at(space, tile_shape, n);
+            auto dst_tile = permute(tile, perm);
+            auto inner = dst_tile._shape._data[S - 1];
+            auto step = steps._data[S - 1];
+            auto s = ndoffset(space, tile._start);
+            auto d = ndoffset(dst_space, dst_tile._start);
+            auto count = uvec_t<S>{};
+
+            for (std::size_t row = 0; row < size(dst_tile) / inner; ++row) {
+                for (std::size_t j = 0; j < inner; ++j) {
+                    dst[d + j] = src[s + j * step];
+                }
+                for (std::size_t a = S - 1; a > 0; --a) {
+                    s += steps._data[a - 1];
+                    d += dst_strides._data[a - 1];
+
+                    if (++count._data[a - 1] < dst_tile._shape._data[a - 1]) {
+                        break;
+                    }
+                    s -= dst_tile._shape._data[a - 1] * steps._data[a - 1];
+                    d -= dst_tile._shape._data[a - 1] * dst_strides._data[a - 1];
+                    count._data[a - 1] = 0;
+                }
+            }
+        }
+    });
+}
+
+template<typename T, std::size_t S>
+void permute(const T* src, T* dst, const index_space_t<S>& space, const uvec_t<S>& perm) {
+    permute(src, dst, space, perm, cpu_t{});
+}
+
+// Swap two axes: the 2D transpose, or e.g. bringing z innermost in 3D
+template<std::size_t S>
+constexpr uvec_t<S> swap_axes(std::size_t a, std::size_t b) {
+    auto perm = range<S>();
+    std::swap(perm._data[a], perm._data[b]);
+    return perm;
 }
 
 } // namespace mist
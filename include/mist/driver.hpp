@@ -12,9 +12,15 @@
 #include <sstream>
 #include <iomanip>
 #include <iostream>
+#include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <optional>
 #include "ascii_writer.hpp"
+#include "memory.hpp"
 #include "serialize.hpp"
+#include "shards.hpp"
+#include "tasks.hpp"
 
 namespace mist {
 
@@ -46,6 +52,15 @@ concept Physics = requires(
 } && HasConstFields<typename P::state_t>
   && HasConstFields<typename P::product_t>;
 
+// A state holding one shard of a decomposed global index space, such as one
+// rank's block of an MPI decomposition, describes the decomposition with
+// shard_layout(cfg, s) -> shard_layout_t<S>. The driver then writes each
+// checkpoint and product as one file per shard, plus a manifest.
+template<typename P>
+concept ShardedPhysics = Physics<P> && requires(const typename P::config_t& cfg, const typename P::state_t& s) {
+    shard_layout(cfg, s);
+};
+
 // =============================================================================
 // Time integrators
 // =============================================================================
@@ -114,15 +129,22 @@ public:
         }
     }
 
+    // Whether an exact output falls within a step from t0 to t1
+    bool exact_output_due(double t0, double t1) const {
+        return policy == scheduling_policy::exact && interval_kind == 0 && t0 < *next_time && t1 >= *next_time;
+    }
+
+    // Count an output of state, schedule the next, and write it
+    void emit(const StateT& state) {
+        (*count)++;
+        *next_time += interval;
+        if (callback) callback(state);
+    }
+
     template<typename RKStepFn>
     void handle_exact_output(double t0, double t1, const StateT& state, RKStepFn&& rk_step) {
-        if (policy == scheduling_policy::exact && interval_kind == 0) {
-            if (t0 < *next_time && t1 >= *next_time) {
-                auto state_exact = rk_step(state, *next_time - t0);
-                (*count)++;
-                *next_time += interval;
-                if (callback) callback(state_exact);
-            }
+        if (exact_output_due(t0, t1)) {
+            emit(rk_step(state, *next_time - t0));
         }
     }
 
@@ -130,9 +152,7 @@ public:
     void handle_nearest_output(const StateT& state, GetTimeFn&& get_time) {
         if (policy == scheduling_policy::nearest) {
             if (get_time(state, interval_kind) >= *next_time) {
-                (*count)++;
-                *next_time += interval;
-                if (callback) callback(state);
+                emit(state);
             }
         }
     }
@@ -186,6 +206,12 @@ struct config_t {
     int timeseries_interval_kind = 0;
     std::string timeseries_scheduling = "exact";
 
+    int team_threads = 0;  // size of a persistent team for threads_t kernels (0 = none)
+    int task_threads = 0;  // size of a task pool overlapping steps and output (0 = none)
+    std::string affinity = "none";  // pinning of team and pool threads (see parse_affinity)
+
+    std::string output_directory = "";  // where checkpoints and products go ("" = working directory)
+
     auto fields() const {
         return std::make_tuple(
             field("rk_order", rk_order),
@@ -203,7 +229,11 @@ struct config_t {
             field("products_scheduling", products_scheduling),
             field("timeseries_interval", timeseries_interval),
             field("timeseries_interval_kind", timeseries_interval_kind),
-            field("timeseries_scheduling", timeseries_scheduling)
+            field("timeseries_scheduling", timeseries_scheduling),
+            field("team_threads", team_threads),
+            field("task_threads", task_threads),
+            field("affinity", affinity),
+            field("output_directory", output_directory)
         );
     }
 
@@ -224,7 +254,11 @@ struct config_t {
             field("products_scheduling", products_scheduling),
             field("timeseries_interval", timeseries_interval),
             field("timeseries_interval_kind", timeseries_interval_kind),
-            field("timeseries_scheduling", timeseries_scheduling)
+            field("timeseries_scheduling", timeseries_scheduling),
+            field("team_threads", team_threads),
+            field("task_threads", task_threads),
+            field("affinity", affinity),
+            field("output_directory", output_directory)
         );
     }
 };
@@ -259,54 +293,100 @@ struct config {
 // Output functions
 // =============================================================================
 
+// Messages may come from several runs at once (see mist/ensemble.hpp), so
+// each is written whole
 inline void write_iteration_message(const std::string& message) {
+    static auto mutex = std::mutex{};
+    auto lock = std::lock_guard<std::mutex>(mutex);
     std::cout << message << std::endl;
 }
 
-template<Physics P>
-void write_checkpoint(int output_num, const typename P::state_t& state, const driver_state_t& driver_state) {
-    char filename[64];
-    std::snprintf(filename, sizeof(filename), "chkpt.%04d.dat", output_num);
-    std::ofstream file(filename);
-    ascii_writer writer(file);
+namespace detail {
+    template<Physics P>
+    void write_checkpoint_group(ascii_writer& writer, const typename P::state_t& state, const driver_state_t& driver_state) {
+        writer.begin_group("checkpoint");
+
+        writer.begin_group("driver_state");
+        writer.write_scalar("iteration", driver_state.iteration);
+        writer.write_scalar("message_count", driver_state.message_count);
+        writer.write_scalar("checkpoint_count", driver_state.checkpoint_count);
+        writer.write_scalar("products_count", driver_state.products_count);
+        writer.write_scalar("timeseries_count", driver_state.timeseries_count);
+        writer.write_scalar("next_message_time", driver_state.next_message_time);
+        writer.write_scalar("next_checkpoint_time", driver_state.next_checkpoint_time);
+        writer.write_scalar("next_products_time", driver_state.next_products_time);
+        writer.write_scalar("next_timeseries_time", driver_state.next_timeseries_time);
+        writer.end_group();
+
+        serialize(writer, "state", state);
+
+        // Write timeseries data
+        writer.begin_group("timeseries");
+        for (const auto& [name, values] : driver_state.timeseries_data) {
+            writer.write_array(name.c_str(), values);
+        }
+        writer.end_group();
+
+        writer.end_group();
+    }
+
+    inline std::string output_prefix(const char* kind, int output_num, const std::string& directory = {}) {
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "%s.%04d", kind, output_num);
+        return directory.empty() ? prefix : (std::filesystem::path(directory) / prefix).string();
+    }
+
+    // Write this state's shard of an output; shard 0 also writes the
+    // manifest, since every shard's layout knows the whole decomposition
+    template<std::size_t S, typename F>
+    void write_output_shard(const std::string& prefix, const shard_layout_t<S>& layout, F write_value) {
+        detail::write_shard_file(shard_filename(prefix, layout._shard), layout._spaces.at(layout._shard), write_value);
 
-    writer.begin_group("checkpoint");
-
-    writer.begin_group("driver_state");
-    writer.write_scalar("iteration", driver_state.iteration);
-    writer.write_scalar("message_count", driver_state.message_count);
-    writer.write_scalar("checkpoint_count", driver_state.checkpoint_count);
-    writer.write_scalar("products_count", driver_state.products_count);
-    writer.write_scalar("timeseries_count", driver_state.timeseries_count);
-    writer.write_scalar("next_message_time", driver_state.next_message_time);
-    writer.write_scalar("next_checkpoint_time", driver_state.next_checkpoint_time);
-    writer.write_scalar("next_products_time", driver_state.next_products_time);
-    writer.write_scalar("next_timeseries_time", driver_state.next_timeseries_time);
-    writer.end_group();
-
-    serialize(writer, "state", state);
-
-    // Write timeseries data
-    writer.begin_group("timeseries");
-    for (const auto& [name, values] : driver_state.timeseries_data) {
-        writer.write_array(name.c_str(), values);
+        if (layout._shard == 0) {
+            write_manifest(manifest_filename(prefix), make_manifest(prefix, layout._global, layout._spaces));
+        }
     }
-    writer.end_group();
+}
 
-    writer.end_group();
+template<Physics P>
+void write_checkpoint(int output_num, const typename P::state_t& state, const driver_state_t& driver_state, const std::string& directory = {}) {
+    std::ofstream file(detail::output_prefix("chkpt", output_num, directory) + ".dat");
+    ascii_writer writer(file);
+    detail::write_checkpoint_group<P>(writer, state, driver_state);
 }
 
 template<Physics P>
-void write_products(int output_num, const typename P::state_t& state, const typename P::product_t& product) {
-    char filename[64];
-    std::snprintf(filename, sizeof(filename), "prods.%04d.dat", output_num);
-    std::ofstream file(filename);
+void write_products(int output_num, const typename P::state_t&, const typename P::product_t& product, const std::string& directory = {}) {
+    std::ofstream file(detail::output_prefix("prods", output_num, directory) + ".dat");
     ascii_writer writer(file);
 
     serialize(writer, "products", product);
 }
 
+// Outputs of a sharded physics are written as chkpt.NNNN.KKKK.dat (or
+// prods) for shard KKKK, plus chkpt.NNNN.manifest; other physics write a
+// single chkpt.NNNN.dat. Files go in directory, if given.
+template<Physics P>
+void write_checkpoint(const typename P::config_t& cfg, int output_num, const typename P::state_t& state, const driver_state_t& driver_state, const std::string& directory = {}) {
+    if constexpr (ShardedPhysics<P>) {
+        detail::write_output_shard(detail::output_prefix("chkpt", output_num, directory), shard_layout(cfg, state), [&](ascii_writer& writer) {
+            detail::write_checkpoint_group<P>(writer, state, driver_state);
+        });
+    } else {
+        write_checkpoint<P>(output_num, state, driver_state, directory);
+    }
+}
 
+template<Physics P>
+void write_products(const typename P::config_t& cfg, int output_num, const typename P::state_t& state, const typename P::product_t& product, const std::string& directory = {}) {
+    if constexpr (ShardedPhysics<P>) {
+        detail::write_output_shard(detail::output_prefix("prods", output_num, directory), shard_layout(cfg, state), [&](ascii_writer& writer) {
+            serialize(writer, "products", product);
+        });
+    } else {
+        write_products<P>(output_num, state, product, directory);
+    }
+}
 
 // =============================================================================
 // Helpers
@@ -336,6 +416,109 @@ inline double get_wall_time() {
     return duration<double>(steady_clock::now().time_since_epoch()).count();
 }
 
+namespace detail {
+    // Wall time and iteration of the last iteration message, for its
+    // zone-update rate
+    struct message_clock_t {
+        double wall_time = 0.0;
+        int iteration = 0;
+    };
+
+    // The four scheduled outputs of a run: iteration messages, checkpoints,
+    // products and timeseries samples. Files are handed to write(w), which
+    // may write them at once or defer them. The outputs refer to cfg,
+    // driver_state, clock and write, which must outlive them.
+    template<Physics P, typename WriteFn>
+    std::array<scheduled_output<typename P::state_t>, 4> make_outputs(
+        const config<P>& cfg,
+        driver_state_t& driver_state,
+        message_clock_t& clock,
+        WriteFn& write)
+    {
+        using state_t = typename P::state_t;
+        const auto& drv = cfg.driver;
+        const auto& phys = cfg.physics;
+
+        // Iteration message output
+        auto message_output = scheduled_output<state_t>(
+            drv.message_interval,
+            drv.message_interval_kind,
+            parse_scheduling_policy(drv.message_scheduling),
+            &driver_state.next_message_time,
+            &driver_state.message_count,
+            [&](const state_t& s) {
+                double wall_now = get_wall_time();
+                double wall_elapsed = wall_now - clock.wall_time;
+                int iter_elapsed = driver_state.iteration - clock.iteration;
+                double mzps = (wall_elapsed > 0) ? (iter_elapsed * zone_count(s)) / (wall_elapsed * 1e6) : 0.0;
+
+                std::ostringstream oss;
+                if (!drv.output_directory.empty()) oss << drv.output_directory << " ";
+                oss << "[" << std::setw(6) << std::setfill('0') << driver_state.iteration << "] ";
+                oss << "t=" << std::fixed << std::setprecision(5) << get_time(s, 0) << " (";
+
+                for (int kind = 1; kind <= 10; ++kind) {
+                    try {
+                        double t = get_time(s, kind);
+                        if (kind > 1) oss << " ";
+                        oss << kind << ":" << std::fixed << std::setprecision(4) << t;
+                    } catch (const std::out_of_range&) {
+                        break;
+                    }
+                }
+                oss << ") Mzps=" << std::fixed << std::setprecision(3) << mzps;
+
+                write_iteration_message(oss.str());
+                clock.wall_time = wall_now;
+                clock.iteration = driver_state.iteration;
+            });
+
+        // Checkpoint output
+        auto checkpoint_output = scheduled_output<state_t>(
+            drv.checkpoint_interval,
+            drv.checkpoint_interval_kind,
+            parse_scheduling_policy(drv.checkpoint_scheduling),
+            &driver_state.next_checkpoint_time,
+            &driver_state.checkpoint_count,
+            [&](const state_t& s) {
+                write([&phys, &drv, s, snapshot = driver_state] {
+                    write_checkpoint<P>(phys, snapshot.checkpoint_count, s, snapshot, drv.output_directory);
+                });
+            });
+
+        // Product output
+        auto products_output = scheduled_output<state_t>(
+            drv.products_interval,
+            drv.products_interval_kind,
+            parse_scheduling_policy(drv.products_scheduling),
+            &driver_state.next_products_time,
+            &driver_state.products_count,
+            [&](const state_t& s) {
+                write([&phys, &drv, s, n = driver_state.products_count] {
+                    write_products<P>(phys, n, s, get_product(phys, s), drv.output_directory);
+                });
+            });
+
+        // Timeseries output
+        auto timeseries_output = scheduled_output<state_t>(
+            drv.timeseries_interval,
+            drv.timeseries_interval_kind,
+            parse_scheduling_policy(drv.timeseries_scheduling),
+            &driver_state.next_timeseries_time,
+            &driver_state.timeseries_count,
+            [&](const state_t& s) {
+                accumulate_timeseries_sample(driver_state, timeseries_sample(phys, s));
+            });
+
+        return {{
+            message_output,
+            checkpoint_output,
+            products_output,
+            timeseries_output
+        }};
+    }
+}
+
 // =============================================================================
 // Main driver
 // =============================================================================
@@ -346,17 +529,64 @@ typename P::state_t run(const config<P>& cfg, driver_state_t& driver_state) {
     const auto& drv = cfg.driver;
     const auto& phys = cfg.physics;
 
-    auto rk_step = [&](const state_t& s, double dt) -> state_t {
-        switch (drv.rk_order) {
-            case 1: return rk1_step<P>(phys, s, dt);
-            case 2: return rk2_step<P>(phys, s, dt);
-            case 3: return rk3_step<P>(phys, s, dt);
-            default: throw std::runtime_error("rk_order must be 1, 2, or 3");
-        }
+    // Per-step arenas: temporaries that physics functions take from
+    // current_arena() (e.g. with scratch<T>(n)) are released in bulk after
+    // each step. Exact-time outputs have their own arena, since with a task
+    // pool they run alongside the step.
+    auto step_arena = arena_t{};
+    auto output_arena = arena_t{};
+
+    auto rk_step_in = [&](arena_t& arena, const state_t& s, double dt) -> state_t {
+        auto scope = arena_scope_t(arena);
+        auto next = [&] {
+            switch (drv.rk_order) {
+                case 1: return rk1_step<P>(phys, s, dt);
+                case 2: return rk2_step<P>(phys, s, dt);
+                case 3: return rk3_step<P>(phys, s, dt);
+                default: throw std::runtime_error("rk_order must be 1, 2, or 3");
+            }
+        }();
+        reset(arena);
+        return next;
+    };
+    auto rk_step = [&](const state_t& s, double dt) {
+        return rk_step_in(step_arena, s, dt);
+    };
+    auto exact_step = [&](const state_t& s, double dt) {
+        return rk_step_in(output_arena, s, dt);
     };
 
     auto state = initial_state(phys);
 
+    if (!drv.output_directory.empty()) {
+        std::filesystem::create_directories(drv.output_directory);
+    }
+
+    // Task pool: each iteration becomes a graph in which file writes for
+    // earlier outputs overlap the Courant reduction and the step; without a
+    // pool, writes happen immediately
+    auto pool = std::optional<task_pool_t>{};
+    auto deferred = std::vector<std::function<void()>>{};
+
+    // The pool and the team are placed on disjoint CPUs (while there are
+    // enough), the pool's workers first. This thread, worker 0 of both, is
+    // pinned to the first CPU once for the whole run.
+    auto affinity = parse_affinity(drv.affinity);
+    auto pool_workers = static_cast<std::size_t>(std::max(drv.task_threads, 0));
+    auto team_workers = static_cast<std::size_t>(std::max(drv.team_threads, 0));
+    auto pin = detail::caller_pin_t(pool_workers + team_workers > 0 ? detail::affinity_cpu(affinity, 0) : -1);
+
+    if (drv.task_threads > 0) {
+        pool.emplace(static_cast<unsigned int>(drv.task_threads), detail::affinity_slice(affinity, 0, pool_workers));
+    }
+    auto write = [&](std::function<void()> w) {
+        if (pool) {
+            deferred.push_back(std::move(w));
+        } else {
+            w();
+        }
+    };
+
     // Initialize scheduling on first run
     if (driver_state.iteration == 0) {
         driver_state.next_message_time = drv.message_interval;
@@ -366,82 +596,8 @@ typename P::state_t run(const config<P>& cfg, driver_state_t& driver_state) {
     }
 
     // Session state
-    double last_message_wall_time = get_wall_time();
-    int last_message_iteration = driver_state.iteration;
-
-    // Iteration message output
-    auto message_output = scheduled_output<state_t>(
-        drv.message_interval,
-        drv.message_interval_kind,
-        parse_scheduling_policy(drv.message_scheduling),
-        &driver_state.next_message_time,
-        &driver_state.message_count,
-        [&](const state_t& s) {
-            double wall_now = get_wall_time();
-            double wall_elapsed = wall_now - last_message_wall_time;
-            int iter_elapsed = driver_state.iteration - last_message_iteration;
-            double mzps = (wall_elapsed > 0) ? (iter_elapsed * zone_count(s)) / (wall_elapsed * 1e6) : 0.0;
-
-            std::ostringstream oss;
-            oss << "[" << std::setw(6) << std::setfill('0') << driver_state.iteration << "] ";
-            oss << "t=" << std::fixed << std::setprecision(5) << get_time(s, 0) << " (";
-
-            for (int kind = 1; kind <= 10; ++kind) {
-                try {
-                    double t = get_time(s, kind);
-                    if (kind > 1) oss << " ";
-                    oss << kind << ":" << std::fixed << std::setprecision(4) << t;
-                } catch (const std::out_of_range&) {
-                    break;
-                }
-            }
-            oss << ") Mzps=" << std::fixed << std::setprecision(3) << mzps;
-
-            write_iteration_message(oss.str());
-            last_message_wall_time = wall_now;
-            last_message_iteration = driver_state.iteration;
-        });
-
-    // Checkpoint output
-    auto checkpoint_output = scheduled_output<state_t>(
-        drv.checkpoint_interval,
-        drv.checkpoint_interval_kind,
-        parse_scheduling_policy(drv.checkpoint_scheduling),
-        &driver_state.next_checkpoint_time,
-        &driver_state.checkpoint_count,
-        [&](const state_t& s) {
-            write_checkpoint<P>(driver_state.checkpoint_count, s, driver_state);
-        });
-
-    // Product output
-    auto products_output = scheduled_output<state_t>(
-        drv.products_interval,
-        drv.products_interval_kind,
-        parse_scheduling_policy(drv.products_scheduling),
-        &driver_state.next_products_time,
-        &driver_state.products_count,
-        [&](const state_t& s) {
-            write_products<P>(driver_state.products_count, s, get_product(phys, s));
-        });
-
-    // Timeseries output
-    auto timeseries_output = scheduled_output<state_t>(
-        drv.timeseries_interval,
-        drv.timeseries_interval_kind,
-        parse_scheduling_policy(drv.timeseries_scheduling),
-        &driver_state.next_timeseries_time,
-        &driver_state.timeseries_count,
-        [&](const state_t& s) {
-            accumulate_timeseries_sample(driver_state, timeseries_sample(phys, s));
-        });
-
-    // Collect outputs
-    std::array<scheduled_output<state_t>, 4> outputs = {{
-        message_output,
-        checkpoint_output,
-        products_output,
-        timeseries_output
-    }};
+    auto clock = detail::message_clock_t{get_wall_time(), driver_state.iteration};
+    auto outputs = detail::make_outputs(cfg, driver_state, clock, write);
 
     for (auto& output : outputs) {
         output.validate();
@@ -454,6 +610,23 @@ typename P::state_t run(const config<P>& cfg, driver_state_t& driver_state) {
         }
     }
 
+    // Persistent thread team: threads_t kernels in the physics wake its
+    // parked workers instead of spawning threads on every call
+    auto team = std::optional<team_t>{};
+    auto team_scope = std::optional<team_scope_t>{};
+
+    if (drv.team_threads > 0) {
+        team.emplace(static_cast<unsigned int>(drv.team_threads), detail::affinity_slice(affinity, pool_workers, team_workers));
+        team_scope.emplace(*team);
+    }
+
+    // Kernels run on pool workers use the team too
+    auto in_team = [&](auto&& kernel) {
+        auto scope = std::optional<team_scope_t>{};
+        if (team) scope.emplace(*team);
+        kernel();
+    };
+
     // Main loop
     while (true) {
         double t0 = get_time(state, 0);
@@ -461,14 +634,42 @@ typename P::state_t run(const config<P>& cfg, driver_state_t& driver_state) {
         if (t0 >= drv.t_final) break;
         if (drv.max_iter > 0 && driver_state.iteration >= drv.max_iter) break;
 
-        double dt = drv.cfl * courant_time(phys, state);
-        double t1 = t0 + dt;
+        if (pool) {
+            auto writing = std::move(deferred);
+            auto graph = task_graph_t{};
+            auto dt = 0.0;
+            auto next = std::optional<state_t>{};
+            deferred.clear();
 
-        for (auto& output : outputs) {
-            output.handle_exact_output(t0, t1, state, rk_step);
-        }
+            for (auto& w : writing) {
+                add_task(graph, std::move(w));
+            }
+            auto courant = add_task(graph, [&] {
+                in_team([&] { dt = drv.cfl * courant_time(phys, state); });
+            });
+            add_task(graph, [&] {
+                in_team([&] {
+                    for (auto& output : outputs) {
+                        output.handle_exact_output(t0, t0 + dt, state, exact_step);
+                    }
+                });
+            }, {courant});
+            add_task(graph, [&] {
+                in_team([&] { next.emplace(rk_step(state, dt)); });
+            }, {courant});
+
+            run(graph, *pool);
+            state = std::move(*next);
+        } else {
+            double dt = drv.cfl * courant_time(phys, state);
+            double t1 = t0 + dt;
 
-        state = rk_step(state, dt);
+            for (auto& output : outputs) {
+                output.handle_exact_output(t0, t1, state, exact_step);
+            }
+
+            state = rk_step(state, dt);
+        }
         driver_state.iteration++;
 
         for (auto& output : outputs) {
@@ -477,6 +678,9 @@ typename P::state_t run(const config<P>& cfg, driver_state_t& driver_state) {
         }
     }
 
+    for (auto& w : deferred) {
+        w();
+    }
     return state;
 }
 
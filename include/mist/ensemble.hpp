@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "core.hpp"
+#include "driver.hpp"
+#include "tasks.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Ensemble configuration
+// =============================================================================
+
+// A parameter sweep of small problems cannot fill a node with one process
+// per run, since each run alone scales poorly. An ensemble instead runs many
+// configurations in one process, as tasks on a shared pool: with at least
+// as many members as threads, each member runs on a single thread, and with
+// fewer, the threads left over are divided among members as their teams.
+
+namespace ensemble {
+
+struct config_t {
+    int threads = 0;                   // threads for the whole ensemble (0 = hardware concurrency)
+    int member_threads = 0;            // team threads per member (0 = threads / members, at least 1)
+    std::string directory = "member";  // member KKKK writes to directory.KKKK, unless its output_directory is set
+
+    auto fields() const {
+        return std::make_tuple(
+            field("threads", threads),
+            field("member_threads", member_threads),
+            field("directory", directory)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("threads", threads),
+            field("member_threads", member_threads),
+            field("directory", directory)
+        );
+    }
+};
+
+} // namespace ensemble
+
+// =============================================================================
+// Scheduling
+// =============================================================================
+
+// How an ensemble's threads are divided: concurrent members at a time, each
+// with member_threads threads
+struct ensemble_plan_t {
+    unsigned int concurrent = 1;
+    unsigned int member_threads = 1;
+};
+
+inline ensemble_plan_t plan_ensemble(std::size_t members, const ensemble::config_t& ecfg) {
+    auto threads = ecfg.threads > 0 ? static_cast<unsigned int>(ecfg.threads) : std::max(1u, std::thread::hardware_concurrency());
+    auto n = static_cast<unsigned int>(std::max(std::size_t(1), members));
+    auto plan = ensemble_plan_t{};
+
+    plan.member_threads = ecfg.member_threads > 0 ? static_cast<unsigned int>(ecfg.member_threads) : std::max(1u, threads / n);
+    plan.member_threads = std::min(plan.member_threads, threads);
+    plan.concurrent = std::min(n, threads / plan.member_threads);
+    return plan;
+}
+
+// The configuration member k of an ensemble runs with: its own output
+// directory, and a team of the planned size, even of one thread, so its
+// threads_t kernels stay on the member's pool worker rather than spawning
+// threads of their own. Members run on the ensemble's pool, so they get no
+// task pool of their own, and their teams are unpinned, since concurrent
+// members would otherwise pin to the same CPUs.
+template<Physics P>
+config<P> ensemble_member_config(const config<P>& cfg, std::size_t k, const ensemble::config_t& ecfg, const ensemble_plan_t& plan) {
+    auto member = cfg;
+
+    if (member.driver.output_directory.empty()) {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".%04zu", k);
+        member.driver.output_directory = ecfg.directory + suffix;
+    }
+    member.driver.team_threads = static_cast<int>(plan.member_threads);
+    member.driver.task_threads = 0;
+
+    if (plan.concurrent > 1) {
+        member.driver.affinity = "none";
+    }
+    return member;
+}
+
+// =============================================================================
+// Ensemble driver
+// =============================================================================
+
+// Run every configuration in members to completion, as in run(cfg,
+// driver_state), returning their final states. Members are tasks on a pool
+// of plan.concurrent workers, so a worker that finishes a short member
+// takes the next one. driver_states is resized to one per member, and
+// those already there resume as in run(). The first exception thrown by a
+// member is rethrown, once the members already running have finished.
+template<Physics P>
+std::vector<typename P::state_t> run_ensemble(const std::vector<config<P>>& members, std::vector<driver_state_t>& driver_states, const ensemble::config_t& ecfg = {}) {
+    using state_t = typename P::state_t;
+
+    auto plan = plan_ensemble(members.size(), ecfg);
+    auto finals = std::vector<std::optional<state_t>>(members.size());
+    auto graph = task_graph_t{};
+    driver_states.resize(members.size());
+
+    for (std::size_t k = 0; k < members.size(); ++k) {
+        add_task(graph, [&, k] {
+            finals[k].emplace(run(ensemble_member_config(members[k], k, ecfg, plan), driver_states[k]));
+        });
+    }
+    auto pool = task_pool_t(plan.concurrent);
+    run(graph, pool);
+
+    auto result = std::vector<state_t>{};
+    result.reserve(members.size());
+
+    for (auto& s : finals) {
+        result.push_back(std::move(*s));
+    }
+    return result;
+}
+
+template<Physics P>
+std::vector<typename P::state_t> run_ensemble(const std::vector<config<P>>& members, const ensemble::config_t& ecfg = {}) {
+    auto driver_states = std::vector<driver_state_t>{};
+    return run_ensemble(members, driver_states, ecfg);
+}
+
+// =============================================================================
+// SIMD lanes
+// =============================================================================
+
+// Members too small to use threads well (0D reaction networks, short 1D
+// sweeps) can still use vector units: a physics that can interleave W
+// states, so that each value becomes a pack_t<double, W> with one member
+// per lane, advances W members with one vectorized euler_step. Lanes share
+// the step's arithmetic but not its time step: each lane has its own dt,
+// t_final and output schedule, and a lane that is finished (or between
+// steps) is given dt = 0, which must leave it unchanged.
+//
+// Such a physics provides, besides the Physics functions:
+//   lane_state_t<W>                        - the interleaved state of W members
+//   interleave(states) -> lane_state_t<W>  - from std::array<state_t, W>
+//   extract_lane(ls, l) -> state_t         - member l of an interleaved state
+//   euler_step(cfgs, ls, dt)               - cfgs is std::array<config_t, W>, dt a const pack&
+//   courant_time(cfgs, ls) -> pack_t<double, W>
+//   average(ls, ls, alpha) -> lane_state_t<W>
+//   get_time(ls, kind) -> pack_t<double, W>
+template<typename P, std::size_t W>
+concept LanePhysics = Physics<P> && requires(
+    const std::array<typename P::config_t, W>& cfgs,
+    const std::array<typename P::state_t, W>& states,
+    const typename P::template lane_state_t<W>& ls,
+    const pack_t<double, W>& dt,
+    double alpha,
+    int kind,
+    std::size_t lane
+) {
+    typename P::template lane_state_t<W>;
+
+    { interleave(states) } -> std::same_as<typename P::template lane_state_t<W>>;
+    { extract_lane(ls, lane) } -> std::same_as<typename P::state_t>;
+    { euler_step(cfgs, ls, dt) } -> std::same_as<typename P::template lane_state_t<W>>;
+    { courant_time(cfgs, ls) } -> std::same_as<pack_t<double, W>>;
+    { average(ls, ls, alpha) } -> std::same_as<typename P::template lane_state_t<W>>;
+    { get_time(ls, kind) } -> std::same_as<pack_t<double, W>>;
+};
+
+namespace detail {
+    // rk1_step, rk2_step or rk3_step, on W interleaved members
+    template<typename C, typename L, std::size_t W>
+    L lane_rk_step(int rk_order, const C& cfgs, const L& s0, const pack_t<double, W>& dt) {
+        switch (rk_order) {
+            case 1: {
+                return euler_step(cfgs, s0, dt);
+            }
+            case 2: {
+                auto s1 = euler_step(cfgs, s0, dt);
+                auto s2 = euler_step(cfgs, s1, dt);
+                return average(s0, s2, 0.5);
+            }
+            case 3: {
+                auto s1 = euler_step(cfgs, s0, dt);
+                auto s2 = euler_step(cfgs, s1, dt);
+                auto s3 = euler_step(cfgs, average(s0, s2, 0.25), dt);
+                return average(s0, s3, 2.0 / 3.0);
+            }
+            default: throw std::runtime_error("rk_order must be 1, 2, or 3");
+        }
+    }
+
+    // Run up to W members (count of them) in the lanes of one interleaved
+    // state, as run() would run each alone; unused lanes repeat the last
+    // member and never step
+    template<std::size_t W, Physics P>
+    std::vector<typename P::state_t> run_lanes(const std::vector<config<P>>& members, std::vector<driver_state_t*> driver_states) {
+        using state_t = typename P::state_t;
+
+        auto count = members.size();
+        auto cfgs = std::array<typename P::config_t, W>{};
+        auto states = std::array<state_t, W>{};
+
+        for (std::size_t l = 0; l < W; ++l) {
+            const auto& member = members[std::min(l, count - 1)];
+            cfgs[l] = member.physics;
+            states[l] = initial_state(member.physics);
+
+            if (member.driver.rk_order != members[0].driver.rk_order) {
+                throw std::runtime_error("run_lanes: members sharing a pack must share rk_order");
+            }
+        }
+        auto rk_order = members[0].driver.rk_order;
+        auto lanes = interleave(states);
+
+        // Each member's schedule, as in run()
+        auto write = [](const std::function<void()>& w) { w(); };
+        auto clocks = std::vector<message_clock_t>(count);
+        auto outputs = std::vector<std::array<scheduled_output<state_t>, 4>>{};
+
+        for (std::size_t l = 0; l < count; ++l) {
+            const auto& drv = members[l].driver;
+            auto& ds = *driver_states[l];
+
+            if (!drv.output_directory.empty()) {
+                std::filesystem::create_directories(drv.output_directory);
+            }
+            if (ds.iteration == 0) {
+                ds.next_message_time = drv.message_interval;
+                ds.next_checkpoint_time = drv.checkpoint_interval;
+                ds.next_products_time = drv.products_interval;
+                ds.next_timeseries_time = drv.timeseries_interval;
+            }
+            clocks[l] = message_clock_t{get_wall_time(), ds.iteration};
+            outputs.push_back(make_outputs(members[l], ds, clocks[l], write));
+
+            for (auto& output : outputs[l]) {
+                output.validate();
+            }
+            if (ds.iteration == 0) {
+                for (std::size_t i = 1; i < outputs[l].size(); ++i) {
+                    outputs[l][i].callback(states[l]);
+                }
+            }
+        }
+
+        // Main loop: every active lane steps by its own dt, and exact outputs
+        // falling within a lane's step come from one more vectorized step,
+        // with dt = 0 in the other lanes
+        while (true) {
+            auto t0 = get_time(lanes, 0);
+            auto active = std::array<bool, W>{};
+            auto any = false;
+
+            for (std::size_t l = 0; l < count; ++l) {
+                const auto& drv = members[l].driver;
+                active[l] = t0[l] < drv.t_final && !(drv.max_iter > 0 && driver_states[l]->iteration >= drv.max_iter);
+                any = any || active[l];
+            }
+            if (!any) break;
+
+            auto courant = courant_time(cfgs, lanes);
+            auto dt = broadcast<W>(0.0);
+
+            for (std::size_t l = 0; l < count; ++l) {
+                if (active[l]) dt[l] = members[l].driver.cfl * courant[l];
+            }
+            for (std::size_t o = 0; o < 4; ++o) {
+                auto exact_dt = broadcast<W>(0.0);
+                auto due = std::array<bool, W>{};
+                auto any_due = false;
+
+                for (std::size_t l = 0; l < count; ++l) {
+                    due[l] = active[l] && outputs[l][o].exact_output_due(t0[l], t0[l] + dt[l]);
+                    any_due = any_due || due[l];
+                    if (due[l]) exact_dt[l] = *outputs[l][o].next_time - t0[l];
+                }
+                if (any_due) {
+                    auto exact = lane_rk_step(rk_order, cfgs, lanes, exact_dt);
+
+                    for (std::size_t l = 0; l < count; ++l) {
+                        if (due[l]) outputs[l][o].emit(extract_lane(exact, l));
+                    }
+                }
+            }
+            lanes = lane_rk_step(rk_order, cfgs, lanes, dt);
+
+            for (std::size_t l = 0; l < count; ++l) {
+                if (active[l]) driver_states[l]->iteration++;
+            }
+            for (std::size_t o = 0; o < 4; ++o) {
+                for (std::size_t l = 0; l < count; ++l) {
+                    auto& output = outputs[l][o];
+
+                    if (active[l] && output.policy == scheduling_policy::nearest && get_time(lanes, output.interval_kind)[l] >= *output.next_time) {
+                        output.emit(extract_lane(lanes, l));
+                    }
+                }
+            }
+        }
+
+        auto result = std::vector<state_t>{};
+        for (std::size_t l = 0; l < count; ++l) {
+            result.push_back(extract_lane(lanes, l));
+        }
+        return result;
+    }
+}
+
+// run_ensemble with the members packed W at a time into SIMD lanes, in
+// order: members 0 to W - 1 share the first pack, and so on. Packs are the
+// tasks of the pool, one thread each. Members sharing a pack must have the
+// same rk_order; their other driver settings are their own.
+template<std::size_t W, Physics P>
+    requires LanePhysics<P, W>
+std::vector<typename P::state_t> run_lanes(const std::vector<config<P>>& members, std::vector<driver_state_t>& driver_states, const ensemble::config_t& ecfg = {}) {
+    using state_t = typename P::state_t;
+
+    auto packs = (members.size() + W - 1) / W;
+    auto plan = plan_ensemble(packs, {.threads = ecfg.threads, .member_threads = 1, .directory = ecfg.directory});
+    auto finals = std::vector<std::vector<state_t>>(packs);
+    auto graph = task_graph_t{};
+    driver_states.resize(members.size());
+
+    for (std::size_t p = 0; p < packs; ++p) {
+        add_task(graph, [&, p] {
+            auto pack = std::vector<config<P>>{};
+            auto states = std::vector<driver_state_t*>{};
+
+            for (auto k = p * W; k < std::min(members.size(), (p + 1) * W); ++k) {
+                pack.push_back(ensemble_member_config(members[k], k, ecfg, plan));
+                states.push_back(&driver_states[k]);
+            }
+            finals[p] = detail::run_lanes<W>(pack, states);
+        });
+    }
+    auto pool = task_pool_t(plan.concurrent);
+    run(graph, pool);
+
+    auto result = std::vector<state_t>{};
+    result.reserve(members.size());
+
+    for (auto& pack : finals) {
+        for (auto& s : pack) {
+            result.push_back(std::move(s));
+        }
+    }
+    return result;
+}
+
+template<std::size_t W, Physics P>
+    requires LanePhysics<P, W>
+std::vector<typename P::state_t> run_lanes(const std::vector<config<P>>& members, const ensemble::config_t& ecfg = {}) {
+    auto driver_states = std::vector<driver_state_t>{};
+    return run_lanes<W>(members, driver_states, ecfg);
+}
+
+} // namespace mist
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "core.hpp"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace mist {
+
+// =============================================================================
+// Aligned and huge-page allocation
+// =============================================================================
+
+// How an aligned_allocator backs large buffers with huge pages. A 3D stencil
+// sweep over a large grid touches many 4 KiB pages at once (one per row of
+// each plane it reads), so TLB misses can cost a measurable fraction of a
+// step; 2 MiB pages cut the number of translations by 512.
+enum class huge_pages {
+    none,           // ordinary pages
+    transparent,    // 2 MiB-aligned, and madvise(MADV_HUGEPAGE) for buffers of 2 MiB or more
+    explicit_       // mmap(MAP_HUGETLB) from the reserved huge page pool, else ordinary pages
+};
+
+namespace detail {
+    inline constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+    inline constexpr std::size_t arena_alignment = 64;
+
+    inline std::size_t round_up(std::size_t bytes, std::size_t unit) {
+        return (bytes + unit - 1) / unit * unit;
+    }
+
+    inline void* allocate_aligned(std::size_t bytes, std::size_t alignment, huge_pages h) {
+        #ifdef __linux__
+        if (h == huge_pages::explicit_) {
+            auto length = round_up(bytes, huge_page_size);
+            auto p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p == MAP_FAILED) {
+                p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            }
+            if (p == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            return p;
+        }
+        if (h == huge_pages::transparent && bytes >= huge_page_size) {
+            auto p = ::operator new(bytes, std::align_val_t(huge_page_size));
+            madvise(p, bytes / huge_page_size * huge_page_size, MADV_HUGEPAGE);
+            return p;
+        }
+        #endif
+        if (h != huge_pages::none && bytes >= huge_page_size) {
+            return ::operator new(bytes, std::align_val_t(huge_page_size));
+        }
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+
+    inline void deallocate_aligned(void* p, std::size_t bytes, std::size_t alignment, huge_pages h) noexcept {
+        #ifdef __linux__
+        if (h == huge_pages::explicit_) {
+            munmap(p, round_up(bytes, huge_page_size));
+            return;
+        }
+        #endif
+        if (h != huge_pages::none && bytes >= huge_page_size) {
+            ::operator delete(p, std::align_val_t(huge_page_size));
+            return;
+        }
+        ::operator delete(p, std::align_val_t(alignment));
+    }
+}
+
+// Allocator returning buffers aligned to Alignment bytes (64 = a cache line,
+// so SIMD loads of a row never split lines; 4096 = a page), optionally backed
+// by huge pages. It can replace std::allocator in the std::vector of an
+// existing state_t; serialization accepts vectors with any allocator.
+template<typename T, std::size_t Alignment = 64, huge_pages H = huge_pages::none>
+    requires ((Alignment & (Alignment - 1)) == 0)
+struct aligned_allocator {
+    using value_type = T;
+
+    static constexpr std::size_t alignment = Alignment > alignof(T) ? Alignment : alignof(T);
+
+    template<typename U>
+    struct rebind {
+        using other = aligned_allocator<U, Alignment, H>;
+    };
+
+    aligned_allocator() = default;
+
+    template<typename U>
+    constexpr aligned_allocator(const aligned_allocator<U, Alignment, H>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(detail::allocate_aligned(n * sizeof(T), alignment, H));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        detail::deallocate_aligned(p, n * sizeof(T), alignment, H);
+    }
+
+    template<typename U>
+    constexpr bool operator==(const aligned_allocator<U, Alignment, H>&) const noexcept {
+        return true;
+    }
+};
+
+template<typename T, std::size_t Alignment = 64, huge_pages H = huge_pages::none>
+using aligned_vector = std::vector<T, aligned_allocator<T, Alignment, H>>;
+
+// =============================================================================
+// First-touch allocation
+// =============================================================================
+
+// Operating systems place a page of memory on the NUMA node of the thread
+// that first writes to it. A std::vector<double>(n) zero-fills its elements
+// on the allocating thread, so on a multi-socket node every page lands on
+// one socket, and parallel loops then read remote memory.
+
+// Allocator adaptor whose construct() with no arguments default-initializes
+// rather than value-initializes, so std::vector<T, default_init_allocator<T>>(n)
+// leaves trivially constructible elements, and their pages, untouched
+template<typename T, typename A = std::allocator<T>>
+struct default_init_allocator : A {
+    using A::A;
+
+    template<typename U>
+    struct rebind {
+        using other = default_init_allocator<U, typename std::allocator_traits<A>::template rebind_alloc<U>>;
+    };
+
+    template<typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        std::allocator_traits<A>::construct(static_cast<A&>(*this), p, std::forward<Args>(args)...);
+    }
+};
+
+template<typename T>
+using first_touch_vector = std::vector<T, default_init_allocator<T>>;
+
+// A buffer over space whose element at each index is init(index), written by
+// the executor's workers. With static chunking, every page is first touched
+// by the worker that a later for_each over space with the same executor
+// assigns it to, and with an affinity set (or a persistent team_t), that
+// worker stays on the same CPU, so each worker's data is local to its socket.
+template<typename T, std::size_t S, typename F, Executor E>
+first_touch_vector<T> first_touch(const index_space_t<S>& space, F init, const E& e) {
+    auto result = first_touch_vector<T>(size(space));
+    auto data = result.data();
+
+    for_each(space, [data, space, init](const ivec_t<S>& index) {
+        data[ndoffset(space, index)] = init(index);
+    }, e);
+    return result;
+}
+
+// =============================================================================
+// Arenas
+// =============================================================================
+
+// A bump allocator for temporaries with a common lifetime, such as the flux
+// arrays and reconstructed states of one time step. Allocation advances a
+// pointer through a block; nothing is freed until reset(), which releases
+// everything at once. After a reset that followed growth, the arena holds
+// one block as large as all of its previous blocks, so a workload that
+// repeats every step reaches a steady state with no calls to malloc or free.
+// An arena is not thread-safe; use one per thread that allocates from it.
+struct arena_t {
+    struct block_t {
+        std::byte* _data;
+        std::size_t _size;
+    };
+    std::vector<block_t> _blocks;
+    std::size_t _used = 0;                       // bytes used in the last block
+    std::size_t _block_size = std::size_t(1) << 20;
+
+    arena_t() = default;
+    explicit arena_t(std::size_t block_size) : _block_size(block_size) {}
+    ~arena_t() {
+        for (auto& b : _blocks) {
+            ::operator delete(b._data, std::align_val_t(detail::arena_alignment));
+        }
+    }
+    arena_t(const arena_t&) = delete;
+    arena_t& operator=(const arena_t&) = delete;
+};
+
+// Total size of an arena's blocks
+inline std::size_t capacity(const arena_t& a) {
+    auto total = std::size_t(0);
+    for (const auto& b : a._blocks) {
+        total += b._size;
+    }
+    return total;
+}
+
+// Bytes of storage for a new object, aligned to alignment (at most 64)
+inline void* allocate(arena_t& a, std::size_t bytes, std::size_t alignment) {
+    if (alignment > detail::arena_alignment || (alignment & (alignment - 1)) != 0) {
+        throw std::runtime_error("arena: alignment must be a power of two no larger than 64");
+    }
+    if (!a._blocks.empty()) {
+        auto& b = a._blocks.back();
+        auto offset = detail::round_up(a._used, alignment);
+
+        if (offset <= b._size && bytes <= b._size - offset) {
+            a._used = offset + bytes;
+            return b._data + offset;
+        }
+    }
+    auto size = std::max(a._block_size, detail::round_up(bytes, detail::arena_alignment));
+    auto data = static_cast<std::byte*>(::operator new(size, std::align_val_t(detail::arena_alignment)));
+    a._blocks.push_back({data, size});
+    a._used = bytes;
+    return data;
+}
+
+// Release everything allocated from the arena
+inline void reset(arena_t& a) {
+    if (a._blocks.size() > 1) {
+        auto size = capacity(a);
+        for (auto& b : a._blocks) {
+            ::operator delete(b._data, std::align_val_t(detail::arena_alignment));
+        }
+        a._blocks.clear();
+        auto data = static_cast<std::byte*>(::operator new(size, std::align_val_t(detail::arena_alignment)));
+        a._blocks.push_back({data, size});
+    }
+    a._used = 0;
+}
+
+// Allocator drawing from an arena; deallocation is a no-op, and storage is
+// reclaimed by resetting the arena. With no arena, it uses the heap.
+template<typename T>
+struct arena_allocator {
+    using value_type = T;
+
+    arena_t* _arena = nullptr;
+
+    arena_allocator() = default;
+    constexpr explicit arena_allocator(arena_t* arena) noexcept : _arena(arena) {}
+
+    template<typename U>
+    constexpr arena_allocator(const arena_allocator<U>& other) noexcept : _arena(other._arena) {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        if (_arena) {
+            return static_cast<T*>(mist::allocate(*_arena, n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        if (!_arena) {
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        }
+    }
+
+    template<typename U>
+    constexpr bool operator==(const arena_allocator<U>& other) const noexcept {
+        return _arena == other._arena;
+    }
+};
+
+template<typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+namespace detail {
+    inline arena_t*& current_arena() {
+        thread_local arena_t* arena = nullptr;
+        return arena;
+    }
+}
+
+// The arena installed on this thread by an arena_scope_t, e.g. the driver's
+// per-step arena while a step runs, or nullptr
+inline arena_t* current_arena() {
+    return detail::current_arena();
+}
+
+// Install an arena on this thread for the scope's lifetime
+struct arena_scope_t {
+    arena_t* _previous;
+
+    explicit arena_scope_t(arena_t& arena) : _previous(detail::current_arena()) {
+        detail::current_arena() = &arena;
+    }
+    ~arena_scope_t() {
+        detail::current_arena() = _previous;
+    }
+    arena_scope_t(const arena_scope_t&) = delete;
+    arena_scope_t& operator=(const arena_scope_t&) = delete;
+};
+
+// A temporary vector of n values from the current arena (or the heap if
+// there is none). It must not outlive the arena's next reset, so it should
+// never be stored in a state.
+template<typename T>
+arena_vector<T> scratch(std::size_t n, const T& value = T()) {
+    return arena_vector<T>(n, value, arena_allocator<T>(current_arena()));
+}
+
+} // namespace mist
@@ -0,0 +1,575 @@
+#pragma once
+
+#include <mpi.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "core.hpp"
+#include "array.hpp"
+#include "balance.hpp"
+#include "boundary.hpp"
+#include "shards.hpp"
+
+// Distributed-memory execution over MPI. This header is optional: nothing
+// else in mist includes it, so only programs that include it need to be
+// compiled with an MPI compiler wrapper (e.g. mpicxx) and launched with
+// mpirun. All MPI calls are made from the thread that calls into this
+// header, so MPI_THREAD_FUNNELED suffices alongside threaded executors.
+
+namespace mist {
+
+// =============================================================================
+// Environment
+// =============================================================================
+
+// Initializes MPI for the scope's lifetime, unless it is already initialized
+struct mpi_environment_t {
+    bool _owner = false;
+
+    mpi_environment_t(int& argc, char**& argv) {
+        auto initialized = 0;
+        MPI_Initialized(&initialized);
+
+        if (!initialized) {
+            auto provided = 0;
+            MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+            _owner = true;
+        }
+    }
+    ~mpi_environment_t() {
+        if (_owner) {
+            MPI_Finalize();
+        }
+    }
+    mpi_environment_t(const mpi_environment_t&) = delete;
+    mpi_environment_t& operator=(const mpi_environment_t&) = delete;
+};
+
+inline int comm_rank(MPI_Comm comm) {
+    auto rank = 0;
+    MPI_Comm_rank(comm, &rank);
+    return rank;
+}
+
+inline int comm_size(MPI_Comm comm) {
+    auto size = 0;
+    MPI_Comm_size(comm, &size);
+    return size;
+}
+
+// =============================================================================
+// Domain decomposition
+// =============================================================================
+
+// A global index space divided into a grid of _blocks rectangular
+// subspaces, one per rank of _comm, with blocks numbered in row-major order.
+// Along each axis the zones are dealt out as evenly as possible, the first
+// (n % blocks) blocks getting one extra zone. Along a periodic axis, the
+// first and last blocks are neighbors.
+template<std::size_t S>
+struct decomposition_t {
+    index_space_t<S> _global;
+    uvec_t<S> _blocks;
+    std::array<bool, S> _periodic;
+    MPI_Comm _comm;
+    int _rank;
+};
+
+// Decompose global over the ranks of comm, using the factorization of the
+// rank count chosen by MPI_Dims_create (as close to cubic as possible)
+template<std::size_t S>
+decomposition_t<S> decompose(const index_space_t<S>& global, MPI_Comm comm = MPI_COMM_WORLD, const std::array<bool, S>& periodic = {}) {
+    auto dims = std::array<int, S>{};
+    MPI_Dims_create(comm_size(comm), static_cast<int>(S), dims.data());
+
+    auto d = decomposition_t<S>{global, {}, periodic, comm, comm_rank(comm)};
+
+    for (std::size_t a = 0; a < S; ++a) {
+        d._blocks._data[a] = static_cast<unsigned int>(dims[a]);
+
+        if (global._shape._data[a] < d._blocks._data[a]) {
+            throw std::runtime_error("decompose: more blocks than zones along axis " + std::to_string(a));
+        }
+    }
+    return d;
+}
+
+// Grid coordinates of the block owned by a rank
+template<std::size_t S>
+uvec_t<S> block_coordinates(const decomposition_t<S>& d, int rank) {
+    auto coords = uvec_t<S>{};
+    auto r = static_cast<unsigned int>(rank);
+
+    for (std::size_t a = S; a-- > 0;) {
+        coords._data[a] = r % d._blocks._data[a];
+        r /= d._blocks._data[a];
+    }
+    return coords;
+}
+
+// Rank owning the block at the given grid coordinates
+template<std::size_t S>
+int block_rank(const decomposition_t<S>& d, const uvec_t<S>& coords) {
+    auto rank = 0u;
+    for (std::size_t a = 0; a < S; ++a) {
+        rank = rank * d._blocks._data[a] + coords._data[a];
+    }
+    return static_cast<int>(rank);
+}
+
+// The subspace of the global space owned by a rank
+template<std::size_t S>
+index_space_t<S> subspace(const decomposition_t<S>& d, int rank) {
+    auto coords = block_coordinates(d, rank);
+    auto result = d._global;
+
+    for (std::size_t a = 0; a < S; ++a) {
+        auto n = d._global._shape._data[a];
+        auto b = d._blocks._data[a];
+        auto c = coords._data[a];
+        auto extra = n % b;
+        result._start._data[a] += static_cast<int>(c * (n / b) + std::min(c, extra));
+        result._shape._data[a] = n / b + (c < extra ? 1 : 0);
+    }
+    return result;
+}
+
+// The subspace owned by the calling rank
+template<std::size_t S>
+index_space_t<S> local_space(const decomposition_t<S>& d) {
+    return subspace(d, d._rank);
+}
+
+// The subspaces of every rank, and the calling rank's shard, for writing
+// sharded output (a ShardedPhysics can return this from shard_layout)
+template<std::size_t S>
+shard_layout_t<S> shard_layout(const decomposition_t<S>& d) {
+    auto layout = shard_layout_t<S>{d._global, {}, static_cast<std::size_t>(d._rank)};
+
+    for (int r = 0; r < comm_size(d._comm); ++r) {
+        layout._spaces.push_back(subspace(d, r));
+    }
+    return layout;
+}
+
+// Rank of the block displaced from the calling rank's block by offset
+// (components -1, 0 or 1), or MPI_PROC_NULL past a non-periodic edge
+template<std::size_t S>
+int neighbor(const decomposition_t<S>& d, const ivec_t<S>& offset) {
+    auto coords = block_coordinates(d, d._rank);
+
+    for (std::size_t a = 0; a < S; ++a) {
+        auto b = static_cast<int>(d._blocks._data[a]);
+        auto c = static_cast<int>(coords._data[a]) + offset._data[a];
+
+        if (c < 0 || c >= b) {
+            if (!d._periodic[a]) {
+                return MPI_PROC_NULL;
+            }
+            c = (c + b) % b;
+        }
+        coords._data[a] = static_cast<unsigned int>(c);
+    }
+    return block_rank(d, coords);
+}
+
+// =============================================================================
+// Halo exchange
+// =============================================================================
+
+// A halo is the ghost shell of a rank's local space that lies inside the
+// blocks of its neighbors (across a periodic axis, inside the wrapped
+// global space). Halo exchange is split-phase: begin_halo_exchange posts a
+// nonblocking receive and send for each of the up to 3^S - 1 neighbors,
+// covering faces, edges and corners at once, and finish_halo_exchange
+// waits for them and unpacks the received zones. Work that does not read
+// the halo can run in between.
+template<typename T, std::size_t S>
+struct halo_exchange_t {
+    array_view_t<T, S> _view;
+    std::vector<index_space_t<S>> _recv_regions;
+    std::vector<std::vector<T>> _recv_buffers;
+    std::vector<std::vector<T>> _send_buffers;
+    std::vector<MPI_Request> _requests;
+};
+
+namespace detail {
+    template<std::size_t S>
+    int direction_tag(const ivec_t<S>& offset) {
+        auto tag = 0;
+        for (std::size_t a = 0; a < S; ++a) {
+            tag = tag * 3 + offset._data[a] + 1;
+        }
+        return tag;
+    }
+
+    // Ghost depths below and above local along each axis; every rank must
+    // have the same depths, and they may be no larger than any block
+    template<std::size_t S>
+    std::pair<uvec_t<S>, uvec_t<S>> ghost_depths(const decomposition_t<S>& d, const index_space_t<S>& padded, const index_space_t<S>& local) {
+        auto lo = uvec_t<S>{};
+        auto hi = uvec_t<S>{};
+
+        if (intersect(padded, local) != local) {
+            throw std::runtime_error("halo exchange: the view must contain the local space");
+        }
+        for (std::size_t a = 0; a < S; ++a) {
+            lo._data[a] = static_cast<unsigned int>(local._start._data[a] - padded._start._data[a]);
+            hi._data[a] = padded._shape._data[a] - local._shape._data[a] - lo._data[a];
+
+            if (std::max(lo._data[a], hi._data[a]) > d._global._shape._data[a] / d._blocks._data[a]) {
+                throw std::runtime_error("halo exchange: ghost layer is deeper than the smallest block");
+            }
+        }
+        return {lo, hi};
+    }
+
+    // The local space less depth zones on each side
+    template<std::size_t S>
+    index_space_t<S> shrink(const index_space_t<S>& space, const uvec_t<S>& lo, const uvec_t<S>& hi) {
+        auto result = space;
+        for (std::size_t a = 0; a < S; ++a) {
+            auto n = space._shape._data[a];
+            result._start._data[a] += static_cast<int>(std::min(lo._data[a], n));
+            result._shape._data[a] = n - std::min(n, lo._data[a] + hi._data[a]);
+        }
+        return result;
+    }
+}
+
+// Post the messages exchanging the halo of u, a view whose domain is the
+// calling rank's local space plus a ghost shell
+template<typename T, std::size_t S>
+halo_exchange_t<T, S> begin_halo_exchange(const decomposition_t<S>& d, const array_view_t<T, S>& u) {
+    static_assert(std::is_trivially_copyable_v<T>, "halo exchange sends values as bytes");
+
+    auto local = local_space(d);
+    auto padded = domain(u);
+    auto [lo_depth, hi_depth] = detail::ghost_depths(d, padded, local);
+    auto h = halo_exchange_t<T, S>{u, {}, {}, {}, {}};
+
+    for (const auto& region : detail::ghost_regions(padded, local)) {
+        // The neighbor in the region's direction fills this region, and is
+        // sent the zones of local that fill its ghost region facing back
+        auto offset = ivec_t<S>{};
+        auto source = local;
+
+        for (std::size_t a = 0; a < S; ++a) {
+            auto x = region._start._data[a];
+            auto l = local._start._data[a];
+            auto n = static_cast<int>(local._shape._data[a]);
+
+            if (x < l) {
+                offset._data[a] = -1;
+                source._shape._data[a] = hi_depth._data[a];
+            } else if (x >= l + n) {
+                offset._data[a] = 1;
+                source._start._data[a] = l + n - static_cast<int>(lo_depth._data[a]);
+                source._shape._data[a] = lo_depth._data[a];
+            }
+        }
+        auto rank = neighbor(d, offset);
+
+        if (rank == MPI_PROC_NULL) {
+            continue;
+        }
+        auto& recv = h._recv_buffers.emplace_back(size(region));
+        auto& send = h._send_buffers.emplace_back();
+        send.reserve(size(source));
+
+        for (auto i : source) {
+            send.push_back(ndread(u, i));
+        }
+        h._recv_regions.push_back(region);
+        h._requests.emplace_back();
+        MPI_Irecv(recv.data(), static_cast<int>(recv.size() * sizeof(T)), MPI_BYTE, rank, detail::direction_tag(-1 * offset), d._comm, &h._requests.back());
+        h._requests.emplace_back();
+        MPI_Isend(send.data(), static_cast<int>(send.size() * sizeof(T)), MPI_BYTE, rank, detail::direction_tag(offset), d._comm, &h._requests.back());
+    }
+    return h;
+}
+
+// Wait for the messages of a halo exchange and write the received zones
+template<typename T, std::size_t S>
+void finish_halo_exchange(halo_exchange_t<T, S>& h) {
+    MPI_Waitall(static_cast<int>(h._requests.size()), h._requests.data(), MPI_STATUSES_IGNORE);
+    h._requests.clear();
+
+    for (std::size_t k = 0; k < h._recv_regions.size(); ++k) {
+        auto n = std::size_t(0);
+        for (auto i : h._recv_regions[k]) {
+            ndwrite(h._view, i, h._recv_buffers[k][n++]);
+        }
+    }
+}
+
+namespace detail {
+    // Fill the ghost zones of u outside the global space along non-periodic
+    // axes, as fill_ghosts does for a single process. Their sources lie in
+    // the global space, in local or in a halo that was already exchanged.
+    template<typename T, std::size_t S, Executor E, typename R>
+    void fill_physical_ghosts(const decomposition_t<S>& d, const array_view_t<T, S>& u, const boundary_conditions_t<S>& bc, const E& e, R reflect) {
+        const auto& global = d._global;
+        auto outside = std::vector<index_space_t<S>>{};
+
+        for (const auto& region : ghost_regions(domain(u), local_space(d))) {
+            if (intersect(region, global) != region) {
+                outside.push_back(region);
+            }
+        }
+        for_each(outside, [&](const index_space_t<S>&, const ivec_t<S>& index) {
+            auto source = index;
+            auto mirrored = std::array<bool, S>{};
+            auto changed = false;
+
+            for (std::size_t a = 0; a < S; ++a) {
+                auto x = index._data[a];
+                auto lo = global._start._data[a];
+                auto n = static_cast<int>(global._shape._data[a]);
+
+                if (!d._periodic[a] && (x < lo || x >= lo + n)) {
+                    auto type = x < lo ? bc._lo[a] : bc._hi[a];
+                    source._data[a] = boundary_source(type, x, lo, n);
+                    mirrored[a] = type == boundary::reflecting;
+                    changed = true;
+                }
+            }
+            if (!changed) {
+                return;
+            }
+            auto value = ndread(u, source);
+
+            for (std::size_t a = 0; a < S; ++a) {
+                if (mirrored[a]) {
+                    value = reflect(value, a);
+                }
+            }
+            ndwrite(u, index, value);
+        }, e);
+    }
+
+    template<std::size_t S>
+    void check_boundaries(const decomposition_t<S>& d, const boundary_conditions_t<S>& bc) {
+        for (std::size_t a = 0; a < S; ++a) {
+            auto lo = bc._lo[a] == boundary::periodic;
+            auto hi = bc._hi[a] == boundary::periodic;
+
+            if (lo != d._periodic[a] || hi != d._periodic[a]) {
+                throw std::runtime_error("fill_ghosts: periodic boundaries must match the decomposition's periodic axes");
+            }
+        }
+    }
+}
+
+// Fill every ghost zone of u, a view over the calling rank's local space
+// plus a ghost shell: halo zones from the neighboring ranks, and zones
+// outside the global space from the boundary types bc, which must be
+// periodic exactly along the decomposition's periodic axes. This is the
+// distributed counterpart of fill_ghosts(u, interior, bc, e, reflect).
+template<typename T, std::size_t S, Executor E, typename R = no_reflect>
+void fill_ghosts(const decomposition_t<S>& d, const array_view_t<T, S>& u, const boundary_conditions_t<S>& bc, const E& e, R reflect = {}) {
+    detail::check_boundaries(d, bc);
+    auto h = begin_halo_exchange(d, u);
+    finish_halo_exchange(h);
+    detail::fill_physical_ghosts(d, u, bc, e, reflect);
+}
+
+template<typename T, std::size_t S>
+void fill_ghosts(const decomposition_t<S>& d, const array_view_t<T, S>& u, const boundary_conditions_t<S>& bc) {
+    fill_ghosts(d, u, bc, cpu_t{});
+}
+
+// Fill the ghost zones of u as fill_ghosts does, and call func(index) for
+// every index of the local space, where func may read u within the ghost
+// depth of index. The messages are in flight while func runs over the
+// zones at least one ghost depth inside the local space, which never read
+// a ghost zone; the rim of the local space runs after they arrive.
+template<typename T, std::size_t S, typename F, Executor E, typename R = no_reflect>
+void for_each_exchanging(const decomposition_t<S>& d, const array_view_t<T, S>& u, const boundary_conditions_t<S>& bc, F&& func, const E& e, R reflect = {}) {
+    detail::check_boundaries(d, bc);
+
+    auto local = local_space(d);
+    auto [lo_depth, hi_depth] = detail::ghost_depths(d, domain(u), local);
+    auto inner = detail::shrink(local, lo_depth, hi_depth);
+    auto h = begin_halo_exchange(d, u);
+
+    for_each(inner, func, e);
+    finish_halo_exchange(h);
+    detail::fill_physical_ghosts(d, u, bc, e, reflect);
+
+    for_each(detail::ghost_regions(local, inner), [&](const index_space_t<S>&, const ivec_t<S>& index) {
+        func(index);
+    }, e);
+}
+
+template<typename T, std::size_t S, typename F>
+void for_each_exchanging(const decomposition_t<S>& d, const array_view_t<T, S>& u, const boundary_conditions_t<S>& bc, F&& func) {
+    for_each_exchanging(d, u, bc, std::forward<F>(func), cpu_t{});
+}
+
+// =============================================================================
+// Global reductions
+// =============================================================================
+
+// Reduce one value per rank of comm, returning the same result on every
+// rank. Partial results are gathered and folded in rank order, so the
+// result is reproducible for any reduce_op, including non-commutative ones
+// and floating-point sums.
+template<typename T, typename ReduceF>
+T allreduce(MPI_Comm comm, const T& value, ReduceF&& reduce_op) {
+    static_assert(std::is_trivially_copyable_v<T>, "allreduce sends values as bytes");
+
+    auto values = std::vector<T>(static_cast<std::size_t>(comm_size(comm)), value);
+    MPI_Allgather(&value, sizeof(T), MPI_BYTE, values.data(), sizeof(T), MPI_BYTE, comm);
+
+    T result = values[0];
+    for (std::size_t r = 1; r < values.size(); ++r) {
+        result = reduce_op(result, values[r]);
+    }
+    return result;
+}
+
+// Reduce map(index) over the global space: each rank reduces its local
+// space with the executor, then the partial results are combined across
+// ranks. As for a single process, init enters the reduction exactly once,
+// so e.g. a courant_time that reduces with this overload returns the
+// global time step on every rank.
+template<std::size_t S, typename T, typename MapF, typename ReduceF, Executor E>
+T map_reduce(const decomposition_t<S>& d, T init, MapF&& map, ReduceF&& reduce_op, const E& e) {
+    static_assert(std::is_trivially_copyable_v<T>, "map_reduce sends values as bytes");
+
+    struct partial_t {
+        bool _valid;
+        T _value;
+    };
+    auto local = map_reduce(local_space(d), std::optional<T>{}, [&](const ivec_t<S>& index) {
+        return std::optional<T>(map(index));
+    }, [&](const std::optional<T>& a, const std::optional<T>& b) {
+        return a && b ? std::optional<T>(reduce_op(*a, *b)) : a ? a : b;
+    }, e);
+
+    auto partials = std::vector<partial_t>(static_cast<std::size_t>(comm_size(d._comm)));
+    auto mine = partial_t{local.has_value(), local ? *local : init};
+    MPI_Allgather(&mine, sizeof(partial_t), MPI_BYTE, partials.data(), sizeof(partial_t), MPI_BYTE, d._comm);
+
+    T result = init;
+    for (const auto& p : partials) {
+        if (p._valid) result = reduce_op(result, p._value);
+    }
+    return result;
+}
+
+template<std::size_t S, typename T, typename MapF, typename ReduceF>
+T map_reduce(const decomposition_t<S>& d, T init, MapF&& map, ReduceF&& reduce_op) {
+    return map_reduce(d, init, std::forward<MapF>(map), std::forward<ReduceF>(reduce_op), cpu_t{});
+}
+
+// =============================================================================
+// Sharded I/O
+// =============================================================================
+
+// Write value(index) over the global space with each rank writing the
+// shard of its local space in parallel, and rank 0 the manifest; returns
+// on every rank once the output is complete
+template<typename T, std::size_t S, typename F>
+void write_shards(const decomposition_t<S>& d, const std::string& prefix, F value) {
+    static_assert(std::is_arithmetic_v<T>, "sharded arrays hold arithmetic values");
+
+    auto layout = shard_layout(d);
+    auto local = layout._spaces[layout._shard];
+    auto data = std::vector<T>{};
+    data.reserve(size(local));
+
+    for (auto i : local) {
+        data.push_back(value(i));
+    }
+    write_shard(shard_filename(prefix, layout._shard), local, "data", data);
+    MPI_Barrier(d._comm);
+
+    if (d._rank == 0) {
+        write_manifest(manifest_filename(prefix), make_manifest(prefix, d._global, layout._spaces));
+    }
+    MPI_Barrier(d._comm);
+}
+
+// The calling rank's local space, read from sharded output. The output
+// may have been written by any number of ranks (or by write_shards on a
+// single process); each rank reads only the shards that overlap it.
+template<typename T, std::size_t S>
+std::vector<T> read_shards(const decomposition_t<S>& d, const std::string& manifest_file) {
+    return read_shards<T>(manifest_file, local_space(d));
+}
+
+// =============================================================================
+// Patch load balancing
+// =============================================================================
+
+// Reassign patches to ranks by measured cost. Every rank passes the same
+// spaces and owner (the rank of each patch), and cost holding the times it
+// measured for the patches it owns; entries for other patches are ignored.
+// Returns the new owner of each patch, the same on every rank: patches cut
+// into runs along the curve, or owner unchanged if the policy finds the
+// migration not worthwhile.
+template<std::size_t S>
+std::vector<std::size_t> rebalance(
+    MPI_Comm comm,
+    const std::vector<index_space_t<S>>& spaces,
+    const std::vector<double>& cost,
+    const std::vector<std::size_t>& owner,
+    const balance_policy_t& policy = {})
+{
+    auto rank = static_cast<std::size_t>(comm_rank(comm));
+    auto measured = std::vector<double>(spaces.size(), 0.0);
+
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        if (owner[k] == rank) measured[k] = cost[k];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, measured.data(), static_cast<int>(measured.size()), MPI_DOUBLE, MPI_SUM, comm);
+    return rebalance(spaces, measured, owner, static_cast<std::size_t>(comm_size(comm)), policy);
+}
+
+// Move the data of each patch from its old owner to its new one. data[k]
+// holds patch k's buffer on the rank that owns it (and is empty elsewhere);
+// afterwards it does so for the new owners.
+template<typename T>
+void migrate(MPI_Comm comm, const std::vector<std::size_t>& owner, const std::vector<std::size_t>& next, std::vector<std::vector<T>>& data) {
+    static_assert(std::is_trivially_copyable_v<T>, "migrate sends values as bytes");
+
+    auto rank = static_cast<std::size_t>(comm_rank(comm));
+    auto requests = std::vector<MPI_Request>{};
+    constexpr auto tag = 0;
+
+    // Messages between two ranks arrive in the order they were sent, so
+    // patches sent in increasing order are received in increasing order
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        if (owner[k] == rank && next[k] != rank) {
+            requests.emplace_back();
+            MPI_Isend(data[k].data(), static_cast<int>(data[k].size() * sizeof(T)), MPI_BYTE, static_cast<int>(next[k]), tag, comm, &requests.back());
+        }
+    }
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        if (next[k] == rank && owner[k] != rank) {
+            auto status = MPI_Status{};
+            auto bytes = 0;
+            MPI_Probe(static_cast<int>(owner[k]), tag, comm, &status);
+            MPI_Get_count(&status, MPI_BYTE, &bytes);
+            data[k].resize(static_cast<std::size_t>(bytes) / sizeof(T));
+            MPI_Recv(data[k].data(), bytes, MPI_BYTE, static_cast<int>(owner[k]), tag, comm, MPI_STATUS_IGNORE);
+        }
+    }
+    MPI_Waitall(static_cast<int>(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        if (owner[k] == rank && next[k] != rank) {
+            data[k] = std::vector<T>{};
+        }
+    }
+}
+
+} // namespace mist
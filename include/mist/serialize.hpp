@@ -1,6 +1,7 @@
 #pragma once
 
 #include <concepts>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <type_traits>
@@ -114,13 +115,16 @@ void serialize(A& ar, const char* name, const std::string& value);
 template<ArchiveWriter A, typename T, std::size_t N>
 void serialize(A& ar, const char* name, const vec_t<T, N>& value);
 
-template<ArchiveWriter A, typename T>
+template<ArchiveWriter A, typename T, typename Alloc>
     requires std::is_arithmetic_v<T>
-void serialize(A& ar, const char* name, const std::vector<T>& value);
+void serialize(A& ar, const char* name, const std::vector<T, Alloc>& value);
 
-template<ArchiveWriter A, typename T>
+template<ArchiveWriter A, typename T, std::size_t N, typename Alloc>
+void serialize(A& ar, const char* name, const std::vector<vec_t<T, N>, Alloc>& value);
+
+template<ArchiveWriter A, typename T, typename Alloc>
     requires HasConstFields<T>
-void serialize(A& ar, const char* name, const std::vector<T>& value);
+void serialize(A& ar, const char* name, const std::vector<T, Alloc>& value);
 
 template<ArchiveWriter A, typename T>
     requires HasConstFields<T>
@@ -140,13 +144,16 @@ void deserialize(A& ar, const char* name, std::string& value);
 template<ArchiveReader A, typename T, std::size_t N>
 void deserialize(A& ar, const char* name, vec_t<T, N>& value);
 
-template<ArchiveReader A, typename T>
+template<ArchiveReader A, typename T, typename Alloc>
     requires std::is_arithmetic_v<T>
-void deserialize(A& ar, const char* name, std::vector<T>& value);
+void deserialize(A& ar, const char* name, std::vector<T, Alloc>& value);
 
-template<ArchiveReader A, typename T>
+template<ArchiveReader A, typename T, std::size_t N, typename Alloc>
+void deserialize(A& ar, const char* name, std::vector<vec_t<T, N>, Alloc>& value);
+
+template<ArchiveReader A, typename T, typename Alloc>
     requires HasFields<T>
-void deserialize(A& ar, const char* name, std::vector<T>& value);
+void deserialize(A& ar, const char* name, std::vector<T, Alloc>& value);
 
 template<ArchiveReader A, typename T>
     requires HasFields<T>
@@ -175,17 +182,30 @@ void serialize(A& ar, const char* name, const vec_t<T, N>& value) {
     ar.write_array(name, value);
 }
 
-// std::vector<T> where T is arithmetic
-template<ArchiveWriter A, typename T>
+// std::vector<T, Alloc> where T is arithmetic
+template<ArchiveWriter A, typename T, typename Alloc>
     requires std::is_arithmetic_v<T>
-void serialize(A& ar, const char* name, const std::vector<T>& value) {
+void serialize(A& ar, const char* name, const std::vector<T, Alloc>& value) {
     ar.write_array(name, value);
 }
 
-// std::vector<T> where T is a compound type
-template<ArchiveWriter A, typename T>
+// std::vector<vec_t<T, N>, Alloc>, as one flat array of T
+template<ArchiveWriter A, typename T, std::size_t N, typename Alloc>
+void serialize(A& ar, const char* name, const std::vector<vec_t<T, N>, Alloc>& value) {
+    auto flat = std::vector<T>{};
+    flat.reserve(N * value.size());
+    for (const auto& v : value) {
+        for (std::size_t i = 0; i < N; ++i) {
+            flat.push_back(v[i]);
+        }
+    }
+    ar.write_array(name, flat);
+}
+
+// std::vector<T, Alloc> where T is a compound type
+template<ArchiveWriter A, typename T, typename Alloc>
     requires HasConstFields<T>
-void serialize(A& ar, const char* name, const std::vector<T>& value) {
+void serialize(A& ar, const char* name, const std::vector<T, Alloc>& value) {
     ar.begin_group(name);
     for (const auto& elem : value) {
         ar.begin_group();
@@ -231,17 +251,33 @@ void deserialize(A& ar, const char* name, vec_t<T, N>& value) {
     ar.read_array(name, value);
 }
 
-// std::vector<T> where T is arithmetic
-template<ArchiveReader A, typename T>
+// std::vector<T, Alloc> where T is arithmetic
+template<ArchiveReader A, typename T, typename Alloc>
     requires std::is_arithmetic_v<T>
-void deserialize(A& ar, const char* name, std::vector<T>& value) {
+void deserialize(A& ar, const char* name, std::vector<T, Alloc>& value) {
     ar.read_array(name, value);
 }
 
-// std::vector<T> where T is a compound type
-template<ArchiveReader A, typename T>
+// std::vector<vec_t<T, N>, Alloc>, from one flat array of T
+template<ArchiveReader A, typename T, std::size_t N, typename Alloc>
+void deserialize(A& ar, const char* name, std::vector<vec_t<T, N>, Alloc>& value) {
+    auto flat = std::vector<T>{};
+    ar.read_array(name, flat);
+    if (flat.size() % N != 0) {
+        throw std::runtime_error("deserialize: array '" + std::string(name) + "' does not hold whole vectors");
+    }
+    value.resize(flat.size() / N);
+    for (std::size_t n = 0; n < value.size(); ++n) {
+        for (std::size_t i = 0; i < N; ++i) {
+            value[n][i] = flat[n * N + i];
+        }
+    }
+}
+
+// std::vector<T, Alloc> where T is a compound type
+template<ArchiveReader A, typename T, typename Alloc>
     requires HasFields<T>
-void deserialize(A& ar, const char* name, std::vector<T>& value) {
+void deserialize(A& ar, const char* name, std::vector<T, Alloc>& value) {
     std::size_t count = ar.count_groups(name);
     ar.begin_group(name);
     value.resize(count);
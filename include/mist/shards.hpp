@@ -0,0 +1,314 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "core.hpp"
+#include "serialize.hpp"
+#include "ascii_reader.hpp"
+#include "ascii_writer.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Shard manifests
+// =============================================================================
+
+// Output of a global index space written as shards: one file per subspace,
+// each written independently (by a rank, or by a worker of an executor),
+// and a small manifest naming the files and the subspaces they cover.
+// Since the manifest records the layout, a reader can reassemble any
+// subspace from the shards that overlap it, so a run can restart on a
+// different number of ranks than wrote its checkpoint.
+
+template<std::size_t S>
+struct shard_t {
+    ivec_t<S> start;
+    uvec_t<S> shape;
+    std::string file;  // relative to the manifest's directory
+
+    auto fields() const {
+        return std::make_tuple(
+            field("start", start),
+            field("shape", shape),
+            field("file", file)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("start", start),
+            field("shape", shape),
+            field("file", file)
+        );
+    }
+};
+
+template<std::size_t S>
+struct manifest_t {
+    ivec_t<S> start;  // the global space
+    uvec_t<S> shape;
+    std::vector<shard_t<S>> shards;
+
+    auto fields() const {
+        return std::make_tuple(
+            field("start", start),
+            field("shape", shape),
+            field("shards", shards)
+        );
+    }
+
+    auto fields() {
+        return std::make_tuple(
+            field("start", start),
+            field("shape", shape),
+            field("shards", shards)
+        );
+    }
+};
+
+template<std::size_t S>
+index_space_t<S> global_space(const manifest_t<S>& m) {
+    return index_space(m.start, m.shape);
+}
+
+template<std::size_t S>
+index_space_t<S> shard_space(const shard_t<S>& s) {
+    return index_space(s.start, s.shape);
+}
+
+// File names for output prefix: prefix.manifest, and prefix.NNNN.dat for
+// shard NNNN
+inline std::string manifest_filename(const std::string& prefix) {
+    return prefix + ".manifest";
+}
+
+inline std::string shard_filename(const std::string& prefix, std::size_t shard) {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%04zu.dat", shard);
+    return prefix + suffix;
+}
+
+namespace detail {
+    // Shards may leave zones of the global space unwritten, but must not
+    // write any zone twice, or readers would race to assemble it
+    template<std::size_t S>
+    void check_disjoint_shards(const manifest_t<S>& m, const char* caller) {
+        for (std::size_t a = 0; a < m.shards.size(); ++a) {
+            for (std::size_t b = a + 1; b < m.shards.size(); ++b) {
+                if (size(intersect(shard_space(m.shards[a]), shard_space(m.shards[b]))) > 0) {
+                    throw std::runtime_error(std::string(caller) + ": shards " + std::to_string(a) + " and " + std::to_string(b) + " overlap");
+                }
+            }
+        }
+    }
+}
+
+// The manifest of shards over spaces, numbered in order, for output prefix.
+// Throws std::runtime_error if a space is outside global, or if two overlap.
+template<std::size_t S>
+manifest_t<S> make_manifest(const std::string& prefix, const index_space_t<S>& global, const std::vector<index_space_t<S>>& spaces) {
+    auto m = manifest_t<S>{global._start, global._shape, {}};
+    auto name = std::filesystem::path(prefix).filename().string();
+
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        if (intersect(spaces[k], global) != spaces[k]) {
+            throw std::runtime_error("make_manifest: shard " + std::to_string(k) + " is outside the global space");
+        }
+        m.shards.push_back(shard_t<S>{spaces[k]._start, spaces[k]._shape, shard_filename(name, k)});
+    }
+    detail::check_disjoint_shards(m, "make_manifest");
+    return m;
+}
+
+template<std::size_t S>
+void write_manifest(const std::string& filename, const manifest_t<S>& m) {
+    auto file = std::ofstream(filename);
+    auto writer = ascii_writer(file);
+    serialize(writer, "manifest", m);
+
+    if (!file) {
+        throw std::runtime_error("write_manifest: could not write " + filename);
+    }
+}
+
+template<std::size_t S>
+manifest_t<S> read_manifest(const std::string& filename) {
+    auto file = std::ifstream(filename);
+
+    if (!file) {
+        throw std::runtime_error("read_manifest: could not open " + filename);
+    }
+    auto reader = ascii_reader(file);
+    auto m = manifest_t<S>{};
+    deserialize(reader, "manifest", m);
+    detail::check_disjoint_shards(m, "read_manifest");
+    return m;
+}
+
+// The subspace of every shard of a decomposition, and the one shard that a
+// process (or a state) holds
+template<std::size_t S>
+struct shard_layout_t {
+    index_space_t<S> _global;
+    std::vector<index_space_t<S>> _spaces;
+    std::size_t _shard;
+};
+
+// Indices of the shards that overlap space
+template<std::size_t S>
+std::vector<std::size_t> overlapping_shards(const manifest_t<S>& m, const index_space_t<S>& space) {
+    auto result = std::vector<std::size_t>{};
+    for (std::size_t k = 0; k < m.shards.size(); ++k) {
+        if (size(intersect(shard_space(m.shards[k]), space)) > 0) {
+            result.push_back(k);
+        }
+    }
+    return result;
+}
+
+// Path of shard k, for a manifest read from manifest_file
+template<std::size_t S>
+std::string shard_path(const manifest_t<S>& m, const std::string& manifest_file, std::size_t k) {
+    return (std::filesystem::path(manifest_file).parent_path() / m.shards[k].file).string();
+}
+
+// =============================================================================
+// Shard files
+// =============================================================================
+
+namespace detail {
+    // Write a shard file holding space, then whatever write_value(writer)
+    // writes
+    template<std::size_t S, typename F>
+    void write_shard_file(const std::string& filename, const index_space_t<S>& space, F write_value) {
+        auto file = std::ofstream(filename);
+        auto writer = ascii_writer(file);
+
+        writer.begin_group("shard");
+        writer.write_array("start", space._start);
+        writer.write_array("shape", space._shape);
+        write_value(writer);
+        writer.end_group();
+
+        if (!file) {
+            throw std::runtime_error("write_shard: could not write " + filename);
+        }
+    }
+}
+
+// A shard file holds its subspace, then a value named name, which may be
+// anything serializable: a row-major array over the subspace, or a whole
+// state covering it
+template<std::size_t S, typename T>
+void write_shard(const std::string& filename, const index_space_t<S>& space, const char* name, const T& value) {
+    detail::write_shard_file(filename, space, [&](ascii_writer& writer) {
+        serialize(writer, name, value);
+    });
+}
+
+// Read a shard file written by write_shard, returning its subspace
+template<std::size_t S, typename T>
+index_space_t<S> read_shard(const std::string& filename, const char* name, T& value) {
+    auto file = std::ifstream(filename);
+
+    if (!file) {
+        throw std::runtime_error("read_shard: could not open " + filename);
+    }
+    auto reader = ascii_reader(file);
+    auto space = index_space_t<S>{};
+
+    reader.begin_group("shard");
+    reader.read_array("start", space._start);
+    reader.read_array("shape", space._shape);
+    deserialize(reader, name, value);
+    reader.end_group();
+    return space;
+}
+
+// =============================================================================
+// Sharded arrays
+// =============================================================================
+
+// Write value(index) over global as one shard per space in spaces, named
+// "data" in each shard file, plus the manifest. The shards are written in
+// parallel, one per chunk of the executor, and the manifest last, so a
+// complete manifest implies complete shards.
+template<typename T, std::size_t S, typename F, Executor E>
+manifest_t<S> write_shards(const std::string& prefix, const index_space_t<S>& global, const std::vector<index_space_t<S>>& spaces, F value, const E& e) {
+    static_assert(std::is_arithmetic_v<T>, "sharded arrays hold arithmetic values");
+
+    auto m = make_manifest(prefix, global, spaces);
+
+    execute(e, spaces.size(), [&](std::size_t first, std::size_t last, std::size_t) {
+        for (auto k = first; k < last; ++k) {
+            auto data = std::vector<T>{};
+            data.reserve(size(spaces[k]));
+
+            for (auto i : spaces[k]) {
+                data.push_back(value(i));
+            }
+            write_shard(shard_filename(prefix, k), spaces[k], "data", data);
+        }
+    });
+    write_manifest(manifest_filename(prefix), m);
+    return m;
+}
+
+template<typename T, std::size_t S, typename F>
+manifest_t<S> write_shards(const std::string& prefix, const index_space_t<S>& global, const std::vector<index_space_t<S>>& spaces, F value) {
+    return write_shards<T>(prefix, global, spaces, value, cpu_t{});
+}
+
+// A row-major buffer over space, assembled from the "data" arrays of the
+// shards overlapping it, which are read in parallel. space may be any
+// subspace of the global space, whatever the partition that wrote it.
+// Since a manifest's shards are disjoint, each zone is read at most once.
+// Throws std::runtime_error if the shards do not cover space.
+template<typename T, std::size_t S, Executor E>
+std::vector<T> read_shards(const std::string& manifest_file, const index_space_t<S>& space, const E& e) {
+    auto m = read_manifest<S>(manifest_file);
+
+    if (intersect(space, global_space(m)) != space) {
+        throw std::runtime_error("read_shards: the space is outside the manifest's global space");
+    }
+    auto shards = overlapping_shards(m, space);
+    auto result = std::vector<T>(size(space));
+    auto covered = std::vector<std::size_t>(shards.size(), 0);
+
+    execute(e, shards.size(), [&](std::size_t first, std::size_t last, std::size_t) {
+        for (auto n = first; n < last; ++n) {
+            auto data = std::vector<T>{};
+            auto k = shards[n];
+            auto shard = read_shard<S>(shard_path(m, manifest_file, k), "data", data);
+
+            if (shard != shard_space(m.shards[k]) || data.size() != size(shard)) {
+                throw std::runtime_error("read_shards: shard " + m.shards[k].file + " does not match the manifest");
+            }
+            for (auto i : intersect(shard, space)) {
+                result[ndoffset(space, i)] = data[ndoffset(shard, i)];
+                covered[n]++;
+            }
+        }
+    });
+
+    auto total = std::size_t(0);
+    for (auto c : covered) {
+        total += c;
+    }
+    if (total != size(space)) {
+        throw std::runtime_error("read_shards: the shards do not cover the space");
+    }
+    return result;
+}
+
+template<typename T, std::size_t S>
+std::vector<T> read_shards(const std::string& manifest_file, const index_space_t<S>& space) {
+    return read_shards<T>(manifest_file, space, cpu_t{});
+}
+
+} // namespace mist
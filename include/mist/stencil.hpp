@@ -0,0 +1,299 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "core.hpp"
+#include "array.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Fused kernel pipelines
+// =============================================================================
+
+// One stage of a fused pipeline. The kernel is called as
+//
+//     kernel(index, out_0, out_1, ..., out_{k-1})
+//
+// where out_j is an array_view_t<const T_j, S> of the values computed by
+// stage j, and returns the stage's value of type T at index. _radius is the
+// farthest (in zones, along any axis) the kernel reads from index into the
+// outputs of earlier stages. The last stage of a pipeline has T = void; it
+// consumes the earlier outputs and writes its results to memory itself.
+template<typename T, typename F>
+struct stage_t {
+    F _kernel;
+    unsigned int _radius;
+};
+
+template<typename T, typename F>
+constexpr stage_t<T, F> stage(unsigned int radius, F kernel) {
+    return stage_t<T, F>{kernel, radius};
+}
+
+namespace detail {
+    // Whether two views of dense storage have elements in common
+    template<typename T, typename U, std::size_t S>
+    bool shares_storage(const array_view_t<T, S>& a, const array_view_t<U, S>& b) {
+        auto less = std::less<const void*>{};
+        const void* a_end = a._data + size(a._space);
+        const void* b_end = b._data + size(b._space);
+        return less(a._data, b_end) && less(b._data, a_end);
+    }
+
+    template<typename Stage> struct stage_value;
+    template<typename T, typename F> struct stage_value<stage_t<T, F>> { using type = T; };
+
+    template<typename Stage>
+    using stage_value_t = typename stage_value<Stage>::type;
+
+    // Scratch storage for one stage's output (unused for the final stage)
+    template<typename T>
+    using stage_buffer_t = std::vector<std::conditional_t<std::is_void_v<T>, char, T>>;
+
+    // Evaluate stage K and all later stages on one tile. Stage K is computed
+    // on the tile grown by halos[K], so that later stages can read neighbors.
+    template<std::size_t K, std::size_t S, typename Stages, typename Buffers, std::size_t N, typename... Views>
+    void run_fused_tile(
+        const index_space_t<S>& tile,
+        const Stages& stages,
+        Buffers& buffers,
+        const std::array<unsigned int, N>& halos,
+        const Views&... views)
+    {
+        const auto& st = std::get<K>(stages);
+
+        if constexpr (K + 1 == N) {
+            for (std::size_t n = 0; n < size(tile); ++n) {
+                st._kernel(ndindex(tile, n), views...);
+            }
+        } else {
+            using T = stage_value_t<std::tuple_element_t<K, Stages>>;
+            auto region = expand(tile, halos[K]);
+            auto& buffer = std::get<K>(buffers);
+
+            if (buffer.size() < size(region)) {
+                buffer.resize(size(region));
+            }
+            for (std::size_t n = 0; n < size(region); ++n) {
+                buffer[n] = st._kernel(ndindex(region, n), views...);
+            }
+            run_fused_tile<K + 1>(tile, stages, buffers, halos, views..., array_view_t<const T, S>{buffer.data(), region});
+        }
+    }
+}
+
+// Run a pipeline of stages over space in one traversal. The space is cut
+// into tiles of tile_shape, which are distributed over the executor's
+// workers. Within a tile, each stage is evaluated on the tile grown by the
+// summed radii of the stages after it, into per-worker scratch buffers that
+// stay in cache, so intermediate results never round-trip through main
+// memory. Neighbor values near tile edges are recomputed by each tile that
+// needs them. Stage 0 must therefore be valid on space grown by the summed
+// radii of all later stages (e.g. by reading from arrays with ghost zones).
+template<std::size_t S, Executor E, typename... Stages>
+    requires (sizeof...(Stages) > 0)
+void fused_for_each(const index_space_t<S>& space, const uvec_t<S>& tile_shape, const E& e, const Stages&... stages) {
+    constexpr std::size_t N = sizeof...(Stages);
+    using last_t = std::tuple_element_t<N - 1, std::tuple<Stages...>>;
+    static_assert(std::is_void_v<detail::stage_value_t<last_t>>, "the last stage of a pipeline must have value type void");
+
+    detail::check_tile_shape(tile_shape, "fused_for_each");
+
+    auto pipeline = std::tuple<Stages...>(stages...);
+    auto radii = std::array<unsigned int, N>{stages._radius...};
+    auto halos = std::array<unsigned int, N>{};
+
+    for (std::size_t k = N - 1; k > 0; --k) {
+        halos[k - 1] = halos[k] + radii[k];
+    }
+
+    using buffers_t = std::tuple<detail::stage_buffer_t<detail::stage_value_t<Stages>>...>;
+    auto scratch = std::vector<buffers_t>(num_workers(e));
+
+    execute(e, tile_count(space, tile_shape), [&](std::size_t first, std::size_t last, std::size_t worker) {
+        for (std::size_t n = first; n < last; ++n) {
+            detail::run_fused_tile<0>(tile_at(space, tile_shape, n), pipeline, scratch[worker], halos);
+        }
+    });
+}
+
+// =============================================================================
+// Temporal blocking
+// =============================================================================
+
+// Advance src by several sweeps of a stencil kernel, keeping each tile in
+// cache for all the sweeps. The kernel is called as
+//
+//     kernel(index, u, step) -> T
+//
+// where u is an array_view_t<const T, S> of the values after step - 1 sweeps
+// (step counts from 1), and reads at most radius zones from index along any
+// axis. src must cover space grown by steps * radius zones, which serve as
+// deep ghost zones: sweep k is evaluated on space grown by (steps - k) *
+// radius, and the result of the final sweep on space is written to dst.
+// Tiles read src halos that neighboring tiles store over, so src and dst
+// must not share storage; there is no in-place update.
+//
+// Each tile of tile_shape is loaded once with its full halo, advanced through
+// every sweep in per-worker scratch, and stored once (overlapped, or
+// trapezoidal, tiling). Zones near tile edges are computed redundantly by
+// neighboring tiles, in exchange for cutting main-memory traffic per sweep
+// by roughly a factor of steps.
+template<typename T, std::size_t S, Executor E, typename F>
+void temporal_for_each(
+    const index_space_t<S>& space,
+    const uvec_t<S>& tile_shape,
+    const E& e,
+    unsigned int steps,
+    unsigned int radius,
+    const array_view_t<const T, S>& src,
+    const array_view_t<T, S>& dst,
+    F&& kernel)
+{
+    auto halo = steps * radius;
+    detail::check_tile_shape(tile_shape, "temporal_for_each");
+
+    if (intersect(expand(space, halo), domain(src)) != expand(space, halo)) {
+        throw std::runtime_error("temporal_for_each: src must cover space grown by steps * radius");
+    }
+    if (intersect(space, domain(dst)) != space) {
+        throw std::runtime_error("temporal_for_each: dst must cover space");
+    }
+    if (detail::shares_storage(src, dst)) {
+        throw std::runtime_error("temporal_for_each: src and dst must not overlap");
+    }
+
+    struct scratch_t {
+        std::vector<T> _a;
+        std::vector<T> _b;
+    };
+    auto scratch = std::vector<scratch_t>(num_workers(e));
+
+    execute(e, tile_count(space, tile_shape), [&](std::size_t first, std::size_t last, std::size_t worker) {
+        auto& a = scratch[worker]._a;
+        auto& b = scratch[worker]._b;
+
+        for (std::size_t n = first; n < last; ++n) {
+            auto tile = tile_at(space, tile_shape, n);
+            auto region = expand(tile, halo);
+
+            if (a.size() < size(region)) {
+                a.resize(size(region));
+                b.resize(size(region));
+            }
+            for (std::size_t m = 0; m < size(region); ++m) {
+                a[m] = ndread(src, ndindex(region, m));
+            }
+            for (unsigned int step = 1; step <= steps; ++step) {
+                auto u = array_view_t<const T, S>{a.data(), region};
+                auto next = expand(tile, (steps - step) * radius);
+
+                for (std::size_t m = 0; m < size(next); ++m) {
+                    b[m] = kernel(ndindex(next, m), u, step);
+                }
+                std::swap(a, b);
+                region = next;
+            }
+            for (std::size_t m = 0; m < size(tile); ++m) {
+                ndwrite(dst, ndindex(tile, m), a[m]);
+            }
+        }
+    });
+}
+
+// =============================================================================
+// Pencil sweeps
+// =============================================================================
+
+// Apply a 1D kernel along every pencil (line of zones parallel to axis) of
+// space. Each pencil, with ghost zones on both ends, is gathered from src
+// into a contiguous per-worker buffer, the kernel is called as
+//
+//     kernel(in, out, pencil)
+//
+// and out is scattered to dst. Here pencil is the index_space_t<S> of the
+// pencil's zones, in is an array_view_t<const T, 1> covering the pencil's
+// range along axis grown by ghost, and out is an array_view_t<T, 1> covering
+// that range itself; both are indexed by the absolute coordinate along axis.
+// The kernel therefore sees unit-stride data whatever the axis, and pencils
+// are distributed over the executor's workers.
+//
+// src must cover space grown by ghost along axis, and dst must cover space.
+// Since each pencil is gathered before it is scattered, src and dst may be
+// views of the same buffer.
+template<typename T, std::size_t S, Executor E, typename F>
+void pencil_for_each(
+    const index_space_t<S>& space,
+    std::size_t axis,
+    unsigned int ghost,
+    const E& e,
+    const array_view_t<const T, S>& src,
+    const array_view_t<T, S>& dst,
+    F&& kernel)
+{
+    if (axis >= S) {
+        throw std::runtime_error("pencil_for_each: axis out of range");
+    }
+    auto width = uvec_t<S>{};
+    width._data[axis] = ghost;
+
+    if (intersect(expand(space, width), domain(src)) != expand(space, width)) {
+        throw std::runtime_error("pencil_for_each: src must cover space grown by ghost along axis");
+    }
+    if (intersect(space, domain(dst)) != space) {
+        throw std::runtime_error("pencil_for_each: dst must cover space");
+    }
+
+    auto cross = space;
+    cross._shape._data[axis] = size(space) == 0 ? 0 : 1;
+
+    auto length = space._shape._data[axis];
+    auto lo = space._start._data[axis];
+    auto src_stride = detail::strides(domain(src))._data[axis];
+    auto dst_stride = detail::strides(domain(dst))._data[axis];
+
+    struct scratch_t {
+        std::vector<T> _in;
+        std::vector<T> _out;
+    };
+    auto scratch = std::vector<scratch_t>(num_workers(e));
+
+    execute(e, size(cross), [&](std::size_t first, std::size_t last, std::size_t worker) {
+        auto& in = scratch[worker]._in;
+        auto& out = scratch[worker]._out;
+        in.resize(length + 2 * ghost);
+        out.resize(length);
+
+        for (std::size_t n = first; n < last; ++n) {
+            auto pencil = index_space_t<S>{ndindex(cross, n), uvec_t<S>{}};
+            for (std::size_t a = 0; a < S; ++a) {
+                pencil._shape._data[a] = a == axis ? length : 1;
+            }
+
+            auto head = pencil._start;
+            head._data[axis] -= static_cast<int>(ghost);
+
+            const T* s = data(src) + ndoffset(domain(src), head);
+            for (std::size_t j = 0; j < in.size(); ++j) {
+                in[j] = s[j * src_stride];
+            }
+            kernel(
+                array_view_t<const T, 1>{in.data(), index_space(ivec(lo - static_cast<int>(ghost)), uvec(length + 2 * ghost))},
+                array_view_t<T, 1>{out.data(), index_space(ivec(lo), uvec(length))},
+                pencil);
+
+            T* d = data(dst) + ndoffset(domain(dst), pencil._start);
+            for (std::size_t j = 0; j < length; ++j) {
+                d[j * dst_stride] = out[j];
+            }
+        }
+    });
+}
+
+} // namespace mist
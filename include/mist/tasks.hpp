@@ -0,0 +1,275 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "core.hpp"
+
+namespace mist {
+
+// =============================================================================
+// Task graphs
+// =============================================================================
+
+// A task graph is a DAG of void() tasks. A task runs once all of the tasks it
+// depends on have finished; tasks with no path between them may run
+// concurrently. Since a task can only depend on tasks added before it, every
+// graph is acyclic by construction.
+
+using task_id = std::size_t;
+
+struct task_t {
+    std::function<void()> _work;
+    std::vector<task_id> _dependents;
+    std::size_t _num_dependencies = 0;
+};
+
+struct task_graph_t {
+    std::vector<task_t> _tasks;
+};
+
+inline std::size_t size(const task_graph_t& g) {
+    return g._tasks.size();
+}
+
+// Add a task that runs after each of deps; returns its id
+inline task_id add_task(task_graph_t& g, std::function<void()> work, const std::vector<task_id>& deps = {}) {
+    auto id = g._tasks.size();
+
+    for (auto d : deps) {
+        if (d >= id) {
+            throw std::runtime_error("add_task: a task may only depend on tasks added before it");
+        }
+    }
+    g._tasks.push_back(task_t{std::move(work), {}, deps.size()});
+
+    for (auto d : deps) {
+        g._tasks[d]._dependents.push_back(id);
+    }
+    return id;
+}
+
+// Add one task per tile of tile_shape covering space, each calling
+// func(tile) after deps, and an empty task that joins them; returns the id
+// of the join, so later tasks can depend on the whole sweep
+template<std::size_t S, typename F>
+task_id add_tile_tasks(task_graph_t& g, const index_space_t<S>& space, const uvec_t<S>& tile_shape, F func, const std::vector<task_id>& deps = {}) {
+    detail::check_tile_shape(tile_shape, "add_tile_tasks");
+
+    auto tiles = std::vector<task_id>{};
+    auto count = tile_count(space, tile_shape);
+    tiles.reserve(count);
+
+    for (std::size_t n = 0; n < count; ++n) {
+        tiles.push_back(add_task(g, [func, tile = tile_at(space, tile_shape, n)] { func(tile); }, deps));
+    }
+    return add_task(g, [] {}, tiles.empty() ? deps : tiles);
+}
+
+// =============================================================================
+// Work-stealing pool
+// =============================================================================
+
+namespace detail {
+    struct task_queue_t {
+        std::mutex _mutex;
+        std::deque<task_id> _tasks;
+    };
+
+    // Progress of one run of a graph on a pool
+    struct graph_run_t {
+        const task_graph_t* _graph = nullptr;
+        std::unique_ptr<std::atomic<std::size_t>[]> _waiting;
+        std::atomic<std::size_t> _remaining{0};
+        std::atomic<bool> _failed{false};
+        std::exception_ptr _error;
+        std::mutex _error_mutex;
+    };
+}
+
+// A pool of persistent workers that run task graphs. Each worker owns a
+// deque: tasks made ready by a worker are pushed onto its own deque and
+// popped LIFO, so a consumer tends to run where its inputs are still in
+// cache, while idle workers steal FIFO from the other end of other deques.
+// Idle workers sleep on a condition variable. The thread calling run() is
+// worker 0 for the run's duration; the pool pins only the workers it owns.
+struct task_pool_t {
+    std::vector<std::thread> _threads;
+    std::unique_ptr<detail::task_queue_t[]> _queues;
+    std::atomic<std::size_t> _queued{0};
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _stop = false;
+
+    std::mutex _run_mutex;
+    detail::graph_run_t* _run = nullptr;
+    affinity_t _affinity;
+
+    explicit task_pool_t(unsigned int num_threads = 0, affinity_t affinity = {});  // 0 = hardware concurrency
+    ~task_pool_t();
+    task_pool_t(const task_pool_t&) = delete;
+    task_pool_t& operator=(const task_pool_t&) = delete;
+};
+
+inline std::size_t num_workers(const task_pool_t& pool) {
+    return pool._threads.size() + 1;
+}
+
+namespace detail {
+    inline void push_task(task_pool_t& pool, std::size_t worker, task_id t) {
+        {
+            auto lock = std::lock_guard<std::mutex>(pool._queues[worker]._mutex);
+            pool._queues[worker]._tasks.push_back(t);
+        }
+        pool._queued.fetch_add(1);
+        auto lock = std::lock_guard<std::mutex>(pool._mutex);
+        pool._wake.notify_one();
+    }
+
+    // Pop from the worker's own deque, else steal from the others
+    inline bool take_task(task_pool_t& pool, std::size_t worker, task_id& t) {
+        auto workers = num_workers(pool);
+
+        for (std::size_t k = 0; k < workers; ++k) {
+            auto victim = (worker + k) % workers;
+            auto& queue = pool._queues[victim];
+            auto lock = std::lock_guard<std::mutex>(queue._mutex);
+
+            if (!queue._tasks.empty()) {
+                if (k == 0) {
+                    t = queue._tasks.back();
+                    queue._tasks.pop_back();
+                } else {
+                    t = queue._tasks.front();
+                    queue._tasks.pop_front();
+                }
+                pool._queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Run a task, then release its dependents. After a failure, the
+    // remaining tasks are drained without running their work.
+    inline void run_task(task_pool_t& pool, std::size_t worker, task_id t) {
+        auto& run = *pool._run;
+        const auto& task = run._graph->_tasks[t];
+
+        if (!run._failed.load()) {
+            try {
+                task._work();
+            } catch (...) {
+                auto lock = std::lock_guard<std::mutex>(run._error_mutex);
+                if (!run._error) run._error = std::current_exception();
+                run._failed.store(true);
+            }
+        }
+        for (auto d : task._dependents) {
+            if (run._waiting[d].fetch_sub(1) == 1) {
+                push_task(pool, worker, d);
+            }
+        }
+        if (run._remaining.fetch_sub(1) == 1) {
+            auto lock = std::lock_guard<std::mutex>(pool._mutex);
+            pool._wake.notify_all();
+        }
+    }
+
+    inline void pool_worker(task_pool_t& pool, std::size_t worker) {
+        pin_thread(affinity_cpu(pool._affinity, worker));
+
+        while (true) {
+            auto t = task_id(0);
+
+            if (take_task(pool, worker, t)) {
+                run_task(pool, worker, t);
+                continue;
+            }
+            auto lock = std::unique_lock<std::mutex>(pool._mutex);
+            pool._wake.wait(lock, [&] { return pool._stop || pool._queued.load() > 0; });
+
+            if (pool._stop) {
+                return;
+            }
+        }
+    }
+}
+
+inline task_pool_t::task_pool_t(unsigned int num_threads, affinity_t affinity) : _affinity(std::move(affinity)) {
+    auto workers = num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+    _queues = std::make_unique<detail::task_queue_t[]>(workers);
+
+    for (std::size_t w = 1; w < workers; ++w) {
+        _threads.emplace_back(detail::pool_worker, std::ref(*this), w);
+    }
+}
+
+inline task_pool_t::~task_pool_t() {
+    {
+        auto lock = std::lock_guard<std::mutex>(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+// Run every task of g on the pool, returning when all have finished. The
+// first exception thrown by a task is rethrown here; tasks that had not
+// started by then are skipped. Graphs run one at a time on a pool, and a
+// task must not run a graph on the pool that is running it.
+inline void run(const task_graph_t& g, task_pool_t& pool) {
+    auto n = size(g);
+    if (n == 0) return;
+
+    auto run_lock = std::lock_guard<std::mutex>(pool._run_mutex);
+    auto state = detail::graph_run_t{};
+    state._graph = &g;
+    state._waiting = std::make_unique<std::atomic<std::size_t>[]>(n);
+    state._remaining.store(n);
+
+    for (std::size_t t = 0; t < n; ++t) {
+        state._waiting[t].store(g._tasks[t]._num_dependencies);
+    }
+    pool._run = &state;
+
+    // Deal the ready tasks out round-robin, so workers start without stealing
+    auto workers = num_workers(pool);
+    auto dealt = std::size_t(0);
+
+    for (std::size_t t = 0; t < n; ++t) {
+        if (g._tasks[t]._num_dependencies == 0) {
+            detail::push_task(pool, dealt++ % workers, t);
+        }
+    }
+    while (state._remaining.load() > 0) {
+        auto t = task_id(0);
+
+        if (detail::take_task(pool, 0, t)) {
+            detail::run_task(pool, 0, t);
+            continue;
+        }
+        auto lock = std::unique_lock<std::mutex>(pool._mutex);
+        pool._wake.wait(lock, [&] { return pool._queued.load() > 0 || state._remaining.load() == 0; });
+    }
+    pool._run = nullptr;
+
+    if (state._error) {
+        std::rethrow_exception(state._error);
+    }
+}
+
+} // namespace mist
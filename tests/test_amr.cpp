@@ -0,0 +1,259 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <sstream>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/amr.hpp"
+#include "mist/driver.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// A model: 2D linear advection of a Gaussian pulse with upwind fluxes
+// =============================================================================
+
+namespace pulse {
+
+struct model {
+    struct config_t {
+        double vx = 1.0;
+        double vy = 0.5;
+        double threshold = 0.05;
+
+        auto fields() const {
+            return std::make_tuple(field("vx", vx), field("vy", vy), field("threshold", threshold));
+        }
+
+        auto fields() {
+            return std::make_tuple(field("vx", vx), field("vy", vy), field("threshold", threshold));
+        }
+    };
+    using value_t = double;
+    static constexpr std::size_t rank = 2;
+    static constexpr unsigned int ghost = 1;
+};
+
+double initial_value(const model::config_t&, dvec_t<2> x) {
+    auto r2 = (x[0] - 0.5) * (x[0] - 0.5) + (x[1] - 0.5) * (x[1] - 0.5);
+    return 1.0 + std::exp(-r2 / 0.01);
+}
+
+double flux(const model::config_t& cfg, const array_view_t<const double, 2>& u, ivec_t<2> i, std::size_t axis) {
+    auto v = axis == 0 ? cfg.vx : cfg.vy;
+    auto e = axis == 0 ? ivec(1, 0) : ivec(0, 1);
+    return v * (v > 0 ? u[i - e] : u[i]);
+}
+
+double max_wavespeed(const model::config_t& cfg, double) {
+    return std::max(std::abs(cfg.vx), std::abs(cfg.vy));
+}
+
+bool refine_flag(const model::config_t& cfg, const array_view_t<const double, 2>& u, ivec_t<2> i, double) {
+    return std::abs(u[i + ivec(1, 0)] - u[i - ivec(1, 0)]) + std::abs(u[i + ivec(0, 1)] - u[i - ivec(0, 1)]) > cfg.threshold;
+}
+
+} // namespace pulse
+
+// =============================================================================
+// A vector-valued model: the same pulse, carrying a second, uniform field
+// =============================================================================
+
+namespace tracer {
+
+struct model {
+    struct config_t : pulse::model::config_t {};
+    using value_t = vec_t<double, 2>;
+    static constexpr std::size_t rank = 2;
+    static constexpr unsigned int ghost = 1;
+};
+
+vec_t<double, 2> initial_value(const model::config_t& cfg, dvec_t<2> x) {
+    return vec(pulse::initial_value(cfg, x), 2.0);
+}
+
+vec_t<double, 2> flux(const model::config_t& cfg, const array_view_t<const vec_t<double, 2>, 2>& u, ivec_t<2> i, std::size_t axis) {
+    auto v = axis == 0 ? cfg.vx : cfg.vy;
+    auto e = axis == 0 ? ivec(1, 0) : ivec(0, 1);
+    return v * (v > 0 ? u[i - e] : u[i]);
+}
+
+double max_wavespeed(const model::config_t& cfg, const vec_t<double, 2>&) {
+    return std::max(std::abs(cfg.vx), std::abs(cfg.vy));
+}
+
+bool refine_flag(const model::config_t& cfg, const array_view_t<const vec_t<double, 2>, 2>& u, ivec_t<2> i, double) {
+    return std::abs(u[i + ivec(1, 0)][0] - u[i - ivec(1, 0)][0]) + std::abs(u[i + ivec(0, 1)][0] - u[i - ivec(0, 1)][0]) > cfg.threshold;
+}
+
+} // namespace tracer
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_refine_coarsen() {
+    std::cout << "Testing refine and coarsen... ";
+
+    auto space = index_space(ivec(-2, 3), uvec(4, 5));
+    assert(refine(space, 2) == index_space(ivec(-4, 6), uvec(8, 10)));
+    assert(coarsen(refine(space, 2), 2) == space);
+    assert(coarsen(ivec(-1, 5), 2) == ivec(-1, 2));
+    assert(coarsen(ivec(-4, -5), 4) == ivec(-1, -2));
+
+    std::cout << "PASSED\n";
+}
+
+void test_regrid_nesting() {
+    std::cout << "Testing regrid and proper nesting... ";
+
+    auto bc = boundary_conditions_t<2>{{boundary::outflow, boundary::periodic}, {boundary::outflow, boundary::periodic}};
+    auto h = hierarchy<double>(index_space(ivec(0, 0), uvec(32, 32)), 4, 2, 2, 2, bc);
+    assert(h._patches.size() == 64 && num_levels(h) == 1);
+
+    // Refine around a point near the periodic y = 0 edge
+    auto flag = [](const auto&, ivec_t<2> i, unsigned int level) {
+        auto c = ivec(16, 1) * (1 << level);
+        return std::abs(i[0] - c[0]) <= 1 && std::abs(i[1] - c[1]) <= 1;
+    };
+    regrid(h, flag, threads_t{._num_threads = 2});
+    assert(num_levels(h) == 3);
+
+    // Every fine zone, and every ghost zone of a fine patch, lies over a
+    // zone of the level below that has data
+    for (unsigned int l = 1; l < num_levels(h); ++l) {
+        auto coarse = level_range(h, l - 1);
+        auto [first, last] = level_range(h, l);
+        for (auto n = first; n < last; ++n) {
+            for (auto i : padded(h._patches[n])) {
+                auto j = coarsen(i, 2);
+                auto space = level_space(h, l - 1);
+                j[1] = (j[1] % static_cast<int>(space._shape[1]) + space._shape[1]) % space._shape[1];
+                if (j[0] < 0 || j[0] >= static_cast<int>(space._shape[0])) continue;
+                auto found = false;
+                for (auto k = coarse.first; k < coarse.second; ++k) {
+                    found = found || contains(h._patches[k]._space, j);
+                }
+                assert(found);
+            }
+        }
+    }
+
+    // Ghost fills and restriction preserve a linear profile
+    for (auto& p : h._patches) {
+        auto u = view(p);
+        for (auto i : p._space) {
+            u[i] = (i[0] + 0.5) / (1 << p._level);
+        }
+    }
+    fill_ghosts(h, 1, cpu_t{});
+    for (auto n = level_range(h, 1).first; n < level_range(h, 1).second; ++n) {
+        auto u = view(h._patches[n]);
+        for (auto i : padded(h._patches[n])) {
+            if (i[0] >= 0 && i[0] < 64) {
+                assert(std::abs(u[i] - (coarsen(i, 2)[0] + 0.5)) < 1e-12 || std::abs(u[i] - (i[0] + 0.5) / 2) < 1e-12);
+            }
+        }
+    }
+    restrict_level(h, 0, cpu_t{});
+    for (auto n = level_range(h, 0).first; n < level_range(h, 0).second; ++n) {
+        auto u = view(h._patches[n]);
+        for (auto i : h._patches[n]._space) {
+            assert(std::abs(u[i] - (i[0] + 0.5)) < 1e-12);
+        }
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_conservation() {
+    std::cout << "Testing conservative subcycled advance... ";
+
+    static_assert(AmrModel<pulse::model>);
+    static_assert(Physics<amr<pulse::model>>);
+
+    auto cfg = amr<pulse::model>::config_t{};
+    cfg.resolution = uvec(32, 32);
+    cfg.max_level = 2;
+    cfg.regrid_interval = 2;
+
+    auto s = initial_state(cfg);
+    assert(num_levels(s.hierarchy) == 3);
+    assert(zone_count(s) > size(s.hierarchy._domain));
+
+    auto total = [&](const auto& state) {
+        return timeseries_sample(cfg, state)[3].second;
+    };
+    auto mass = total(s);
+
+    for (int n = 0; n < 10; ++n) {
+        s = rk2_step<amr<pulse::model>>(cfg, s, 0.4 * courant_time(cfg, s));
+    }
+    assert(std::abs(total(s) - mass) < 1e-12 * mass);
+    assert(std::abs(get_time(s, 0) - 10 * 0.4 / 32) < 1e-12);
+
+    // The refined region follows the pulse
+    auto product = get_product(cfg, s);
+    assert(product.patches_per_level.size() == 3 && product.patches_per_level[2] > 0);
+
+    std::cout << "PASSED\n";
+}
+
+void test_vector_model() {
+    std::cout << "Testing vector-valued models through the driver... ";
+
+    static_assert(Physics<amr<tracer::model>>);
+
+    auto cfg = config<amr<tracer::model>>{};
+    cfg.physics.resolution = uvec(16, 16);
+    cfg.physics.max_level = 1;
+    cfg.driver.t_final = 0.05;
+    cfg.driver.message_interval = 10.0;
+    cfg.driver.checkpoint_interval = 0.05;
+    cfg.driver.products_interval = 0.05;
+    cfg.driver.output_directory = (std::filesystem::temp_directory_path() / "mist_test_amr").string();
+    std::filesystem::remove_all(cfg.driver.output_directory);
+
+    auto s = run(cfg);
+    assert(std::filesystem::exists(cfg.driver.output_directory + "/chkpt.0001.dat"));
+    assert(std::filesystem::exists(cfg.driver.output_directory + "/prods.0001.dat"));
+    std::filesystem::remove_all(cfg.driver.output_directory);
+
+    // Patches of vectors round trip through a checkpoint
+    auto ss = std::stringstream{};
+    auto writer = ascii_writer(ss);
+    serialize(writer, "state", s);
+    ss.seekg(0);
+    auto reader = ascii_reader(ss);
+    auto loaded = amr<tracer::model>::state_t{};
+    deserialize(reader, "state", loaded);
+
+    assert(loaded.hierarchy._patches.size() == s.hierarchy._patches.size());
+    for (std::size_t n = 0; n < loaded.hierarchy._patches.size(); ++n) {
+        const auto& a = loaded.hierarchy._patches[n]._data;
+        const auto& b = s.hierarchy._patches[n]._data;
+        assert(a.size() == b.size());
+        for (std::size_t k = 0; k < a.size(); ++k) {
+            assert(std::abs(a[k][0] - b[k][0]) < 1e-12 && std::abs(a[k][1] - b[k][1]) < 1e-12);
+        }
+    }
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== AMR Library Tests ===\n\n";
+
+    test_refine_coarsen();
+    test_regrid_nesting();
+    test_conservation();
+    test_vector_model();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
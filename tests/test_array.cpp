@@ -0,0 +1,159 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/array.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_array_view() {
+    std::cout << "Testing array_view_t... ";
+
+    auto space = index_space(ivec(1, 2), uvec(3, 4));
+    auto buf = std::vector<double>(size(space), 0.0);
+    auto v = view(buf, space);
+
+    ndwrite(v, ivec(2, 3), 5.0);
+    v[ivec(3, 5)] = 7.0;
+    assert(buf[ndoffset(space, ivec(2, 3))] == 5.0);
+    assert(ndread(v, ivec(3, 5)) == 7.0);
+    assert(domain(v) == space);
+    assert(data(v) == buf.data());
+
+    bool threw = false;
+    try {
+        view(buf, index_space(ivec(0, 0), uvec(4, 4)));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_expressions() {
+    std::cout << "Testing lazy expressions... ";
+
+    auto space = index_space(ivec(0), uvec(100));
+    auto a = std::vector<double>(100);
+    auto b = std::vector<double>(100);
+    auto c = std::vector<double>(100);
+
+    for (std::size_t i = 0; i < 100; ++i) {
+        a[i] = 1.0 * i;
+        b[i] = 2.0 * i + 1.0;
+    }
+
+    double alpha = 0.25;
+    auto expr = view(a, space) * (1.0 - alpha) + view(b, space) * alpha;
+    static_assert(Expression<decltype(expr)>);
+
+    assign(view(c, space), expr);
+    for (std::size_t i = 0; i < 100; ++i) {
+        assert(c[i] == a[i] * (1.0 - alpha) + b[i] * alpha);
+    }
+
+    // Any executor may be used for the fused traversal
+    assign(view(c, space), -view(a, space) / 2.0 + map(view(b, space), [](double x) { return std::sqrt(x); }), threads_t{._num_threads = 3});
+    for (std::size_t i = 0; i < 100; ++i) {
+        assert(c[i] == -a[i] / 2.0 + std::sqrt(b[i]));
+    }
+
+    // Assignment restricted to a subspace, reading from a larger array
+    auto interior = index_space(ivec(1), uvec(98));
+    auto d = std::vector<double>(98);
+    assign(view(d, interior), (view(a, space) - 1.0) * 2.0, interior, cpu_t{});
+    assert(d[0] == 0.0 && d[97] == 2.0 * 97.0);
+
+    // Both the destination and the views read must cover the space
+    auto threw = 0;
+    try {
+        assign(view(d, interior), view(a, space), space, cpu_t{});
+    } catch (const std::runtime_error&) {
+        threw++;
+    }
+    try {
+        assign(view(c, space), view(d, interior) + view(a, space));
+    } catch (const std::runtime_error&) {
+        threw++;
+    }
+    assert(threw == 2);
+
+    std::cout << "PASSED\n";
+}
+
+void test_vec_broadcasting() {
+    std::cout << "Testing vec_t broadcasting in expressions... ";
+
+    auto space = index_space(ivec(0, 0), uvec(4, 5));
+    auto rho = std::vector<double>(size(space), 2.0);
+    auto vel = std::vector<dvec_t<3>>(size(space), dvec(1.0, 2.0, 3.0));
+    auto mom = std::vector<dvec_t<3>>(size(space));
+    auto my = std::vector<double>(size(space));
+
+    // Scalar field times vector field, plus a broadcast vec_t constant
+    assign(view(mom, space), view(rho, space) * view(vel, space) + dvec(0.5, 0.0, 0.0));
+    assert(mom[7] == dvec(2.5, 4.0, 6.0));
+
+    // Component extraction from a vector-valued expression
+    assign(view(my, space), component(view(mom, space) * 0.5, 1));
+    assert(my[19] == 2.0);
+
+    std::cout << "PASSED\n";
+}
+
+void test_vec_view() {
+    std::cout << "Testing vec_view_t... ";
+
+    auto space = index_space(ivec(0, 0), uvec(3, 5));
+    auto layout = aosoa_t<4>{};
+    auto buf = std::vector<double>(ndsize<2>(layout, space));
+    auto u = vec_view<2>(layout, buf, space);
+
+    ndwrite(u, ivec(1, 2), dvec(1.5, -2.0));
+    assert(ndread(u, ivec(1, 2)) == dvec(1.5, -2.0));
+    assert(ndread(u, ivec(1, 2), 1) == -2.0);
+
+    ndwrite(u, ivec(2, 4), 0, 7.0);
+    assert(buf[ndoffset<2>(layout, space, ivec(2, 4), 0)] == 7.0);
+
+    // Expressions move data between component layouts
+    auto rho = std::vector<double>(size(space), 2.0);
+    auto soa = std::vector<double>(ndsize<2>(soa_t<>{}, space));
+    assign(u, view(rho, space) * dvec(1.0, 3.0));
+    assign(vec_view<2>(soa_t<>{}, soa, space), vec_view<2>(layout, std::as_const(buf), space));
+    assert(soa[0] == 2.0 && soa[size(space)] == 6.0);
+
+    auto bad = std::vector<double>(size(space));
+    auto threw = false;
+    try {
+        vec_view<2>(aos_t<>{}, bad, space);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Array Library Tests ===\n\n";
+
+    test_array_view();
+    test_expressions();
+    test_vec_broadcasting();
+    test_vec_view();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
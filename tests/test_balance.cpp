@@ -0,0 +1,156 @@
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/balance.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// Helpers
+// =============================================================================
+
+// Busy work, so a patch takes a measurable time
+static double spin(int iterations) {
+    volatile double x = 1.0;
+    for (int n = 0; n < iterations; ++n) {
+        x = x * 1.0000001 + 1e-9;
+    }
+    return x;
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_curve_keys() {
+    std::cout << "Testing curve keys... ";
+
+    // Keys count the indices of a cube in the order the traversals visit them
+    auto cube = index_space(ivec(0, 0, 0), uvec(8, 8, 8));
+    auto hilbert = std::vector<std::uint64_t>{};
+    auto morton = std::vector<std::uint64_t>{};
+    auto point = [](const ivec_t<3>& i) {
+        return uvec(static_cast<unsigned int>(i[0]), static_cast<unsigned int>(i[1]), static_cast<unsigned int>(i[2]));
+    };
+
+    for_each(cube, [&](const ivec_t<3>& i) { hilbert.push_back(detail::curve_key<true>(point(i), 3)); }, hilbert_t<>{});
+    for_each(cube, [&](const ivec_t<3>& i) { morton.push_back(detail::curve_key<false>(point(i), 3)); }, morton_t<>{});
+
+    for (std::uint64_t n = 0; n < size(cube); ++n) {
+        assert(hilbert[n] == n);
+        assert(morton[n] == n);
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_curve_partition() {
+    std::cout << "Testing curve partitions... ";
+
+    auto global = index_space(ivec(-8, 0), uvec(64, 64));
+    auto spaces = std::vector<index_space_t<2>>{};
+    for (std::size_t n = 0; n < tile_count(global, uvec(8, 8)); ++n) {
+        spaces.push_back(tile_at(global, uvec(8, 8), n));
+    }
+
+    // Consecutive patches along the curve are neighbors
+    auto order = curve_order(spaces);
+    assert(std::set<std::size_t>(order.begin(), order.end()).size() == spaces.size());
+    for (std::size_t n = 1; n < order.size(); ++n) {
+        auto a = spaces[order[n - 1]]._start;
+        auto b = spaces[order[n]]._start;
+        assert(std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) == 8);
+    }
+
+    // A hot spot: patches near the center cost 20 times more
+    auto cost = std::vector<double>{};
+    for (const auto& s : spaces) {
+        auto hot = s._start[0] >= 16 && s._start[0] < 32 && s._start[1] >= 16 && s._start[1] < 32;
+        cost.push_back(hot ? 20.0 : 1.0);
+    }
+    auto part = curve_partition(order, cost, 5);
+    auto loads = part_loads(cost, part, 5);
+
+    // Parts are contiguous runs of the curve, each within one patch of the mean
+    for (std::size_t n = 1; n < order.size(); ++n) {
+        assert(part[order[n]] == part[order[n - 1]] || part[order[n]] == part[order[n - 1]] + 1);
+    }
+    for (auto load : loads) {
+        assert(std::abs(load - (60.0 + 4.0 * 20.0) / 5.0) <= 20.0);
+    }
+
+    // Rebalancing from a zone-count partition pays off unless migration is
+    // expensive, and a balanced partition is kept
+    auto even = curve_partition(order, std::vector<double>(spaces.size(), 1.0), 5);
+    assert(rebalance(spaces, cost, even, 5) == part);
+    assert(rebalance(spaces, cost, even, 5, {._migration_cost = 1.0}) == even);
+    assert(rebalance(spaces, cost, part, 5) == part);
+
+    std::cout << "PASSED\n";
+}
+
+void test_balanced_traversal() {
+    std::cout << "Testing measured-cost patch traversal... ";
+
+    auto global = index_space(ivec(0, 0), uvec(32, 32));
+    auto spaces = std::vector<index_space_t<2>>{};
+    for (std::size_t n = 0; n < tile_count(global, uvec(8, 8)); ++n) {
+        spaces.push_back(tile_at(global, uvec(8, 8), n));
+    }
+    auto visits = std::vector<int>(size(global), 0);
+    auto lb = load_balancer_t{._interval = 3};
+    auto e = threads_t{._num_threads = 4};
+
+    for (int traversal = 0; traversal < 9; ++traversal) {
+        for_each(spaces, [&](const index_space_t<2>&, const ivec_t<2>& i) {
+            visits[ndoffset(global, i)]++;
+            spin(i[0] < 8 && i[1] < 8 ? 4000 : 10);
+        }, lb, e);
+    }
+    for (auto v : visits) {
+        assert(v == 9);
+    }
+    assert(lb._part.size() == spaces.size() && lb._parts == 4);
+
+    // The expensive corner patch has been measured as such (timings are
+    // noisy, so against the median), and no longer shares its worker with
+    // more than a few others
+    auto corner = std::size_t(0);
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        assert(lb._cost[k] > 0.0);
+        if (spaces[k]._start == ivec(0, 0)) corner = k;
+    }
+    auto sorted = lb._cost;
+    std::sort(sorted.begin(), sorted.end());
+    assert(lb._cost[corner] > 10.0 * sorted[sorted.size() / 2]);
+    auto sharing = 0;
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        if (lb._part[k] == lb._part[corner]) sharing++;
+    }
+    assert(sharing < 4);
+
+    // A new set of patches starts over
+    spaces.pop_back();
+    for_each(spaces, [](const index_space_t<2>&, const ivec_t<2>&) {}, lb, e);
+    assert(lb._part.size() == spaces.size() && lb._count == 1);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Load Balancing Tests ===\n\n";
+
+    test_curve_keys();
+    test_curve_partition();
+    test_balanced_traversal();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
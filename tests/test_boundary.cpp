@@ -0,0 +1,115 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/array.hpp"
+#include "mist/boundary.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_periodic_fill() {
+    std::cout << "Testing periodic ghost fill... ";
+
+    auto interior = index_space(ivec(0, 0), uvec(5, 4));
+    auto padded = expand(interior, 2);
+    auto u = std::vector<double>(size(padded), -1.0);
+    auto v = view(u, padded);
+
+    for (auto i : interior) {
+        v[i] = 10.0 * i[0] + i[1];
+    }
+    fill_ghosts(v, interior, boundary_conditions<2>(boundary::periodic), threads_t{._num_threads = 3});
+
+    // Faces, edges and corners wrap around
+    assert(v[ivec(-1, 2)] == 42.0);
+    assert(v[ivec(5, 2)] == 2.0);
+    assert(v[ivec(3, -2)] == 32.0);
+    assert(v[ivec(-2, 5)] == 31.0);
+    assert(v[ivec(6, -1)] == 13.0);
+
+    for (auto i : padded) {
+        auto j = ivec((i[0] + 5) % 5, (i[1] + 4) % 4);
+        assert(v[i] == v[j]);
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_mixed_fill() {
+    std::cout << "Testing mixed ghost fill... ";
+
+    auto interior = index_space(ivec(1, 1, 1), uvec(4, 3, 5));
+    auto padded = expand(interior, uvec(2, 1, 2));
+    auto bc = boundary_conditions_t<3>{
+        {boundary::outflow, boundary::reflecting, boundary::periodic},
+        {boundary::reflecting, boundary::outflow, boundary::periodic}
+    };
+    auto u = std::vector<dvec_t<3>>(size(padded), dvec(-1.0, -1.0, -1.0));
+    auto v = view(u, padded);
+
+    for (auto i : interior) {
+        v[i] = dvec(i[0], i[1], i[2]);
+    }
+
+    // Negate the normal component of reflected vectors
+    auto flip = [](dvec_t<3> x, std::size_t axis) {
+        x[axis] = -x[axis];
+        return x;
+    };
+    fill_ghosts(v, interior, bc, cpu_t{}, flip);
+
+    assert(v[ivec(-1, 2, 3)] == dvec(1.0, 2.0, 3.0));   // outflow, axis 0 low
+    assert(v[ivec(5, 2, 3)] == dvec(-4.0, 2.0, 3.0));   // reflecting, axis 0 high
+    assert(v[ivec(6, 2, 3)] == dvec(-3.0, 2.0, 3.0));
+    assert(v[ivec(2, 0, 3)] == dvec(2.0, -1.0, 3.0));   // reflecting, axis 1 low
+    assert(v[ivec(2, 4, 3)] == dvec(2.0, 3.0, 3.0));    // outflow, axis 1 high
+    assert(v[ivec(2, 2, 0)] == dvec(2.0, 2.0, 5.0));    // periodic, axis 2
+    assert(v[ivec(6, 0, 7)] == dvec(-3.0, -1.0, 2.0));  // corner: all three rules
+
+    for (auto i : padded) {
+        assert(v[i][0] != -1.0 || i[0] == 1);
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_invalid_fill() {
+    std::cout << "Testing ghost fill argument checks... ";
+
+    auto interior = index_space(ivec(0), uvec(2));
+    auto u = std::vector<double>(8);
+    auto threw = false;
+
+    try {
+        fill_ghosts(view(u, expand(interior, 3)), interior, boundary_conditions<1>(boundary::reflecting));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Periodic layers may be deeper than the interior
+    fill_ghosts(view(u, expand(interior, 3)), interior, boundary_conditions<1>(boundary::periodic));
+    assert(parse_boundary("outflow") == boundary::outflow);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Boundary Condition Tests ===\n\n";
+
+    test_periodic_fill();
+    test_mixed_fill();
+    test_invalid_fill();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
@@ -0,0 +1,746 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <vector>
+#include "mist/core.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// A user-defined executor: runs chunks of a fixed size in reverse order
+// =============================================================================
+
+namespace user {
+
+struct reverse_t {
+    std::size_t _grain = 7;
+};
+
+inline std::size_t num_workers(const reverse_t&) {
+    return 1;
+}
+
+template<typename F>
+void execute(const reverse_t& e, std::size_t n, F&& body) {
+    auto chunks = (n + e._grain - 1) / e._grain;
+    for (auto c = chunks; c > 0; --c) {
+        body((c - 1) * e._grain, std::min(n, c * e._grain), std::size_t(0));
+    }
+}
+
+// A patch carrying its own buffer
+struct block_t {
+    index_space_t<2> _space;
+    std::vector<double>* _data;
+};
+
+inline const index_space_t<2>& domain(const block_t& b) {
+    return b._space;
+}
+
+} // namespace user
+
+// =============================================================================
+// Helper functions
+// =============================================================================
+
+// Visits every index with the given executor, checking each is seen once
+template<typename E>
+bool visits_each_index_once(const E& e) {
+    auto space = index_space(ivec(-3, 2), uvec(17, 23));
+    auto count = std::vector<std::atomic<int>>(size(space));
+
+    for_each(space, [&](ivec_t<2> i) {
+        count[ndoffset(space, i)]++;
+    }, e);
+
+    for (const auto& c : count) {
+        if (c != 1) return false;
+    }
+    return true;
+}
+
+template<typename E>
+long sum_of_offsets(const E& e) {
+    auto space = index_space(ivec(0, 0, 0), uvec(9, 10, 11));
+    return map_reduce(space, 0L, [&](ivec_t<3> i) {
+        return static_cast<long>(ndoffset(space, i));
+    }, std::plus<>{}, e);
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_executor_concept() {
+    std::cout << "Testing Executor concept... ";
+
+    static_assert(Executor<cpu_t>);
+    static_assert(Executor<omp_t>);
+    static_assert(Executor<threads_t>);
+    static_assert(Executor<team_t>);
+    static_assert(Executor<user::reverse_t>);
+    static_assert(!Executor<gpu_t>);
+    static_assert(!Executor<exec>);
+
+    std::cout << "PASSED\n";
+}
+
+void test_for_each_executors() {
+    std::cout << "Testing for_each with executor types... ";
+
+    assert(visits_each_index_once(cpu_t{}));
+    assert(visits_each_index_once(user::reverse_t{}));
+
+    for (auto c : {chunking::static_, chunking::dynamic, chunking::guided}) {
+        for (std::size_t grain : {0, 1, 5, 1000}) {
+            assert(visits_each_index_once(threads_t{._chunking = c, ._grain = grain, ._num_threads = 4}));
+            #ifdef _OPENMP
+            assert(visits_each_index_once(omp_t{._chunking = c, ._grain = grain, ._num_threads = 4}));
+            #endif
+        }
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_map_reduce_executors() {
+    std::cout << "Testing map_reduce with executor types... ";
+
+    long n = 9 * 10 * 11;
+    long expected = n * (n - 1) / 2;
+
+    assert(sum_of_offsets(cpu_t{}) == expected);
+    assert(sum_of_offsets(user::reverse_t{}) == expected);
+    assert(sum_of_offsets(threads_t{._num_threads = 3}) == expected);
+    assert(sum_of_offsets(threads_t{._chunking = chunking::guided, ._num_threads = 5}) == expected);
+    assert(sum_of_offsets(threads_t{._chunking = chunking::dynamic, ._grain = 13, ._num_threads = 2}) == expected);
+    #ifdef _OPENMP
+    assert(sum_of_offsets(omp_t{._chunking = chunking::dynamic}) == expected);
+    #endif
+
+    // Empty index spaces return init
+    auto empty = index_space(ivec(0), uvec(0));
+    assert(map_reduce(empty, 5, [](ivec_t<1>) { return 1; }, std::plus<>{}, threads_t{}) == 5);
+
+    std::cout << "PASSED\n";
+}
+
+void test_runtime_exec() {
+    std::cout << "Testing runtime exec selection... ";
+
+    assert(parse_exec("cpu") == exec::cpu);
+    assert(parse_exec("threads") == exec::threads);
+    assert(sum_of_offsets(parse_exec("cpu")) == sum_of_offsets(cpu_t{}));
+    assert(sum_of_offsets(parse_exec("threads")) == sum_of_offsets(cpu_t{}));
+
+    bool threw = false;
+    try {
+        parse_exec("fpga");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Exceptions raised by workers propagate to the caller
+    threw = false;
+    try {
+        for_each(index_space(ivec(0), uvec(100)), [](ivec_t<1> i) {
+            if (i[0] == 42) throw std::runtime_error("bad zone");
+        }, threads_t{._num_threads = 4});
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_pack_arithmetic() {
+    std::cout << "Testing pack_t arithmetic... ";
+
+    double buf[6] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+    auto a = load<4>(buf);
+    auto b = broadcast<4>(2.0);
+    auto c = (a + b) * 2.0 - a / b;
+    assert(c[0] == 5.5 && c[3] == 10.0);
+    assert(sum(a) == 10.0);
+    assert(map(a, [](double x) { return int(x) % 2; })[1] == 0);
+
+    auto d = load<4>(buf + 4, 2);
+    assert(d[0] == 5.0 && d[1] == 6.0 && d[2] == 0.0 && d[3] == 0.0);
+    store(buf, -d, 2);
+    assert(buf[0] == -5.0 && buf[1] == -6.0 && buf[2] == 3.0);
+
+    static_assert(alignof(pack_t<double, 4>) == 32);
+    static_assert(alignof(pack_t<float, 3>) == alignof(float));
+
+    std::cout << "PASSED\n";
+}
+
+template<typename E>
+bool simd_scale_matches(const E& e) {
+    auto space = index_space(ivec(2, -1), uvec(5, 13));
+    auto src = std::vector<double>(size(space));
+    auto dst = std::vector<double>(size(space), -1.0);
+
+    for (std::size_t n = 0; n < src.size(); ++n) {
+        src[n] = static_cast<double>(n);
+    }
+    for_each(space, [&](auto b) {
+        ndwrite(dst.data(), space, b, ndread(src.data(), space, b) * 2.0);
+    }, e);
+
+    for (std::size_t n = 0; n < src.size(); ++n) {
+        if (dst[n] != 2.0 * src[n]) return false;
+    }
+    return true;
+}
+
+void test_simd_traversal() {
+    std::cout << "Testing simd_t traversal... ";
+
+    assert(simd_scale_matches(simd_t<4>{}));
+    assert(simd_scale_matches(simd_t<8>{}));
+    assert(simd_scale_matches(simd_t<1>{}));
+    assert(simd_scale_matches(simd_t<4, threads_t>{._inner = {._chunking = chunking::dynamic, ._num_threads = 3}}));
+
+    // Batches cover each row, with a partial batch at the end
+    auto space = index_space(ivec(0, 0), uvec(3, 10));
+    auto counts = std::vector<unsigned int>();
+    for_each(space, [&](batch_t<2, 4> b) {
+        assert(lane_index(b, 1) == ivec(start(b)[0], start(b)[1] + 1));
+        counts.push_back(count(b));
+    }, simd_t<4>{});
+    assert((counts == std::vector<unsigned int>{4, 4, 2, 4, 4, 2, 4, 4, 2}));
+
+    // Map-reduce over lane coordinates only counts active lanes
+    auto total = map_reduce(space, 0, [](batch_t<2, 4> b) {
+        return lane_coordinates(b);
+    }, std::plus<>{}, simd_t<4, threads_t>{._inner = {._num_threads = 2}});
+    assert(total == 3 * 45);
+
+    std::cout << "PASSED\n";
+}
+
+void test_vec_operators() {
+    std::cout << "Testing vec_t operators... ";
+
+    // Constant evaluation uses the scalar path
+    static_assert(dvec(1.0, 2.0, 3.0) + dvec(1.0, 1.0, 1.0) == dvec(2.0, 3.0, 4.0));
+    static_assert(dot(ivec(1, 2, 3, 4), ivec(4, 3, 2, 1)) == 20);
+    static_assert(sizeof(dvec_t<3>) == 3 * sizeof(double));
+
+    // Native and scalar paths agree exactly, including for mixed types
+    auto a = dvec(0.1, -2.5, 1e300);
+    auto b = dvec(0.2, 7.25, 1e300);
+    auto c = a + b;
+    for (std::size_t i = 0; i < 3; ++i) {
+        assert(c[i] == a[i] + b[i]);
+        assert((a - b)[i] == a[i] - b[i]);
+        assert((a * 3)[i] == a[i] * 3);
+        assert((0.7f * a)[i] == a[i] * 0.7f);
+        assert((a / 3.0)[i] == a[i] / 3.0);
+    }
+    assert(dot(dvec(0.1, 0.2, 0.3), dvec(0.3, 0.2, 0.1)) == 0.1 * 0.3 + 0.2 * 0.2 + 0.3 * 0.1);
+
+    auto f = vec(1.5f, 2.5f, 3.5f, 4.5f);
+    assert((f * 2.0f) == vec(3.0f, 5.0f, 7.0f, 9.0f));
+    assert((ivec(1, 2) * 2.5) == dvec(2.5, 5.0));
+    assert((uvec(5u, 7u) - uvec(1u, 2u)) == uvec(4u, 5u));
+    assert(sum(ivec(1, 2, 3)) == 6 && product(ivec(2, 3, 4)) == 24);
+
+    std::cout << "PASSED\n";
+}
+
+template<std::size_t S, typename E>
+std::vector<ivec_t<S>> visit_order(const index_space_t<S>& space, const E& e) {
+    auto order = std::vector<ivec_t<S>>();
+    for_each(space, [&](ivec_t<S> i) { order.push_back(i); }, e);
+    return order;
+}
+
+template<std::size_t S>
+bool is_face_connected(const std::vector<ivec_t<S>>& order) {
+    for (std::size_t n = 1; n < order.size(); ++n) {
+        auto d = map(order[n] - order[n - 1], [](int x) { return std::abs(x); });
+        if (sum(d) != 1) return false;
+    }
+    return true;
+}
+
+void test_curve_traversal() {
+    std::cout << "Testing space-filling-curve traversal... ";
+
+    // Morton order on a 2x2 block, then the next block
+    auto morton = visit_order(index_space(ivec(0, 0), uvec(4, 4)), morton_t<>{});
+    assert(morton[0] == ivec(0, 0) && morton[1] == ivec(1, 0) && morton[2] == ivec(0, 1) && morton[3] == ivec(1, 1));
+    assert(morton[4] == ivec(2, 0));
+
+    // Hilbert order is a face-connected path over power-of-two cubes
+    assert(is_face_connected(visit_order(index_space(ivec(0, 0), uvec(16, 16)), hilbert_t<>{})));
+    assert(is_face_connected(visit_order(index_space(ivec(-4, 1, 2), uvec(8, 8, 8)), hilbert_t<>{})));
+    assert(is_face_connected(visit_order(index_space(ivec(0, 0, 0, 0), uvec(4, 4, 4, 4)), hilbert_t<>{})));
+
+    // Non-cubic spaces, partitioned among threads along the curve
+    assert(visits_each_index_once(morton_t<threads_t>{._inner = {._num_threads = 4}}));
+    assert(visits_each_index_once(hilbert_t<threads_t>{._inner = {._chunking = chunking::dynamic, ._grain = 10, ._num_threads = 3}}));
+    assert(sum_of_offsets(hilbert_t<threads_t>{._inner = {._num_threads = 3}}) == sum_of_offsets(cpu_t{}));
+    assert(sum_of_offsets(morton_t<>{}) == sum_of_offsets(cpu_t{}));
+
+    // Chunks are contiguous runs of the serial curve order
+    auto space = index_space(ivec(0, 0, 0), uvec(5, 9, 3));
+    auto serial = visit_order(space, hilbert_t<>{});
+    auto chunked = visit_order(space, hilbert_t<user::reverse_t>{});
+    assert(serial.size() == size(space));
+    for (std::size_t c = 0; c < serial.size(); c += 7) {
+        auto n = std::min<std::size_t>(7, serial.size() - c);
+        auto pos = chunked.size() - c - n;
+        assert(std::equal(serial.begin() + c, serial.begin() + c + n, chunked.begin() + pos));
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_bricked_layout() {
+    std::cout << "Testing bricked layout... ";
+
+    static_assert(Layout<row_major_t> && Layout<bricked_t<4>>);
+
+    auto space = index_space(ivec(-1, 3, 0), uvec(9, 4, 6));
+    auto layout = bricked_t<4>{};
+    assert(ndsize(layout, space) == 12 * 4 * 8);
+
+    // Offsets are distinct, in range, and invertible
+    auto used = std::vector<int>(ndsize(layout, space), 0);
+    for (auto index : space) {
+        auto offset = ndoffset(layout, space, index);
+        assert(offset < used.size());
+        assert(ndindex(layout, space, offset) == index);
+        used[offset]++;
+    }
+    assert(std::count(used.begin(), used.end(), 1) == static_cast<long>(size(space)));
+
+    // Zones of a brick are contiguous
+    assert(ndoffset(layout, space, ivec(-1, 3, 1)) == 1);
+    assert(ndoffset(layout, space, ivec(-1, 4, 0)) == 4);
+    assert(ndoffset(layout, space, ivec(-1, 3, 4)) == 64);
+
+    auto buf = std::vector<double>(ndsize(layout, space));
+    ndwrite(layout, buf.data(), space, ivec(2, 5, 5), 3.5);
+    assert(ndread(layout, buf.data(), space, ivec(2, 5, 5)) == 3.5);
+    assert(ndread(row_major_t{}, buf.data(), space, ivec(-1, 3, 0)) == 0.0);
+
+    // Storage-order traversal visits offsets in increasing order
+    auto last = std::size_t(0);
+    auto count = std::size_t(0);
+    for_each(layout, space, [&](ivec_t<3> i) {
+        auto offset = ndoffset(layout, space, i);
+        assert(count == 0 || offset > last);
+        last = offset;
+        count++;
+    });
+    assert(count == size(space));
+
+    auto seen = std::vector<std::atomic<int>>(ndsize(layout, space));
+    for_each(layout, space, [&](ivec_t<3> i) {
+        seen[ndoffset(layout, space, i)]++;
+    }, threads_t{._chunking = chunking::dynamic, ._num_threads = 3});
+    assert(std::count_if(seen.begin(), seen.end(), [](const auto& c) { return c == 1; }) == static_cast<long>(size(space)));
+
+    std::cout << "PASSED\n";
+}
+
+void test_padded_layout() {
+    std::cout << "Testing padded layout... ";
+
+    static_assert(Layout<padded_t<>>);
+
+    // A power-of-two grid gets rows and planes an odd number of lines apart
+    auto space = index_space(ivec(0, 0, 0), uvec(4, 16, 64));
+    auto layout = padded_t<8>{};
+    auto stride = detail::padded_strides<8>(space);
+    assert(stride[2] == 1 && stride[1] == 72 && stride[0] == 16 * 72 + 8);
+    assert(ndsize(layout, space) == 4 * stride[0]);
+
+    // Offsets are distinct, in range, invertible, and in row-major order
+    auto odd = index_space(ivec(-2, 5, 1), uvec(3, 5, 13));
+    auto last = std::size_t(0);
+    auto count = std::size_t(0);
+    for_each(layout, odd, [&](ivec_t<3> i) {
+        auto offset = ndoffset(layout, odd, i);
+        assert(offset < ndsize(layout, odd));
+        assert(ndindex(layout, odd, offset) == i);
+        assert(count == 0 || offset > last);
+        last = offset;
+        count++;
+    });
+    assert(count == size(odd));
+    assert(!contains(odd, ndindex(layout, odd, 13)));
+
+    auto buf = std::vector<double>(ndsize(layout, space));
+    ndwrite(layout, buf.data(), space, ivec(3, 15, 63), 2.5);
+    assert(buf.back() != 2.5 && ndread(layout, buf.data(), space, ivec(3, 15, 63)) == 2.5);
+
+    std::cout << "PASSED\n";
+}
+
+void test_component_layouts() {
+    std::cout << "Testing component layouts... ";
+
+    static_assert(ComponentLayout<aos_t<>> && ComponentLayout<soa_t<>> && ComponentLayout<aosoa_t<4>>);
+    static_assert(ComponentLayout<soa_t<bricked_t<2>>> && !Layout<soa_t<>>);
+
+    auto space = index_space(ivec(2, -1), uvec(5, 3));
+    assert(ndsize<3>(aos_t<>{}, space) == 45);
+    assert(ndsize<3>(soa_t<>{}, space) == 45);
+    assert(ndsize<3>(aosoa_t<4>{}, space) == 48);
+
+    // Offsets are distinct and in range for every layout
+    auto check_distinct = [&](auto layout) {
+        auto used = std::vector<int>(ndsize<3>(layout, space), 0);
+        for (auto index : space) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                used[ndoffset<3>(layout, space, index, k)]++;
+            }
+        }
+        return std::count(used.begin(), used.end(), 1) == static_cast<long>(3 * size(space));
+    };
+    assert(check_distinct(aos_t<>{}));
+    assert(check_distinct(soa_t<>{}));
+    assert(check_distinct(aosoa_t<4>{}));
+    assert(check_distinct(aos_t<bricked_t<2>>{}));
+
+    // Zone 5 is lane 1 of the second tile of 4
+    assert(ndoffset<3>(aos_t<>{}, space, ivec(3, 1), 2) == 5 * 3 + 2);
+    assert(ndoffset<3>(soa_t<>{}, space, ivec(3, 1), 2) == 2 * 15 + 5);
+    assert(ndoffset<3>(aosoa_t<4>{}, space, ivec(3, 1), 2) == 12 + 2 * 4 + 1);
+
+    // soa_t agrees with ndread_soa / ndwrite_soa
+    auto buf = std::vector<double>(ndsize<3>(soa_t<>{}, space));
+    ndwrite_soa(buf.data(), space, ivec(4, 0), dvec(1.0, 2.0, 3.0));
+    assert((ndread<double, 3>(soa_t<>{}, buf.data(), space, ivec(4, 0)) == dvec(1.0, 2.0, 3.0)));
+
+    // One kernel, written once, runs on every layout
+    auto kernel = [&](auto layout) {
+        auto u = std::vector<double>(ndsize<3>(layout, space));
+        for (auto i : space) {
+            ndwrite(layout, u.data(), space, i, dvec(i[0], i[1], i[0] * i[1]));
+        }
+        auto total = 0.0;
+        for (auto i : space) {
+            auto v = ndread<double, 3>(layout, u.data(), space, i);
+            total += v[0] + v[1] + v[2];
+        }
+        return total;
+    };
+    assert(kernel(aos_t<>{}) == kernel(soa_t<>{}));
+    assert(kernel(aos_t<>{}) == kernel(aosoa_t<4>{}));
+
+    std::cout << "PASSED\n";
+}
+
+void test_permute() {
+    std::cout << "Testing blocked axis permutation... ";
+
+    auto space = index_space(ivec(-2, 1, 3), uvec(37, 5, 70));
+    auto src = std::vector<double>(size(space));
+    for (auto i : space) {
+        src[ndoffset(space, i)] = i[0] * 10000.0 + i[1] * 100.0 + i[2];
+    }
+    assert(permute(space, uvec(2, 0, 1)) == index_space(ivec(3, -2, 1), uvec(70, 37, 5)));
+
+    auto perms = std::vector<uvec_t<3>>{
+        uvec(0, 1, 2), uvec(0, 2, 1), uvec(1, 0, 2), uvec(1, 2, 0), uvec(2, 0, 1), uvec(2, 1, 0)
+    };
+    for (auto perm : perms) {
+        auto dst_space = permute(space, perm);
+        auto dst = std::vector<double>(size(space), -1.0);
+        permute(src.data(), dst.data(), space, perm, threads_t{._num_threads = 3});
+
+        for (auto i : space) {
+            assert(dst[ndoffset(dst_space, permute(i, perm))] == src[ndoffset(space, i)]);
+        }
+    }
+
+    // 2D transpose, twice, is the identity
+    auto plane = index_space(ivec(0, 0), uvec(65, 33));
+    auto a = std::vector<int>(size(plane));
+    auto b = std::vector<int>(size(plane));
+    auto c = std::vector<int>(size(plane));
+    for (std::size_t n = 0; n < a.size(); ++n) a[n] = static_cast<int>(n);
+    permute(a.data(), b.data(), plane, swap_axes<2>(0, 1));
+    permute(b.data(), c.data(), permute(plane, swap_axes<2>(0, 1)), swap_axes<2>(0, 1), threads_t{._num_threads = 2});
+    assert(b[1] == 33 && a == c);
+
+    auto threw = false;
+    try {
+        permute(a.data(), b.data(), plane, uvec(1, 1));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_multi_patch_traversal() {
+    std::cout << "Testing multi-patch traversal... ";
+
+    static_assert(PatchRange<std::vector<index_space_t<2>>> && !PatchRange<index_space_t<2>>);
+
+    // Patches of very different sizes, including an empty one
+    auto spaces = std::vector<index_space_t<2>>{
+        index_space(ivec(0, 0), uvec(40, 30)),
+        index_space(ivec(5, 5), uvec(1, 1)),
+        index_space(ivec(0, 0), uvec(0, 4)),
+        index_space(ivec(-3, 2), uvec(3, 7))
+    };
+    auto buffers = std::vector<std::vector<double>>{};
+    auto blocks = std::vector<user::block_t>{};
+    for (const auto& space : spaces) {
+        buffers.push_back(std::vector<double>(size(space), 0.0));
+    }
+    for (std::size_t n = 0; n < spaces.size(); ++n) {
+        blocks.push_back(user::block_t{spaces[n], &buffers[n]});
+    }
+
+    for_each(blocks, [](const user::block_t& b, ivec_t<2> i) {
+        (*b._data)[ndoffset(b._space, i)] += i[0] + 100.0 * i[1];
+    }, threads_t{._chunking = chunking::dynamic, ._grain = 17, ._num_threads = 3});
+
+    for (std::size_t n = 0; n < spaces.size(); ++n) {
+        for (auto i : spaces[n]) {
+            assert(buffers[n][ndoffset(spaces[n], i)] == i[0] + 100.0 * i[1]);
+        }
+    }
+
+    auto count = map_reduce(spaces, 0, [](const auto&, ivec_t<2>) { return 1; }, std::plus<>{}, user::reverse_t{});
+    assert(count == 1200 + 1 + 21);
+
+    auto total = map_reduce(blocks, 0.0, [](const user::block_t& b, ivec_t<2> i) {
+        return (*b._data)[ndoffset(b._space, i)];
+    }, std::plus<>{}, threads_t{._num_threads = 2});
+    assert(total == map_reduce(blocks, 0.0, [](const user::block_t&, ivec_t<2> i) { return i[0] + 100.0 * i[1]; }, std::plus<>{}));
+
+    std::cout << "PASSED\n";
+}
+
+void test_persistent_team() {
+    std::cout << "Testing persistent thread team... ";
+
+    long n = 9 * 10 * 11;
+    long expected = n * (n - 1) / 2;
+    auto team = team_t(4);
+    assert(num_workers(team) == 4);
+
+    // Many back-to-back regions reuse the same workers
+    for (auto c : {chunking::static_, chunking::dynamic, chunking::guided}) {
+        team._chunking = c;
+        for (int region = 0; region < 50; ++region) {
+            assert(visits_each_index_once(team));
+            assert(sum_of_offsets(team) == expected);
+        }
+    }
+
+    // Inside a scope, threads_t kernels run on the team, unless they ask
+    // for a different number of threads
+    {
+        auto scope = team_scope_t(team);
+        assert(num_workers(threads_t{}) == 4);
+        assert(num_workers(threads_t{._num_threads = 4}) == 4);
+        assert(num_workers(threads_t{._num_threads = 2}) == 2);
+        assert(sum_of_offsets(threads_t{._chunking = chunking::dynamic}) == expected);
+        assert(sum_of_offsets(exec::threads) == expected);
+
+        // Nested regions run serially on the calling worker
+        auto counts = std::vector<int>(64, 0);
+        for_each(index_space(ivec(0), uvec(8)), [&](ivec_t<1> i) {
+            for_each(index_space(ivec(0), uvec(8)), [&](ivec_t<1> j) {
+                counts[8 * i[0] + j[0]] += 1;
+            }, threads_t{});
+        }, threads_t{});
+        assert(std::all_of(counts.begin(), counts.end(), [](int c) { return c == 1; }));
+    }
+    assert(num_workers(threads_t{._num_threads = 3}) == 3);
+
+    // Exceptions raised by workers propagate, and the team stays usable
+    auto threw = false;
+    try {
+        for_each(index_space(ivec(0), uvec(100)), [](ivec_t<1> i) {
+            if (i[0] == 42) throw std::runtime_error("bad zone");
+        }, team);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+    assert(sum_of_offsets(team) == expected);
+    assert(num_workers(team_t(1)) == 1 && sum_of_offsets(team_t(1)) == expected);
+
+    std::cout << "PASSED\n";
+}
+
+void test_affinity() {
+    std::cout << "Testing thread affinity... ";
+
+    assert(parse_affinity("none")._policy == affinity::none);
+    assert(parse_affinity("scatter")._policy == affinity::scatter);
+    auto list = parse_affinity("3,0,12");
+    assert(list._policy == affinity::list && list._cpus == std::vector<unsigned int>({3, 0, 12}));
+
+    for (auto bad : {"", "1,,2", "0,1,", "nearest", "-1"}) {
+        auto threw = false;
+        try {
+            parse_affinity(bad);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // Compact and scatter place workers on every allowed CPU exactly once
+    auto cpus = detail::cpu_order(affinity::compact);
+    auto scattered = detail::cpu_order(affinity::scatter);
+    std::sort(scattered.begin(), scattered.end());
+    std::sort(cpus.begin(), cpus.end());
+    assert(!cpus.empty() && cpus == scattered);
+    assert(detail::affinity_cpu(affinity_t{}, 3) == -1);
+    assert(detail::affinity_cpu(list, 4) == 0);
+
+    // Pinned workers run where they are placed, and compute the same results
+    #ifdef __linux__
+    auto pin = affinity_t{affinity::list, {cpus.front()}};
+    auto placed = std::vector<int>(3, -1);
+    execute(threads_t{._grain = 1, ._num_threads = 3, ._affinity = pin}, 3, [&](std::size_t, std::size_t, std::size_t worker) {
+        placed[worker] = sched_getcpu();
+    });
+    for (std::size_t w = 1; w < placed.size(); ++w) {
+        assert(placed[w] == static_cast<int>(cpus.front()));
+    }
+
+    // The calling thread takes part as worker 0, but regions leave its mask
+    // alone; a team scope pins it once, and gives its mask back
+    cpu_set_t before, after;
+    pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+    for_each(index_space(ivec(0), uvec(3)), [](ivec_t<1>) {}, threads_t{._num_threads = 3, ._affinity = pin});
+    for_each(index_space(ivec(0), uvec(3)), [](ivec_t<1>) {}, team_t(3, pin));
+    assert(detail::pinned_cpu() == -1);
+    {
+        auto pinned = team_t(3, pin);
+        auto scope = team_scope_t(pinned);
+        assert(detail::pinned_cpu() == static_cast<int>(cpus.front()));
+        for (int k = 0; k < 4; ++k) {
+            for_each(index_space(ivec(0), uvec(3)), [](ivec_t<1>) {}, threads_t{});
+        }
+        assert(detail::pinned_cpu() == static_cast<int>(cpus.front()));
+    }
+    pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+    assert(CPU_EQUAL(&before, &after));
+    assert(detail::pinned_cpu() == -1);
+    #endif
+
+    // Slices of an affinity place two sets of workers side by side
+    auto slice = detail::affinity_slice(list, 2, 2);
+    assert(slice._policy == affinity::list && slice._cpus == std::vector<unsigned int>({12, 3}));
+    assert(detail::affinity_slice(affinity_t{}, 2, 2)._policy == affinity::none);
+    auto team = team_t(3, affinity_t{affinity::compact, {}});
+    assert(sum_of_offsets(team) == sum_of_offsets(cpu_t{}));
+    assert(sum_of_offsets(threads_t{._num_threads = 2, ._affinity = {affinity::scatter, {}}}) == sum_of_offsets(cpu_t{}));
+
+    std::cout << "PASSED\n";
+}
+
+void test_workspace_traversal() {
+    std::cout << "Testing workspace traversal... ";
+
+    // Each index sums a pencil it builds in its thread's workspace
+    auto space = index_space(ivec(0, 0), uvec(20, 30));
+    auto out = std::vector<double>(size(space));
+    auto kernel = [&](ivec_t<2> i, std::span<double> ws) {
+        assert(ws.size() == 16);
+        for (std::size_t k = 0; k < ws.size(); ++k) {
+            ws[k] = i[0] + 0.5 * k;
+        }
+        auto sum = 0.0;
+        for (auto x : ws) sum += x;
+        out[ndoffset(space, i)] = sum;
+    };
+    auto check = [&] {
+        for (auto i : space) {
+            assert(out[ndoffset(space, i)] == 16.0 * i[0] + 60.0);
+        }
+    };
+    for_each(space, workspace<double>(16), kernel, threads_t{._chunking = chunking::dynamic, ._num_threads = 4});
+    check();
+    for_each(space, workspace<double>(16), kernel);
+    check();
+
+    // A persistent team's threads reuse their buffers across calls
+    auto team = team_t(3);
+    auto buffers = std::vector<std::vector<const void*>>(2);
+    auto mutex = std::mutex();
+    for (auto& seen : buffers) {
+        for_each(space, workspace<int>(100), [&](ivec_t<2>, std::span<int> ws) {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            if (std::find(seen.begin(), seen.end(), ws.data()) == seen.end()) {
+                seen.push_back(ws.data());
+            }
+        }, team);
+        std::sort(seen.begin(), seen.end());
+    }
+    assert(buffers[0].size() <= 3 && buffers[0] == buffers[1]);
+
+    // Nested traversals get separate buffers
+    for_each(index_space(ivec(0), uvec(4)), workspace<int>(8), [](ivec_t<1>, std::span<int> outer) {
+        outer[0] = 7;
+        for_each(index_space(ivec(0), uvec(3)), workspace<int>(8), [&](ivec_t<1>, std::span<int> inner) {
+            assert(inner.data() != outer.data());
+            inner[0] = -1;
+        });
+        assert(outer[0] == 7);
+    });
+
+    // A buffer that cannot be allocated does not leave its depth taken
+    auto threw = false;
+    try {
+        for_each(index_space(ivec(0), uvec(1)), workspace<int>(std::vector<int>().max_size() + 1), [](ivec_t<1>, std::span<int>) {});
+    } catch (const std::length_error&) {
+        threw = true;
+    }
+    assert(threw);
+    assert(detail::workspace_stack<int>()._depth == 0);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Core Library Tests ===\n\n";
+
+    test_executor_concept();
+    test_for_each_executors();
+    test_map_reduce_executors();
+    test_runtime_exec();
+    test_pack_arithmetic();
+    test_simd_traversal();
+    test_vec_operators();
+    test_curve_traversal();
+    test_bricked_layout();
+    test_padded_layout();
+    test_component_layouts();
+    test_permute();
+    test_multi_patch_traversal();
+    test_persistent_team();
+    test_affinity();
+    test_workspace_traversal();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
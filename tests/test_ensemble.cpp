@@ -0,0 +1,381 @@
+#include <iostream>
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/driver.hpp"
+#include "mist/ensemble.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// A small physics: exponential decay of 64 zones at a configurable rate,
+// stepped with a threaded kernel, which is its own product
+// =============================================================================
+
+namespace decay {
+
+struct physics {
+    struct config_t {
+        double rate = 1.0;
+
+        auto fields() const {
+            return std::make_tuple(field("rate", rate));
+        }
+    };
+
+    struct state_t {
+        double time = 0.0;
+        std::vector<double> u;
+
+        auto fields() const {
+            return std::make_tuple(field("time", time), field("u", u));
+        }
+    };
+    using product_t = state_t;
+
+    // W members, interleaved
+    template<std::size_t W>
+    struct lane_state_t {
+        pack_t<double, W> time;
+        std::vector<pack_t<double, W>> u;
+    };
+};
+
+using config_t = physics::config_t;
+using state_t = physics::state_t;
+
+state_t initial_state(const config_t&) {
+    auto s = state_t{0.0, {}};
+    for (int i = 0; i < 64; ++i) {
+        s.u.push_back(1.0 + i);
+    }
+    return s;
+}
+
+// The threads the kernel has run on, and whether any ran without a team
+std::mutex kernel_mutex;
+std::set<std::thread::id> kernel_threads;
+bool kernel_without_team = false;
+
+state_t euler_step(const config_t& cfg, const state_t& s, double dt) {
+    auto next = s;
+    next.time += dt;
+    for_each(index_space(ivec(0), uvec(64)), [&](ivec_t<1> i) {
+        next.u[i[0]] -= dt * cfg.rate * s.u[i[0]];
+    }, threads_t{});
+    auto lock = std::lock_guard<std::mutex>(kernel_mutex);
+    kernel_threads.insert(std::this_thread::get_id());
+    kernel_without_team = kernel_without_team || detail::current_team() == nullptr;
+    return next;
+}
+
+double courant_time(const config_t& cfg, const state_t&) {
+    return 0.1 / cfg.rate;
+}
+
+state_t average(const state_t& a, const state_t& b, double alpha) {
+    auto result = a;
+    result.time = (1.0 - alpha) * a.time + alpha * b.time;
+    for (std::size_t n = 0; n < a.u.size(); ++n) {
+        result.u[n] = (1.0 - alpha) * a.u[n] + alpha * b.u[n];
+    }
+    return result;
+}
+
+state_t get_product(const config_t&, const state_t& s) {
+    return s;
+}
+
+double get_time(const state_t& s, int kind) {
+    if (kind == 0) return s.time;
+    throw std::out_of_range("no such time kind");
+}
+
+std::size_t zone_count(const state_t& s) {
+    return s.u.size();
+}
+
+std::vector<std::pair<std::string, double>> timeseries_sample(const config_t&, const state_t& s) {
+    return {{"u0", s.u[0]}};
+}
+
+// The same, on W members at once
+
+template<std::size_t W>
+physics::lane_state_t<W> interleave(const std::array<state_t, W>& states) {
+    auto ls = physics::lane_state_t<W>{{}, std::vector<pack_t<double, W>>(states[0].u.size())};
+    for (std::size_t l = 0; l < W; ++l) {
+        ls.time[l] = states[l].time;
+        for (std::size_t i = 0; i < ls.u.size(); ++i) {
+            ls.u[i][l] = states[l].u[i];
+        }
+    }
+    return ls;
+}
+
+template<std::size_t W>
+state_t extract_lane(const physics::lane_state_t<W>& ls, std::size_t l) {
+    auto s = state_t{ls.time[l], {}};
+    for (const auto& u : ls.u) {
+        s.u.push_back(u[l]);
+    }
+    return s;
+}
+
+template<std::size_t W>
+pack_t<double, W> rates(const std::array<config_t, W>& cfgs) {
+    auto rate = pack_t<double, W>{};
+    for (std::size_t l = 0; l < W; ++l) {
+        rate[l] = cfgs[l].rate;
+    }
+    return rate;
+}
+
+template<std::size_t W>
+physics::lane_state_t<W> euler_step(const std::array<config_t, W>& cfgs, const physics::lane_state_t<W>& s, const pack_t<double, W>& dt) {
+    auto next = s;
+    auto rate = rates(cfgs);
+    next.time = next.time + dt;
+    for (std::size_t i = 0; i < s.u.size(); ++i) {
+        next.u[i] = next.u[i] - dt * rate * s.u[i];
+    }
+    return next;
+}
+
+template<std::size_t W>
+pack_t<double, W> courant_time(const std::array<config_t, W>& cfgs, const physics::lane_state_t<W>&) {
+    return 0.1 / rates(cfgs);
+}
+
+template<std::size_t W>
+physics::lane_state_t<W> average(const physics::lane_state_t<W>& a, const physics::lane_state_t<W>& b, double alpha) {
+    auto result = a;
+    result.time = (1.0 - alpha) * a.time + alpha * b.time;
+    for (std::size_t n = 0; n < a.u.size(); ++n) {
+        result.u[n] = (1.0 - alpha) * a.u[n] + alpha * b.u[n];
+    }
+    return result;
+}
+
+template<std::size_t W>
+pack_t<double, W> get_time(const physics::lane_state_t<W>& ls, int kind) {
+    if (kind == 0) return ls.time;
+    throw std::out_of_range("no such time kind");
+}
+
+} // namespace decay
+
+static_assert(LanePhysics<decay::physics, 4>);
+
+// =============================================================================
+// Helpers
+// =============================================================================
+
+static std::vector<config<decay::physics>> sweep(std::size_t n) {
+    auto members = std::vector<config<decay::physics>>(n);
+    for (std::size_t k = 0; k < n; ++k) {
+        members[k].driver.t_final = 0.5;
+        members[k].driver.message_interval = 10.0;
+        members[k].driver.checkpoint_interval = 0.25;
+        members[k].physics.rate = 1.0 + 0.5 * static_cast<double>(k);
+    }
+    return members;
+}
+
+static std::string contents(const std::string& filename) {
+    auto file = std::ifstream(filename);
+    auto ss = std::stringstream{};
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_plan() {
+    std::cout << "Testing ensemble thread plans... ";
+
+    auto plan = plan_ensemble(100, {.threads = 8});
+    assert(plan.concurrent == 8 && plan.member_threads == 1);
+
+    plan = plan_ensemble(2, {.threads = 8});
+    assert(plan.concurrent == 2 && plan.member_threads == 4);
+
+    plan = plan_ensemble(3, {.threads = 8});
+    assert(plan.concurrent == 3 && plan.member_threads == 2);
+
+    plan = plan_ensemble(5, {.threads = 8, .member_threads = 4});
+    assert(plan.concurrent == 2 && plan.member_threads == 4);
+
+    plan = plan_ensemble(5, {.threads = 2, .member_threads = 16});
+    assert(plan.concurrent == 1 && plan.member_threads == 2);
+
+    plan = plan_ensemble(0, {.threads = 4});
+    assert(plan.concurrent == 1 && plan.member_threads == 4);
+
+    auto members = sweep(2);
+    members[1].driver.output_directory = "chosen";
+    members[1].driver.task_threads = 4;
+    members[1].driver.affinity = "compact";
+
+    auto ecfg = ensemble::config_t{.threads = 8, .directory = "sweep"};
+    plan = plan_ensemble(members.size(), ecfg);
+    auto a = ensemble_member_config(members[0], 0, ecfg, plan);
+    auto b = ensemble_member_config(members[1], 1, ecfg, plan);
+
+    assert(a.driver.output_directory == "sweep.0000");
+    assert(b.driver.output_directory == "chosen");
+    assert(a.driver.team_threads == 4 && b.driver.task_threads == 0);
+    assert(b.driver.affinity == "none");
+
+    // Members on one thread each still get a team, of one
+    plan = plan_ensemble(members.size(), {.threads = 2});
+    assert(ensemble_member_config(members[0], 0, ecfg, plan).driver.team_threads == 1);
+
+    std::cout << "PASSED\n";
+}
+
+void test_ensemble_run() {
+    std::cout << "Testing ensemble runs... ";
+
+    auto members = sweep(6);
+
+    // Each member alone, in turn
+    auto serial = std::vector<decay::state_t>{};
+    auto serial_states = std::vector<driver_state_t>(members.size());
+    for (std::size_t k = 0; k < members.size(); ++k) {
+        auto cfg = members[k];
+        cfg.driver.output_directory = "serial." + std::to_string(k);
+        serial.push_back(run(cfg, serial_states[k]));
+    }
+
+    // Many members on few threads, and few members with a team each
+    for (auto ecfg : {ensemble::config_t{.threads = 3}, ensemble::config_t{.threads = 4, .member_threads = 2}}) {
+        auto driver_states = std::vector<driver_state_t>{};
+        decay::kernel_threads.clear();
+        decay::kernel_without_team = false;
+        auto finals = run_ensemble(members, driver_states, ecfg);
+
+        // Members' kernels run on their teams, so with one thread per member
+        // on nothing but the pool's workers
+        assert(!decay::kernel_without_team);
+        if (ecfg.member_threads == 0) {
+            assert(decay::kernel_threads.size() <= 3);
+        }
+
+        assert(finals.size() == members.size());
+        assert(driver_states.size() == members.size());
+
+        for (std::size_t k = 0; k < members.size(); ++k) {
+            auto dir = std::string("member.000") + std::to_string(k);
+            assert(finals[k].u == serial[k].u);
+            assert(driver_states[k].iteration == serial_states[k].iteration);
+            assert(driver_states[k].timeseries_data == serial_states[k].timeseries_data);
+            assert(std::filesystem::exists(dir + "/chkpt.0001.dat"));
+            assert(contents(dir + "/prods.0003.dat") == contents("serial." + std::to_string(k) + "/prods.0003.dat"));
+        }
+        std::filesystem::remove_all("member.0000");
+    }
+    assert(!std::filesystem::exists("chkpt.0000.dat"));
+
+    // A failing member is reported
+    members[4].driver.rk_order = 5;
+    auto threw = false;
+    try {
+        run_ensemble(members, {.threads = 2});
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_lanes() {
+    std::cout << "Testing ensemble members in SIMD lanes... ";
+
+    // Members with different rates, so each lane takes its own time steps,
+    // and different end times and product intervals
+    auto members = sweep(6);
+    members[1].driver.t_final = 0.3;
+    members[2].driver.max_iter = 3;
+    members[5].driver.products_interval = 0.07;
+
+    auto serial = std::vector<decay::state_t>{};
+    auto serial_states = std::vector<driver_state_t>(members.size());
+    for (std::size_t k = 0; k < members.size(); ++k) {
+        auto cfg = members[k];
+        cfg.driver.output_directory = "single." + std::to_string(k);
+        serial.push_back(run(cfg, serial_states[k]));
+    }
+
+    // Six members in a full pack of four and a partial one, on two threads
+    auto driver_states = std::vector<driver_state_t>{};
+    auto finals = run_lanes<4>(members, driver_states, {.threads = 2, .directory = "lanes"});
+
+    assert(finals.size() == members.size());
+    for (std::size_t k = 0; k < members.size(); ++k) {
+        auto dir = std::string("lanes.000") + std::to_string(k);
+        auto reference = "single." + std::to_string(k);
+        assert(finals[k].time == serial[k].time);
+        assert(finals[k].u == serial[k].u);
+        assert(driver_states[k].iteration == serial_states[k].iteration);
+        assert(driver_states[k].products_count == serial_states[k].products_count);
+        assert(driver_states[k].timeseries_data == serial_states[k].timeseries_data);
+
+        for (int n = 0; n <= driver_states[k].products_count; ++n) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/prods.%04d.dat", n);
+            assert(contents(dir + name) == contents(reference + name));
+        }
+        assert(std::filesystem::exists(dir + "/chkpt.0001.dat") == std::filesystem::exists(reference + "/chkpt.0001.dat"));
+        assert(contents(dir + "/chkpt.0001.dat") == contents(reference + "/chkpt.0001.dat"));
+    }
+    assert(driver_states[2].iteration == 3);
+
+    // Members sharing a pack share an integrator
+    members[1].driver.rk_order = 3;
+    auto threw = false;
+    try {
+        run_lanes<4>(members, {.threads = 1});
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Ensemble Tests ===\n\n";
+
+    auto dir = std::filesystem::temp_directory_path() / "mist_test_ensemble";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto cwd = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+
+    test_plan();
+    test_ensemble_run();
+    test_lanes();
+
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(dir);
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/ascii_reader.hpp"
+#include "mist/ascii_writer.hpp"
+#include "mist/serialize.hpp"
+#include "mist/array.hpp"
+#include "mist/memory.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_default_init_allocator() {
+    std::cout << "Testing default_init_allocator... ";
+
+    static_assert(std::same_as<std::allocator_traits<default_init_allocator<double>>::rebind_alloc<int>, default_init_allocator<int>>);
+
+    // Explicit values are still constructed as usual
+    auto u = first_touch_vector<double>(100, 2.5);
+    assert(u.size() == 100 && u[0] == 2.5 && u[99] == 2.5);
+    u.resize(150);
+    u.assign(150, 1.0);
+    assert(u[149] == 1.0);
+
+    auto strings = std::vector<std::string, default_init_allocator<std::string>>(3);
+    assert(strings[2].empty());
+
+    std::cout << "PASSED\n";
+}
+
+void test_first_touch() {
+    std::cout << "Testing parallel first-touch initialization... ";
+
+    auto space = index_space(ivec(-4, 2, 0), uvec(17, 9, 6));
+    auto init = [](const ivec_t<3>& i) { return 100.0 * i[0] + 10.0 * i[1] + i[2]; };
+
+    auto a = first_touch<double>(space, init, threads_t{._num_threads = 4, ._affinity = {affinity::compact, {}}});
+    auto b = first_touch<double>(space, init, team_t(3));
+    auto c = first_touch<double>(space, init, cpu_t{});
+    assert(a.size() == size(space));
+
+    for (auto i : space) {
+        assert(a[ndoffset(space, i)] == init(i));
+    }
+    assert(a == b && b == c);
+
+    auto v = view(a, space);
+    assert(v[ivec(12, 10, 5)] == 1305.0);
+
+    std::cout << "PASSED\n";
+}
+
+template<typename V>
+bool is_aligned(const V& v, std::size_t alignment) {
+    return reinterpret_cast<std::uintptr_t>(v.data()) % alignment == 0;
+}
+
+void test_aligned_allocator() {
+    std::cout << "Testing aligned and huge-page allocators... ";
+
+    auto a = aligned_vector<double>(1001, 1.5);
+    auto b = aligned_vector<char, 4096>(3);
+    auto c = aligned_vector<double, 64, huge_pages::transparent>(1 << 19, 2.0);
+    auto d = aligned_vector<float, 64, huge_pages::explicit_>(100, 3.0f);
+    auto e = std::vector<double, default_init_allocator<double, aligned_allocator<double>>>(77);
+
+    assert(is_aligned(a, 64) && is_aligned(b, 4096) && is_aligned(c, 2 << 20) && is_aligned(d, 64) && is_aligned(e, 64));
+    assert(a[1000] == 1.5 && c[(1 << 19) - 1] == 2.0 && d[99] == 3.0f);
+
+    // Growth reallocates through the allocator and keeps the values
+    for (int n = 0; n < 5000; ++n) {
+        a.push_back(n);
+    }
+    assert(is_aligned(a, 64) && a[1000] == 1.5 && a.back() == 4999.0);
+    static_assert(aligned_allocator<char, 16>::alignment == 16 && aligned_allocator<long double, 1>::alignment == alignof(long double));
+
+    // Vectors with any allocator serialize like std::vector
+    auto os = std::ostringstream();
+    auto writer = ascii_writer(os);
+    serialize(writer, "values", aligned_vector<double>{1.0, 2.5, -3.0});
+    auto is = std::istringstream(os.str());
+    auto reader = ascii_reader(is);
+    auto values = aligned_vector<double>{};
+    deserialize(reader, "values", values);
+    assert((values == aligned_vector<double>{1.0, 2.5, -3.0}));
+
+    std::cout << "PASSED\n";
+}
+
+void test_arena() {
+    std::cout << "Testing arena allocation... ";
+
+    auto arena = arena_t(1024);
+    auto a = static_cast<char*>(allocate(arena, 3, 1));
+    auto b = static_cast<double*>(allocate(arena, 5 * sizeof(double), alignof(double)));
+    assert(reinterpret_cast<std::uintptr_t>(b) % alignof(double) == 0);
+    assert(reinterpret_cast<char*>(b) - a == 8);
+    assert(capacity(arena) == 1024);
+
+    // Growth adds blocks; a reset merges them into one that holds them all
+    allocate(arena, 1000, 64);
+    allocate(arena, 5000, 64);
+    assert(arena._blocks.size() == 3 && capacity(arena) == 1024 + 1024 + 5056);
+    reset(arena);
+    assert(arena._blocks.size() == 1 && capacity(arena) == 7104 && arena._used == 0);
+    allocate(arena, 7000, 8);
+    assert(arena._blocks.size() == 1);
+
+    auto threw = false;
+    try {
+        allocate(arena, 8, 128);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Vectors on an arena; growth leaves the old storage until a reset
+    auto v = arena_vector<int>(arena_allocator<int>(&arena));
+    for (int n = 0; n < 100; ++n) {
+        v.push_back(n);
+    }
+    assert(v[99] == 99 && v.get_allocator() == arena_allocator<double>(&arena));
+    reset(arena);
+
+    // scratch() draws from the arena installed on this thread, else the heap
+    auto heap = scratch<double>(10, 1.0);
+    assert(heap.get_allocator()._arena == nullptr && heap[9] == 1.0);
+    {
+        auto scope = arena_scope_t(arena);
+        auto temp = scratch<double>(100);
+        assert(temp.get_allocator()._arena == &arena && temp[99] == 0.0);
+        {
+            auto inner_arena = arena_t();
+            auto inner = arena_scope_t(inner_arena);
+            assert(current_arena() == &inner_arena);
+        }
+        assert(current_arena() == &arena);
+    }
+    assert(current_arena() == nullptr);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Memory Library Tests ===\n\n";
+
+    test_default_init_allocator();
+    test_first_touch();
+    test_aligned_allocator();
+    test_arena();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
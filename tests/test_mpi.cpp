@@ -0,0 +1,339 @@
+#include <iostream>
+#include <cassert>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/array.hpp"
+#include "mist/boundary.hpp"
+#include "mist/mpi.hpp"
+
+using namespace mist;
+
+// Run with any number of ranks, e.g. mpirun -np 4 ./tests/test_mpi
+
+// =============================================================================
+// Helpers
+// =============================================================================
+
+static bool is_root() {
+    return comm_rank(MPI_COMM_WORLD) == 0;
+}
+
+static void begin_test(const char* name) {
+    if (is_root()) std::cout << "Testing " << name << "... " << std::flush;
+}
+
+static void end_test() {
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (is_root()) std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_decomposition() {
+    begin_test("domain decomposition");
+
+    auto global = index_space(ivec(-3, 2), uvec(13, 7));
+    auto d = decompose(global);
+    auto ranks = comm_size(MPI_COMM_WORLD);
+    auto owner = std::vector<int>(size(global), -1);
+
+    assert(static_cast<int>(product(d._blocks)) == ranks);
+
+    // The subspaces tile the global space
+    for (int r = 0; r < ranks; ++r) {
+        auto sub = subspace(d, r);
+        assert(intersect(sub, global) == sub);
+        assert(block_rank(d, block_coordinates(d, r)) == r);
+
+        for (auto i : sub) {
+            assert(owner[ndoffset(global, i)] == -1);
+            owner[ndoffset(global, i)] = r;
+        }
+    }
+    for (auto r : owner) {
+        assert(r >= 0);
+    }
+    assert(local_space(d) == subspace(d, comm_rank(MPI_COMM_WORLD)));
+
+    // Neighbors past a non-periodic edge do not exist
+    auto coords = block_coordinates(d, d._rank);
+    if (coords[0] == 0) {
+        assert(neighbor(d, ivec(-1, 0)) == MPI_PROC_NULL);
+    }
+    assert(neighbor(d, ivec(0, 0)) == d._rank);
+
+    auto threw = false;
+    try {
+        decompose(index_space(ivec(0), uvec(static_cast<unsigned int>(ranks) - 1)));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    end_test();
+}
+
+void test_distributed_ghosts() {
+    begin_test("distributed ghost fill");
+
+    auto global = index_space(ivec(0, 0), uvec(12, 9));
+    auto bc = boundary_conditions_t<2>{
+        {boundary::outflow, boundary::periodic},
+        {boundary::reflecting, boundary::periodic}
+    };
+    auto flip = [](dvec_t<2> x, std::size_t axis) {
+        x[axis] = -x[axis];
+        return x;
+    };
+    auto value = [](const ivec_t<2>& i) {
+        return dvec(i[0] + 0.5, 100.0 * i[1]);
+    };
+
+    // The reference: the whole space filled by a single process
+    auto padded = expand(global, 2);
+    auto g = std::vector<dvec_t<2>>(size(padded));
+    auto gv = view(g, padded);
+    for (auto i : global) {
+        gv[i] = value(i);
+    }
+    fill_ghosts(gv, global, bc, cpu_t{}, flip);
+
+    auto d = decompose(global, MPI_COMM_WORLD, {false, true});
+    auto local = local_space(d);
+    auto u = std::vector<dvec_t<2>>(size(expand(local, 2)), dvec(-1.0, -1.0));
+    auto v = view(u, expand(local, 2));
+
+    for (auto i : local) {
+        v[i] = value(i);
+    }
+    fill_ghosts(d, v, bc, threads_t{._num_threads = 2}, flip);
+
+    for (auto i : domain(v)) {
+        auto j = ivec(i[0], (i[1] + 9) % 9);
+        assert(v[i] == gv[j]);
+    }
+
+    // Boundary types must agree with the periodic axes
+    auto threw = false;
+    try {
+        fill_ghosts(d, v, boundary_conditions<2>(boundary::outflow));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    end_test();
+}
+
+void test_overlapped_stencil() {
+    begin_test("overlapped halo exchange");
+
+    auto global = index_space(ivec(0, 0, 0), uvec(10, 8, 6));
+    auto bc = boundary_conditions<3>(boundary::periodic);
+    auto value = [](const ivec_t<3>& i) {
+        return 1.0 * i[0] * i[0] + 3.0 * i[1] - 0.25 * i[2] * i[1];
+    };
+    auto laplacian = [](const array_view_t<double, 3>& u, const ivec_t<3>& i) {
+        auto result = -6.0 * u[i];
+        for (std::size_t a = 0; a < 3; ++a) {
+            auto e = ivec(0, 0, 0);
+            e[a] = 1;
+            result += u[i + e] + u[i - e];
+        }
+        return result;
+    };
+
+    auto padded = expand(global, 1);
+    auto g = std::vector<double>(size(padded));
+    auto gv = view(g, padded);
+    for (auto i : global) {
+        gv[i] = value(i);
+    }
+    fill_ghosts(gv, global, bc);
+
+    auto d = decompose(global, MPI_COMM_WORLD, {true, true, true});
+    auto local = local_space(d);
+    auto u = std::vector<double>(size(expand(local, 1)), 0.0);
+    auto v = view(u, expand(local, 1));
+    auto du = std::vector<double>(size(local), 0.0);
+    auto dv = view(du, local);
+
+    for (auto i : local) {
+        v[i] = value(i);
+    }
+    for_each_exchanging(d, v, bc, [&](const ivec_t<3>& i) {
+        dv[i] = laplacian(v, i);
+    }, threads_t{._num_threads = 3});
+
+    for (auto i : local) {
+        assert(dv[i] == laplacian(gv, i));
+    }
+
+    end_test();
+}
+
+void test_global_reductions() {
+    begin_test("global reductions");
+
+    auto global = index_space(ivec(-5), uvec(101));
+    auto d = decompose(global);
+
+    auto total = map_reduce(d, 7.0, [](const ivec_t<1>& i) {
+        return 1.0 * i[0];
+    }, [](double a, double b) {
+        return a + b;
+    }, threads_t{._num_threads = 2});
+    assert(total == 7.0 + (-5 + 95) * 101 / 2.0);
+
+    auto smallest = map_reduce(d, 1e9, [](const ivec_t<1>& i) {
+        return 1.0 / (1.0 + (i[0] - 40) * (i[0] - 40));
+    }, [](double a, double b) {
+        return std::min(a, b);
+    });
+    assert(smallest == 1.0 / (1.0 + 55.0 * 55.0));
+
+    // Every rank gets the same result, folded in rank order
+    auto ranks = comm_size(MPI_COMM_WORLD);
+    auto digits = allreduce(MPI_COMM_WORLD, comm_rank(MPI_COMM_WORLD), [](int a, int b) {
+        return 10 * a + b;
+    });
+    auto expected = 0;
+    for (int r = 1; r < ranks; ++r) {
+        expected = 10 * expected + r;
+    }
+    assert(digits == expected);
+
+    end_test();
+}
+
+void test_sharded_restart() {
+    begin_test("sharded output on a different rank count");
+
+    auto dir = std::filesystem::temp_directory_path() / "mist_test_mpi";
+    if (is_root()) {
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto global = index_space(ivec(0, -4), uvec(11, 7));
+    auto value = [](const ivec_t<2>& i) {
+        return 1000.0 * i[0] + i[1];
+    };
+    auto prefix = (dir / "field.0000").string();
+    write_shards<double>(decompose(global), prefix, value);
+
+    // Restart on all ranks but the last (or on the one rank)
+    auto ranks = comm_size(MPI_COMM_WORLD);
+    auto reading = ranks == 1 || comm_rank(MPI_COMM_WORLD) < ranks - 1;
+    auto comm = MPI_Comm{};
+    MPI_Comm_split(MPI_COMM_WORLD, reading ? 0 : MPI_UNDEFINED, 0, &comm);
+
+    if (reading) {
+        auto d = decompose(global, comm);
+        auto local = local_space(d);
+        auto u = read_shards<double>(d, manifest_filename(prefix));
+
+        for (auto i : local) {
+            assert(u[ndoffset(local, i)] == value(i));
+        }
+        assert(read_manifest<2>(manifest_filename(prefix)).shards.size() == static_cast<std::size_t>(ranks));
+        MPI_Comm_free(&comm);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if (is_root()) {
+        std::filesystem::remove_all(dir);
+    }
+    end_test();
+}
+
+void test_patch_rebalance() {
+    begin_test("patch rebalancing and migration");
+
+    auto rank = static_cast<std::size_t>(comm_rank(MPI_COMM_WORLD));
+    auto ranks = static_cast<std::size_t>(comm_size(MPI_COMM_WORLD));
+    auto global = index_space(ivec(0, 0), uvec(32, 32));
+    auto spaces = std::vector<index_space_t<2>>{};
+
+    for (std::size_t n = 0; n < tile_count(global, uvec(4, 4)); ++n) {
+        spaces.push_back(tile_at(global, uvec(4, 4), n));
+    }
+
+    // Patches dealt out round-robin, each holding its own index; the
+    // patches of one corner are 50 times more expensive, and each rank only
+    // knows the costs of its own
+    auto owner = std::vector<std::size_t>(spaces.size());
+    auto cost = std::vector<double>(spaces.size(), -1.0);
+    auto data = std::vector<std::vector<double>>(spaces.size());
+
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        owner[k] = k % ranks;
+        if (owner[k] == rank) {
+            cost[k] = spaces[k]._start[0] < 8 && spaces[k]._start[1] < 8 ? 50.0 : 1.0;
+            data[k].assign(size(spaces[k]), static_cast<double>(k));
+        }
+    }
+    auto next = rebalance(MPI_COMM_WORLD, spaces, cost, owner);
+
+    // Every rank agrees on the new owners, which balance the total cost
+    auto first = next;
+    MPI_Bcast(first.data(), static_cast<int>(first.size() * sizeof(std::size_t)), MPI_BYTE, 0, MPI_COMM_WORLD);
+    assert(first == next);
+
+    auto total = 0.0;
+    auto loads = std::vector<double>(ranks, 0.0);
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        auto c = spaces[k]._start[0] < 8 && spaces[k]._start[1] < 8 ? 50.0 : 1.0;
+        loads[next[k]] += c;
+        total += c;
+    }
+    for (auto load : loads) {
+        assert(load <= total / static_cast<double>(ranks) + 50.0);
+    }
+
+    // The data follows the patches
+    migrate(MPI_COMM_WORLD, owner, next, data);
+
+    for (std::size_t k = 0; k < spaces.size(); ++k) {
+        if (next[k] == rank) {
+            assert(data[k] == std::vector<double>(size(spaces[k]), static_cast<double>(k)));
+        } else {
+            assert(data[k].empty());
+        }
+    }
+
+    // Migration that costs more than it saves leaves the owners alone
+    if (ranks > 1) {
+        assert(rebalance(MPI_COMM_WORLD, spaces, cost, owner, {._migration_cost = 1e3}) == owner);
+    }
+    end_test();
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(int argc, char** argv) {
+    auto env = mpi_environment_t(argc, argv);
+
+    if (is_root()) {
+        std::cout << "=== MPI Tests (" << comm_size(MPI_COMM_WORLD) << " ranks) ===\n\n";
+    }
+
+    test_decomposition();
+    test_distributed_ghosts();
+    test_overlapped_stencil();
+    test_global_reductions();
+    test_sharded_restart();
+    test_patch_rebalance();
+
+    if (is_root()) {
+        std::cout << "\n=== All tests passed! ===\n";
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include <iostream>
+#include <cassert>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/shards.hpp"
+#include "mist/driver.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// A sharded physics: exponential decay, with each state holding one of two
+// halves of an 8-zone global space
+// =============================================================================
+
+namespace decay {
+
+struct physics {
+    struct config_t {
+        int shard = 0;
+
+        auto fields() const {
+            return std::make_tuple(field("shard", shard));
+        }
+
+        auto fields() {
+            return std::make_tuple(field("shard", shard));
+        }
+    };
+
+    struct state_t {
+        double time = 0.0;
+        std::vector<double> u;
+
+        auto fields() const {
+            return std::make_tuple(field("time", time), field("u", u));
+        }
+
+        auto fields() {
+            return std::make_tuple(field("time", time), field("u", u));
+        }
+    };
+
+    struct product_t {
+        std::vector<double> u;
+
+        auto fields() const {
+            return std::make_tuple(field("u", u));
+        }
+
+        auto fields() {
+            return std::make_tuple(field("u", u));
+        }
+    };
+};
+
+using config_t = physics::config_t;
+using state_t = physics::state_t;
+using product_t = physics::product_t;
+
+shard_layout_t<1> shard_layout(const config_t& cfg, const state_t&) {
+    auto global = index_space(ivec(0), uvec(8));
+    return {global, {index_space(ivec(0), uvec(4)), index_space(ivec(4), uvec(4))}, static_cast<std::size_t>(cfg.shard)};
+}
+
+state_t initial_state(const config_t& cfg) {
+    auto s = state_t{0.0, {}};
+    auto layout = shard_layout(cfg, s);
+    for (auto i : layout._spaces[layout._shard]) {
+        s.u.push_back(1.0 + i[0]);
+    }
+    return s;
+}
+
+state_t euler_step(const config_t&, const state_t& s, double dt) {
+    auto next = s;
+    next.time += dt;
+    for (auto& x : next.u) x -= dt * x;
+    return next;
+}
+
+double courant_time(const config_t&, const state_t&) {
+    return 0.1;
+}
+
+state_t average(const state_t& a, const state_t& b, double alpha) {
+    auto result = a;
+    result.time = (1.0 - alpha) * a.time + alpha * b.time;
+    for (std::size_t n = 0; n < a.u.size(); ++n) {
+        result.u[n] = (1.0 - alpha) * a.u[n] + alpha * b.u[n];
+    }
+    return result;
+}
+
+product_t get_product(const config_t&, const state_t& s) {
+    return {s.u};
+}
+
+double get_time(const state_t& s, int kind) {
+    if (kind == 0) return s.time;
+    throw std::out_of_range("no such time kind");
+}
+
+std::size_t zone_count(const state_t& s) {
+    return s.u.size();
+}
+
+std::vector<std::pair<std::string, double>> timeseries_sample(const config_t&, const state_t& s) {
+    return {{"time", s.time}};
+}
+
+} // namespace decay
+
+static_assert(ShardedPhysics<decay::physics>);
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_manifest() {
+    std::cout << "Testing shard manifests... ";
+
+    auto global = index_space(ivec(-2, 3), uvec(9, 5));
+    auto spaces = std::vector<index_space_t<2>>{
+        index_space(ivec(-2, 3), uvec(4, 5)),
+        index_space(ivec(2, 3), uvec(5, 5))
+    };
+    auto m = make_manifest("out/field.0002", global, spaces);
+
+    assert(shard_filename("out/field.0002", 1) == "out/field.0002.0001.dat");
+    assert(manifest_filename("out/field.0002") == "out/field.0002.manifest");
+    assert(m.shards[1].file == "field.0002.0001.dat");
+
+    write_manifest("field.manifest", m);
+    auto r = read_manifest<2>("field.manifest");
+
+    assert(global_space(r) == global);
+    assert(r.shards.size() == 2);
+    assert(shard_space(r.shards[1]) == spaces[1]);
+    assert(r.shards[0].file == "field.0002.0000.dat");
+    assert(overlapping_shards(r, index_space(ivec(0, 4), uvec(2, 1))) == std::vector<std::size_t>{0});
+    assert(overlapping_shards(r, index_space(ivec(1, 4), uvec(3, 1))).size() == 2);
+
+    auto threw = false;
+    try {
+        make_manifest("bad", global, {index_space(ivec(-3, 3), uvec(2, 2))});
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Shards must not overlap, whether the manifest is made or read
+    auto overlapping = std::vector<index_space_t<2>>{spaces[0], index_space(ivec(1, 3), uvec(6, 5))};
+    threw = false;
+    try {
+        make_manifest("bad", global, overlapping);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    m.shards[1].start = ivec(1, 3);
+    m.shards[1].shape = uvec(6, 5);
+    write_manifest("bad.manifest", m);
+    threw = false;
+    try {
+        read_manifest<2>("bad.manifest");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_repartition() {
+    std::cout << "Testing sharded array repartitioning... ";
+
+    auto global = index_space(ivec(1, -1), uvec(13, 10));
+    auto value = [](const ivec_t<2>& i) {
+        return 100.0 * i[0] + i[1];
+    };
+
+    // Written as six uneven row bands, in parallel
+    auto bands = std::vector<index_space_t<2>>{};
+    for (unsigned int row = 0, height = 1; row < 13; row += height, ++height) {
+        bands.push_back(index_space(ivec(1 + static_cast<int>(row), -1), uvec(std::min(height, 13 - row), 10)));
+    }
+    write_shards<double>("array", global, bands, value, threads_t{._num_threads = 3});
+
+    // Read back whole, and as tiles that cut across the bands
+    auto whole = read_shards<double>("array.manifest", global, threads_t{._num_threads = 2});
+    for (auto i : global) {
+        assert(whole[ndoffset(global, i)] == value(i));
+    }
+    for (std::size_t n = 0; n < tile_count(global, uvec(4, 3)); ++n) {
+        auto tile = tile_at(global, uvec(4, 3), n);
+        auto part = read_shards<double>("array.manifest", tile);
+        for (auto i : tile) {
+            assert(part[ndoffset(tile, i)] == value(i));
+        }
+    }
+
+    // Reads must lie inside the global space and be covered by shards
+    auto threw = false;
+    try {
+        read_shards<double>("array.manifest", expand(global, 1));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    write_shards<double>("holes", global, {index_space(ivec(1, -1), uvec(5, 10))}, value);
+    threw = false;
+    try {
+        read_shards<double>("holes.manifest", index_space(ivec(5, 0), uvec(2, 2)));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_driver_shards() {
+    std::cout << "Testing sharded driver output... ";
+
+    for (int shard = 0; shard < 2; ++shard) {
+        auto cfg = config<decay::physics>{};
+        cfg.driver.t_final = 0.05;
+        cfg.physics.shard = shard;
+        run(cfg);
+    }
+    auto m = read_manifest<1>("chkpt.0000.manifest");
+    assert(global_space(m) == index_space(ivec(0), uvec(8)));
+    assert(m.shards.size() == 2);
+    assert(std::filesystem::exists("chkpt.0000.0001.dat"));
+    assert(!std::filesystem::exists("chkpt.0000.dat"));
+
+    // Reassemble the initial product from its shards
+    auto p = read_manifest<1>("prods.0000.manifest");
+    auto u = std::vector<double>{};
+
+    for (std::size_t k = 0; k < p.shards.size(); ++k) {
+        auto product = decay::product_t{};
+        auto space = read_shard<1>(shard_path(p, "prods.0000.manifest", k), "products", product);
+        assert(space == shard_space(p.shards[k]));
+        u.insert(u.end(), product.u.begin(), product.u.end());
+    }
+    assert((u == std::vector<double>{1, 2, 3, 4, 5, 6, 7, 8}));
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Shard I/O Tests ===\n\n";
+
+    auto dir = std::filesystem::temp_directory_path() / "mist_test_shards";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto cwd = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+
+    test_manifest();
+    test_repartition();
+    test_driver_shards();
+
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(dir);
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
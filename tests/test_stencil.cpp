@@ -0,0 +1,246 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/array.hpp"
+#include "mist/stencil.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// Helper functions
+// =============================================================================
+
+// Smooth, non-periodic test data over a space
+template<std::size_t S>
+std::vector<double> sample_data(const index_space_t<S>& space) {
+    auto u = std::vector<double>(size(space));
+    for (std::size_t n = 0; n < u.size(); ++n) {
+        auto i = ndindex(space, n);
+        double x = 0.0;
+        for (std::size_t a = 0; a < S; ++a) {
+            x += std::sin(0.3 * i[a] + a);
+        }
+        u[n] = x;
+    }
+    return u;
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_tiling() {
+    std::cout << "Testing tiling and index space helpers... ";
+
+    auto space = index_space(ivec(-2, 3), uvec(10, 7));
+    auto tile_shape = uvec(4u, 4u);
+    assert(tile_count(space, tile_shape) == 6);
+
+    unsigned int covered = 0;
+    for (std::size_t n = 0; n < tile_count(space, tile_shape); ++n) {
+        auto t = tile_at(space, tile_shape, n);
+        assert(intersect(t, space) == t);
+        covered += size(t);
+    }
+    assert(covered == size(space));
+    assert(tile_at(space, tile_shape, 5) == index_space(ivec(6, 7), uvec(2, 3)));
+
+    assert(expand(space, 2u) == index_space(ivec(-4, 1), uvec(14, 11)));
+    assert(expand(space, uvec(1u, 0u)) == index_space(ivec(-3, 3), uvec(12, 7)));
+    assert(size(intersect(space, index_space(ivec(20, 20), uvec(1, 1)))) == 0);
+
+    std::cout << "PASSED\n";
+}
+
+void test_fused_pipeline() {
+    std::cout << "Testing fused kernel pipeline... ";
+
+    // Interior zones, and input data with two ghost zones on each side
+    auto space = index_space(ivec(0, 0), uvec(37, 23));
+    auto padded = expand(space, 2u);
+    auto u = sample_data(padded);
+    auto uv = view(u, padded);
+
+    // Unfused reference: primitive recovery, face fluxes, then update
+    auto prim = std::vector<double>(size(padded));
+    auto flux = std::vector<double>(size(padded));
+    auto expected = std::vector<double>(size(space));
+    auto fluxes = expand(space, 1u);
+    for_each(padded, [&](ivec_t<2> i) { view(prim, padded)[i] = 2.0 * uv[i]; });
+    for_each(fluxes, [&](ivec_t<2> i) {
+        view(flux, padded)[i] = view(prim, padded)[i - ivec(1, 0)] * view(prim, padded)[i - ivec(0, 1)];
+    });
+    for_each(space, [&](ivec_t<2> i) {
+        auto f = view(flux, padded);
+        view(expected, space)[i] = f[i + ivec(1, 0)] - f[i] + f[i + ivec(0, 1)] - f[i];
+    });
+
+    // Fused: the three kernels run in one traversal, with per-tile scratch
+    for (auto tile_shape : {uvec(8u, 8u), uvec(5u, 64u), uvec(1u, 1u)}) {
+        auto result = std::vector<double>(size(space), 0.0);
+        auto rv = view(result, space);
+
+        fused_for_each(space, tile_shape, threads_t{._chunking = chunking::dynamic, ._num_threads = 3},
+            stage<double>(0, [&](ivec_t<2> i) {
+                return 2.0 * uv[i];
+            }),
+            stage<double>(1, [](ivec_t<2> i, auto p) {
+                return p[i - ivec(1, 0)] * p[i - ivec(0, 1)];
+            }),
+            stage<void>(1, [&](ivec_t<2> i, auto, auto f) {
+                rv[i] = f[i + ivec(1, 0)] - f[i] + f[i + ivec(0, 1)] - f[i];
+            })
+        );
+        assert(result == expected);
+    }
+
+    // Tile shapes must be positive along every axis
+    bool threw = false;
+    try {
+        fused_for_each(space, uvec(8u, 0u), cpu_t{}, stage<void>(0, [](ivec_t<2>) {}));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_temporal_blocking() {
+    std::cout << "Testing temporal blocking... ";
+
+    auto diffuse = [](auto i, const auto& u, unsigned int) {
+        auto sum = 0.0;
+        for (std::size_t a = 0; a < 3; ++a) {
+            auto e = ivec(0, 0, 0);
+            e[a] = 1;
+            sum += u[i + e] + u[i - e] - 2.0 * u[i];
+        }
+        return u[i] + 0.1 * sum;
+    };
+
+    auto space = index_space(ivec(0, 0, 0), uvec(13, 9, 17));
+    unsigned int steps = 4;
+    auto padded = expand(space, steps);
+    auto u0 = sample_data(padded);
+
+    // Reference: full sweeps over a shrinking region of deep ghost zones
+    auto ref = u0;
+    auto tmp = u0;
+    for (unsigned int step = 1; step <= steps; ++step) {
+        auto src = view(std::as_const(ref), padded);
+        auto out = view(tmp, padded);
+        for_each(expand(space, steps - step), [&](ivec_t<3> i) { out[i] = diffuse(i, src, step); });
+        std::swap(ref, tmp);
+    }
+
+    for (auto tile_shape : {uvec(4u, 4u, 4u), uvec(16u, 3u, 8u)}) {
+        auto result = std::vector<double>(size(space));
+        temporal_for_each(space, tile_shape, threads_t{._num_threads = 2}, steps, 1,
+            view(std::as_const(u0), padded), view(result, space), diffuse);
+
+        for_each(space, [&](ivec_t<3> i) {
+            assert(view(result, space)[i] == view(ref, padded)[i]);
+        });
+    }
+
+    // The source must hold steps * radius ghost zones
+    bool threw = false;
+    try {
+        auto result = std::vector<double>(size(space));
+        temporal_for_each(space, uvec(4u, 4u, 4u), cpu_t{}, steps + 1, 1,
+            view(std::as_const(u0), padded), view(result, space), diffuse);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    threw = false;
+    try {
+        auto result = std::vector<double>(size(space));
+        temporal_for_each(space, uvec(4u, 0u, 4u), cpu_t{}, steps, 1,
+            view(std::as_const(u0), padded), view(result, space), diffuse);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // The source and destination must not overlap
+    threw = false;
+    try {
+        auto u = u0;
+        temporal_for_each(space, uvec(4u, 4u, 4u), cpu_t{}, steps, 1,
+            view(std::as_const(u), padded), view(u, padded), diffuse);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    std::cout << "PASSED\n";
+}
+
+void test_pencil_sweeps() {
+    std::cout << "Testing pencil sweeps... ";
+
+    auto space = index_space(ivec(0, -3, 2), uvec(6, 9, 7));
+
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+        auto width = uvec_t<3>{};
+        width[axis] = 2;
+        auto src_space = expand(space, width);
+        auto u = sample_data(src_space);
+        auto result = std::vector<double>(size(space));
+        auto src = view(std::as_const(u), src_space);
+
+        pencil_for_each(space, axis, 2, threads_t{._num_threads = 3}, src, view(result, space),
+            [](auto in, auto out, auto pencil) {
+                assert(shape(pencil)[0] * shape(pencil)[1] * shape(pencil)[2] == size(domain(out)));
+                for (auto i : domain(out)) {
+                    out[i] = in[i - ivec(2)] - 2.0 * in[i] + in[i + ivec(2)];
+                }
+            });
+
+        auto step = ivec_t<3>{};
+        step[axis] = 2;
+        for (auto i : space) {
+            auto expected = src[i - step] - 2.0 * src[i] + src[i + step];
+            assert(std::abs(result[ndoffset(space, i)] - expected) < 1e-14);
+        }
+    }
+
+    // In place, without ghost zones: reverse every pencil along axis 2
+    auto u = sample_data(space);
+    auto v = u;
+    pencil_for_each(space, 2, 0, cpu_t{}, view(std::as_const(u), space), view(u, space),
+        [](auto in, auto out, auto) {
+            auto lo = start(domain(out))[0];
+            auto hi = lo + static_cast<int>(size(domain(out))) - 1;
+            for (auto i : domain(out)) {
+                out[i] = in[ivec(hi - (i[0] - lo))];
+            }
+        });
+    for (auto i : space) {
+        assert(u[ndoffset(space, i)] == v[ndoffset(space, ivec(i[0], i[1], 2 + 8 - i[2]))]);
+    }
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Stencil Library Tests ===\n\n";
+
+    test_tiling();
+    test_fused_pipeline();
+    test_temporal_blocking();
+    test_pencil_sweeps();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}
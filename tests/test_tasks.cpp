@@ -0,0 +1,176 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include "mist/core.hpp"
+#include "mist/tasks.hpp"
+
+using namespace mist;
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+void test_dependency_order() {
+    std::cout << "Testing task dependency order... ";
+
+    auto pool = task_pool_t(4);
+    auto clock = std::atomic<int>(0);
+    auto started = std::vector<int>(200, -1);
+    auto finished = std::vector<int>(200, -1);
+    auto deps = std::vector<std::vector<task_id>>(200);
+    auto g = task_graph_t{};
+
+    // A layered graph: each task depends on up to three tasks of the layer
+    // before it
+    for (task_id t = 0; t < 200; ++t) {
+        if (t >= 10) {
+            auto layer = t / 10;
+            for (task_id k = 0; k < t % 4; ++k) {
+                deps[t].push_back((layer - 1) * 10 + (t + 3 * k) % 10);
+            }
+        }
+        auto id = add_task(g, [&, t] {
+            started[t] = clock++;
+            finished[t] = clock++;
+        }, deps[t]);
+        assert(id == t);
+    }
+    assert(size(g) == 200);
+
+    for (int repeat = 0; repeat < 20; ++repeat) {
+        run(g, pool);
+
+        for (task_id t = 0; t < 200; ++t) {
+            assert(started[t] >= 0);
+            for (auto d : deps[t]) {
+                assert(finished[d] < started[t]);
+            }
+        }
+    }
+
+    std::cout << "PASSED\n";
+}
+
+void test_tile_tasks() {
+    std::cout << "Testing per-tile tasks... ";
+
+    auto pool = task_pool_t(3);
+    auto space = index_space(ivec(-2, 1), uvec(37, 23));
+    auto u = std::vector<double>(size(space), 0.0);
+    auto g = task_graph_t{};
+
+    auto first = add_tile_tasks(g, space, uvec(8, 8), [&](const index_space_t<2>& tile) {
+        for (auto i : tile) {
+            u[ndoffset(space, i)] += 1.0;
+        }
+    });
+    auto second = add_tile_tasks(g, space, uvec(16, 4), [&](const index_space_t<2>& tile) {
+        for (auto i : tile) {
+            u[ndoffset(space, i)] *= 3.0;
+        }
+    }, {first});
+    auto total = 0.0;
+    add_task(g, [&] {
+        for (auto x : u) total += x;
+    }, {second});
+
+    run(g, pool);
+    assert(total == 3.0 * size(space));
+
+    // A sweep over an empty space still orders the tasks around it
+    auto h = task_graph_t{};
+    auto empty = add_tile_tasks(h, index_space(ivec(0), uvec(0)), uvec(4), [](const index_space_t<1>&) {});
+    assert(empty == 0);
+
+    std::cout << "PASSED\n";
+}
+
+void test_task_errors() {
+    std::cout << "Testing task errors... ";
+
+    auto pool = task_pool_t(2);
+    auto g = task_graph_t{};
+    auto ran_dependent = false;
+    auto ran_independent = std::atomic<int>(0);
+
+    auto bad = add_task(g, [] { throw std::runtime_error("bad task"); });
+    add_task(g, [&] { ran_dependent = true; }, {bad});
+
+    for (int k = 0; k < 4; ++k) {
+        add_task(g, [&] { ran_independent++; });
+    }
+
+    auto threw = false;
+    try {
+        run(g, pool);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+    assert(!ran_dependent);
+
+    // Dependencies must refer to earlier tasks
+    threw = false;
+    try {
+        add_task(g, [] {}, {size(g)});
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // The pool is still usable, including with a single worker
+    auto count = std::atomic<int>(0);
+    auto h = task_graph_t{};
+    auto a = add_task(h, [&] { count++; });
+    add_task(h, [&] { count++; }, {a, a});
+    run(h, pool);
+    auto serial = task_pool_t(1);
+    run(h, serial);
+    run(task_graph_t{}, serial);
+    assert(count == 4);
+
+    std::cout << "PASSED\n";
+}
+
+void test_pinned_pool() {
+    std::cout << "Testing pinned task pools... ";
+
+    auto pool = task_pool_t(3, affinity_t{affinity::compact, {}});
+    auto count = std::atomic<int>(0);
+    auto g = task_graph_t{};
+    for (int k = 0; k < 8; ++k) {
+        add_task(g, [&] { count++; });
+    }
+
+    // The calling thread runs tasks as worker 0, but gets its mask back
+    #ifdef __linux__
+    cpu_set_t before, after;
+    pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+    run(g, pool);
+    pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+    assert(CPU_EQUAL(&before, &after));
+    #else
+    run(g, pool);
+    #endif
+    assert(count == 8);
+
+    std::cout << "PASSED\n";
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main() {
+    std::cout << "=== Task Graph Tests ===\n\n";
+
+    test_dependency_order();
+    test_tile_tasks();
+    test_task_errors();
+    test_pinned_pool();
+
+    std::cout << "\n=== All tests passed! ===\n";
+    return 0;
+}